@@ -0,0 +1,90 @@
+// Microbenchmark de aciertos de la caché de páginas: mide cuántas búsquedas
+// obtener_pagina()/soltar_pagina() por segundo completan N hilos sobre un conjunto
+// de páginas ya cargadas, para comprobar que el camino de lectura escala con los hilos.
+//
+// Compilar y ejecutar desde la raíz del repositorio (usa paginas/ e imagenes/):
+//   make bench/bench_cache
+// o a mano:
+//   gcc -O2 -pthread -o bench_cache bench/bench_cache.c buffer.c metricas.c registro.c segmento.c -lz
+//   ./bench_cache [segundos por prueba] [hilos máximos]
+
+#include "../servidor_web.h"
+
+static const char *rutas[] = {
+    "/index.html", "/quienes.html", "/productos.html", "/sedes.html", "/contacto.html",
+    "/Logo_empresa.png", "/Contacto.png", "/Contactos2.png",
+};
+#define NUM_RUTAS (sizeof(rutas) / sizeof(rutas[0]))
+
+static BufferPaginas buffer;
+static atomic_int corriendo;
+
+typedef struct {
+    unsigned long long busquedas;
+} __attribute__((aligned(64))) ResultadoHilo;
+
+static void *hilo_busquedas(void *arg) {
+    ResultadoHilo *resultado = arg;
+    unsigned long long busquedas = 0;
+    unsigned int i = (unsigned int)(uintptr_t)arg;
+    while (atomic_load_explicit(&corriendo, memory_order_relaxed)) {
+        Pagina *pagina = obtener_pagina(&buffer, rutas[i++ % NUM_RUTAS]);
+        if (pagina) {
+            soltar_pagina(pagina);
+        }
+        busquedas++;
+    }
+    resultado->busquedas = busquedas;
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    double segundos = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_hilos = argc > 2 ? atoi(argv[2]) : 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_hilos < 1) {
+        max_hilos = 1;
+    }
+
+    // Los mensajes de carga de la caché no interesan aquí.
+    if (!freopen("/dev/null", "w", stdout)) {
+        return EXIT_FAILURE;
+    }
+    ConfigServidor config = {.cache_bytes = CACHE_BYTES_DEFECTO, .compresion = COMPRIMIR_GZIP, .nivel_gzip = NIVEL_GZIP_DEFECTO,
+                             .umbral_transmision = UMBRAL_TRANSMISION_DEFECTO};
+    inicializar_buffer(&buffer, &config);
+    for (size_t i = 0; i < NUM_RUTAS; i++) {
+        Pagina *pagina = obtener_pagina(&buffer, rutas[i]);
+        if (!pagina) {
+            fprintf(stderr, "No se encontró %s; ejecutar desde la raíz del repositorio.\n", rutas[i]);
+            return EXIT_FAILURE;
+        }
+        soltar_pagina(pagina);
+    }
+
+    fprintf(stderr, "%-6s %16s %14s\n", "hilos", "aciertos/s", "escalado");
+    double base = 0;
+    for (int hilos = 1; hilos <= max_hilos; hilos *= 2) {
+        pthread_t ids[hilos];
+        ResultadoHilo *resultados = aligned_alloc(64, sizeof(ResultadoHilo) * hilos);
+        atomic_store(&corriendo, 1);
+        for (int i = 0; i < hilos; i++) {
+            pthread_create(&ids[i], NULL, hilo_busquedas, &resultados[i]);
+        }
+        usleep((useconds_t)(segundos * 1e6));
+        atomic_store(&corriendo, 0);
+
+        unsigned long long total = 0;
+        for (int i = 0; i < hilos; i++) {
+            pthread_join(ids[i], NULL);
+            total += resultados[i].busquedas;
+        }
+        free(resultados);
+
+        double por_segundo = total / segundos;
+        if (hilos == 1) {
+            base = por_segundo;
+        }
+        fprintf(stderr, "%-6d %16.0f %13.2fx\n", hilos, por_segundo, por_segundo / base);
+    }
+    return EXIT_SUCCESS;
+}
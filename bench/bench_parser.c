@@ -0,0 +1,101 @@
+// Microbenchmark del analizador de peticiones: mide cuántas peticiones por segundo
+// analiza analizar_peticion() con peticiones típicas, llegando de una vez o troceadas
+// en lecturas pequeñas (el análisis incremental retoma en cada trozo).
+//
+// Compilar y ejecutar desde la raíz del repositorio:
+//   make bench/bench_parser
+// o a mano:
+//   gcc -O2 -o bench_parser bench/bench_parser.c parser_http.c
+//   ./bench_parser [segundos por prueba]
+
+#include "../servidor_web.h"
+
+static const char *const peticiones[] = {
+    // curl
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:8000\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // navegador revalidando una página
+    "GET /productos.html?categoria=hogar&pagina=2 HTTP/1.1\r\n"
+    "Host: localhost:8000\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Referer: http://localhost:8000/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: es-ES,es;q=0.9,en;q=0.8\r\n"
+    "If-None-Match: \"86942484-17d1\"\r\n"
+    "If-Modified-Since: Tue, 01 Oct 2024 10:00:00 GMT\r\n"
+    "\r\n",
+    // con cuerpo
+    "POST /contacto.html HTTP/1.1\r\n"
+    "Host: localhost:8000\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 26\r\n"
+    "\r\n"
+    "nombre=Ana&mensaje=Hola+:)",
+};
+#define NUM_PETICIONES (sizeof(peticiones) / sizeof(peticiones[0]))
+
+static double segundos_desde(const struct timespec *inicio) {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (ahora.tv_sec - inicio->tv_sec) + (ahora.tv_nsec - inicio->tv_nsec) / 1e9;
+}
+
+// Analiza 'peticion' entregándola en trozos de 'trozo' bytes (0: de una vez) hasta
+// agotar 'segundos'. Devuelve peticiones por segundo.
+static double medir(const char *peticion, size_t trozo, double segundos) {
+    LimitesHttp limites = {LIMITE_URI_DEFECTO, MAX_ENCABEZADOS_HTTP, LIMITE_CUERPO_DEFECTO};
+    size_t tam = strlen(peticion);
+    PeticionHttp analizada;
+    unsigned long long analizadas = 0;
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    do {
+        for (int i = 0; i < 1000; i++) {
+            iniciar_peticion_http(&analizada);
+            size_t disponibles = trozo ? 0 : tam;
+            int estado;
+            for (;;) {
+                if (trozo) {
+                    disponibles = disponibles + trozo < tam ? disponibles + trozo : tam;
+                }
+                estado = analizar_peticion(&analizada, peticion, disponibles, &limites);
+                if (estado != ANALISIS_INCOMPLETO || disponibles == tam) {
+                    break;
+                }
+            }
+            if (estado != ANALISIS_COMPLETO || analizada.longitud != tam) {
+                fprintf(stderr, "Resultado inesperado (%d) analizando:\n%s\n", estado, peticion);
+                exit(EXIT_FAILURE);
+            }
+        }
+        analizadas += 1000;
+    } while (segundos_desde(&inicio) < segundos);
+    return analizadas / segundos_desde(&inicio);
+}
+
+int main(int argc, char *argv[]) {
+    double segundos = argc > 1 ? atof(argv[1]) : 1.0;
+    static const size_t trozos[] = {0, 64, 1};
+
+    printf("%-10s %8s %10s %16s %10s\n", "peticion", "bytes", "trozo", "peticiones/s", "MB/s");
+    for (size_t p = 0; p < NUM_PETICIONES; p++) {
+        size_t tam = strlen(peticiones[p]);
+        for (size_t t = 0; t < sizeof(trozos) / sizeof(trozos[0]); t++) {
+            double por_segundo = medir(peticiones[p], trozos[t], segundos);
+            char trozo[16];
+            snprintf(trozo, sizeof(trozo), trozos[t] ? "%zu" : "entera", trozos[t]);
+            printf("%-10zu %8zu %10s %16.0f %10.1f\n", p, tam, trozo, por_segundo, por_segundo * tam / 1e6);
+        }
+    }
+    return EXIT_SUCCESS;
+}
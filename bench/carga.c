@@ -0,0 +1,638 @@
+// Generador de carga HTTP para medir el servidor en local. Reparte las conexiones
+// entre varios hilos, cada uno con su instancia epoll, y guarda la latencia de cada
+// respuesta en un histograma log-lineal. Dos modos:
+//   cerrado  cada conexión pide lo siguiente en cuanto recibe la respuesta: mide el
+//            rendimiento máximo con 'conexiones' clientes concurrentes
+//   abierto  las peticiones se programan a tasa constante, respondan o no las
+//            anteriores; la latencia se cuenta desde el instante programado, así que
+//            la espera por una conexión libre también cuenta (sin omisión coordinada)
+// Escenarios:
+//   html       las páginas de paginas/ con keep-alive y Accept-Encoding: gzip
+//   imagenes   cargas de página completas: un HTML seguido de todas las imágenes
+//   expulsion  todo paginas/ e imagenes/ en orden aleatorio; con una caché pequeña
+//              (SERVIDOR_CACHE_KB) el conjunto de trabajo no cabe y se expulsa sin parar
+//   lentos     como html, más conexiones que envían su petición byte a byte (-l)
+//   rotacion   una conexión nueva por petición (Connection: close)
+// El resultado es una línea JSON en la salida estándar, para comparar ejecuciones;
+// el resumen legible va a la salida de errores. Se ejecuta desde la raíz del
+// repositorio (lee paginas/ e imagenes/ para construir las rutas).
+//
+// Compilar:
+//   make bench/carga
+// o a mano:
+//   gcc -O2 -pthread -o carga bench/carga.c
+// Ejemplos:
+//   bench/carga -e html -c 64 -d 10
+//   bench/carga -e html -m abierto -r 5000 -d 10
+//   bench/carga -e lentos -c 32 -l 64 -E hilos
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#define NUM_CUBETAS 312              // mismo esquema que los histogramas de metricas.c
+#define MAX_RUTAS 1024
+#define MAX_HILOS_CARGA 64
+#define TAMANO_LECTURA 16384
+#define CAPACIDAD_PENDIENTES 65536   // peticiones programadas a la espera de conexión (abierto)
+#define INTERVALO_LENTO_NS 100000000ULL // un byte cada 100 ms en las conexiones lentas
+
+typedef enum { ESCENARIO_HTML, ESCENARIO_IMAGENES, ESCENARIO_EXPULSION, ESCENARIO_LENTOS, ESCENARIO_ROTACION,
+               NUM_ESCENARIOS } Escenario;
+static const char *nombres_escenario[NUM_ESCENARIOS] = {"html", "imagenes", "expulsion", "lentos", "rotacion"};
+
+typedef enum {
+    CLIENTE_LIBRE,      // sin petición en curso (y quizá sin conexión)
+    CLIENTE_CONECTANDO,
+    CLIENTE_ENVIANDO,
+    CLIENTE_LEYENDO
+} EstadoCliente;
+
+typedef struct {
+    int fd;
+    EstadoCliente estado;
+    int lento;                 // envía la petición byte a byte y no se mide
+    const char *peticion;
+    size_t tam_peticion;
+    size_t enviados;
+    char encabezado[TAMANO_LECTURA];
+    size_t leidos;             // bytes del encabezado de respuesta acumulados
+    long long cuerpo_restante; // -1 mientras no se ha leído el encabezado entero
+    int cerrar;                // la respuesta trae Connection: close
+    int codigo;
+    uint64_t inicio_ns;        // envío (cerrado) o instante programado (abierto)
+    uint64_t proximo_byte_ns;
+    unsigned int siguiente;    // posición en la secuencia de rutas
+} Cliente;
+
+typedef struct {
+    int id;
+    pthread_t hilo;
+    int epoll_fd;
+    Cliente *clientes;
+    int num_clientes;
+    unsigned int semilla;
+    uint64_t intervalo_ns;     // entre peticiones programadas (abierto)
+    uint64_t proxima_ns;
+    uint64_t *pendientes;      // anillo de instantes programados sin conexión libre
+    size_t cabeza, cola;
+    uint64_t cubetas[NUM_CUBETAS];
+    uint64_t completadas, errores, no_2xx, descartadas, bytes;
+    uint64_t suma_ns, maximo_ns;
+} HiloCarga;
+
+// Opciones de la ejecución
+static struct sockaddr_in destino;
+static Escenario escenario = ESCENARIO_HTML;
+static int modo_abierto = 0;
+static int num_conexiones = 64;
+static int num_lentas = 32;
+static int num_hilos = 1;
+static double tasa = 1000;
+static double duracion = 10;
+static double calentamiento = 1;
+static const char *etiqueta = NULL;
+
+static char *peticiones[MAX_RUTAS];
+static size_t tam_peticiones[MAX_RUTAS];
+static int num_rutas;
+static int num_paginas; // las primeras 'num_paginas' rutas son HTML; el resto, imágenes
+static uint64_t inicio_medida_ns, fin_ns;
+
+static uint64_t ahora_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Cubetas log-lineales: 16 exactas y 8 por potencia de 2, error relativo máximo del 12,5 %.
+static int cubeta(uint64_t ns) {
+    if (ns < 16) {
+        return (int)ns;
+    }
+    int magnitud = 63 - __builtin_clzll(ns);
+    int indice = 16 + (magnitud - 4) * 8 + (int)((ns >> (magnitud - 3)) & 7);
+    return indice < NUM_CUBETAS ? indice : NUM_CUBETAS - 1;
+}
+
+static uint64_t limite_cubeta(int indice) {
+    if (indice < 16) {
+        return (uint64_t)indice + 1;
+    }
+    int magnitud = 4 + (indice - 16) / 8;
+    uint64_t sub = (indice - 16) % 8;
+    return ((8 + sub + 1) << (magnitud - 3));
+}
+
+// Percentil 'p' (0-1) como límite superior de su cubeta, sin pasar del máximo observado.
+static uint64_t percentil(const uint64_t *cubetas, uint64_t total, double p, uint64_t maximo) {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t objetivo = (uint64_t)(p * total);
+    if (objetivo >= total) {
+        objetivo = total - 1;
+    }
+    uint64_t acumulado = 0;
+    for (int i = 0; i < NUM_CUBETAS; i++) {
+        acumulado += cubetas[i];
+        if (acumulado > objetivo) {
+            return limite_cubeta(i) < maximo ? limite_cubeta(i) : maximo;
+        }
+    }
+    return maximo;
+}
+
+static int agregar_ruta(const char *directorio, const char *nombre) {
+    if (num_rutas >= MAX_RUTAS) {
+        return -1;
+    }
+    char texto[512];
+    int n = snprintf(texto, sizeof(texto),
+                     "GET /%s%s HTTP/1.1\r\n"
+                     "Host: %s:%d\r\n"
+                     "User-Agent: carga\r\n"
+                     "Accept-Encoding: gzip\r\n"
+                     "%s"
+                     "\r\n",
+                     directorio, nombre, inet_ntoa(destino.sin_addr), ntohs(destino.sin_port),
+                     escenario == ESCENARIO_ROTACION ? "Connection: close\r\n" : "");
+    if (n < 0 || (size_t)n >= sizeof(texto)) {
+        return -1;
+    }
+    peticiones[num_rutas] = strdup(texto);
+    tam_peticiones[num_rutas] = n;
+    num_rutas++;
+    return 0;
+}
+
+// Construye las peticiones a partir de los archivos de un directorio de contenido.
+static void agregar_directorio(const char *directorio) {
+    DIR *dir = opendir(directorio);
+    if (!dir) {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_type == DT_REG) {
+            agregar_ruta(strcmp(directorio, "imagenes") == 0 ? "imagenes/" : "", ent->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+// Ruta de la siguiente petición de un cliente según el escenario.
+static int elegir_ruta(HiloCarga *hilo, Cliente *cliente) {
+    switch (escenario) {
+    case ESCENARIO_IMAGENES:
+        // Una página y después todas las imágenes, como un navegador con la caché vacía.
+        if (cliente->siguiente % (num_rutas - num_paginas + 1) == 0) {
+            return (cliente->siguiente++ / (num_rutas - num_paginas + 1)) % num_paginas;
+        }
+        return num_paginas + (cliente->siguiente++ % (num_rutas - num_paginas + 1)) - 1;
+    case ESCENARIO_EXPULSION:
+        return rand_r(&hilo->semilla) % num_rutas;
+    default:
+        return cliente->siguiente++ % num_paginas;
+    }
+}
+
+static void cerrar_cliente(HiloCarga *hilo, Cliente *cliente) {
+    if (cliente->fd >= 0) {
+        epoll_ctl(hilo->epoll_fd, EPOLL_CTL_DEL, cliente->fd, NULL);
+        close(cliente->fd);
+        cliente->fd = -1;
+    }
+    cliente->estado = CLIENTE_LIBRE;
+}
+
+static int abrir_conexion(HiloCarga *hilo, Cliente *cliente) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int uno = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &uno, sizeof(uno));
+    if (escenario == ESCENARIO_ROTACION) {
+        // Cierre con RST: el cliente no acumula TIME_WAIT ni agota los puertos efímeros.
+        struct linger sin_espera = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &sin_espera, sizeof(sin_espera));
+    }
+    if (connect(fd, (struct sockaddr *)&destino, sizeof(destino)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = cliente};
+    if (epoll_ctl(hilo->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return -1;
+    }
+    cliente->fd = fd;
+    cliente->estado = CLIENTE_CONECTANDO;
+    return 0;
+}
+
+static void vigilar(HiloCarga *hilo, Cliente *cliente, uint32_t eventos) {
+    struct epoll_event ev = {.events = eventos, .data.ptr = cliente};
+    epoll_ctl(hilo->epoll_fd, EPOLL_CTL_MOD, cliente->fd, &ev);
+}
+
+// Empieza una petición en un cliente libre; 'inicio_ns' es desde cuándo cuenta su latencia.
+static void empezar_peticion(HiloCarga *hilo, Cliente *cliente, uint64_t inicio_ns) {
+    int ruta = elegir_ruta(hilo, cliente);
+    cliente->peticion = peticiones[ruta];
+    cliente->tam_peticion = tam_peticiones[ruta];
+    cliente->enviados = 0;
+    cliente->leidos = 0;
+    cliente->cuerpo_restante = -1;
+    cliente->cerrar = 0;
+    cliente->inicio_ns = inicio_ns;
+    cliente->proximo_byte_ns = 0;
+    if (cliente->fd < 0) {
+        if (abrir_conexion(hilo, cliente) < 0) {
+            // El cliente queda libre; en el modo cerrado se reintenta en la siguiente vuelta.
+            if (!cliente->lento && inicio_ns >= inicio_medida_ns) {
+                hilo->errores++;
+            }
+            return;
+        }
+    } else {
+        cliente->estado = CLIENTE_ENVIANDO;
+        vigilar(hilo, cliente, cliente->lento ? 0 : EPOLLOUT); // los lentos van al ritmo del temporizador
+    }
+}
+
+// Siguiente petición de un cliente que queda libre: en el modo cerrado sale enseguida;
+// en el abierto, solo si hay alguna programada esperando.
+static void siguiente_peticion(HiloCarga *hilo, Cliente *cliente, uint64_t ahora) {
+    if (cliente->lento || !modo_abierto) {
+        empezar_peticion(hilo, cliente, ahora);
+    } else if (hilo->cola != hilo->cabeza) {
+        empezar_peticion(hilo, cliente, hilo->pendientes[hilo->cola++ % CAPACIDAD_PENDIENTES]);
+    }
+}
+
+static void fallo(HiloCarga *hilo, Cliente *cliente, uint64_t ahora) {
+    if (!cliente->lento && cliente->inicio_ns >= inicio_medida_ns) {
+        hilo->errores++;
+    }
+    cerrar_cliente(hilo, cliente);
+    if (ahora < fin_ns) {
+        siguiente_peticion(hilo, cliente, ahora);
+    }
+}
+
+static void registrar(HiloCarga *hilo, Cliente *cliente, uint64_t ahora) {
+    if (cliente->lento || cliente->inicio_ns < inicio_medida_ns) {
+        return;
+    }
+    uint64_t ns = ahora - cliente->inicio_ns;
+    hilo->cubetas[cubeta(ns)]++;
+    hilo->completadas++;
+    hilo->suma_ns += ns;
+    if (ns > hilo->maximo_ns) {
+        hilo->maximo_ns = ns;
+    }
+    if (cliente->codigo < 200 || cliente->codigo > 299) {
+        hilo->no_2xx++;
+    }
+}
+
+// Analiza el encabezado de respuesta cuando ya está completo. Devuelve -1 si no es válido.
+static int analizar_respuesta(Cliente *cliente, size_t fin_encabezado) {
+    cliente->encabezado[fin_encabezado - 1] = '\0';
+    if (sscanf(cliente->encabezado, "HTTP/1.%*d %d", &cliente->codigo) != 1) {
+        return -1;
+    }
+    long long longitud = 0;
+    for (char *linea = strstr(cliente->encabezado, "\r\n"); linea; linea = strstr(linea + 2, "\r\n")) {
+        if (strncasecmp(linea + 2, "Content-Length:", 15) == 0) {
+            longitud = atoll(linea + 17);
+        } else if (strncasecmp(linea + 2, "Connection: close", 17) == 0) {
+            cliente->cerrar = 1;
+        }
+    }
+    cliente->cuerpo_restante = longitud - (long long)(cliente->leidos - fin_encabezado);
+    return 0;
+}
+
+static void leer(HiloCarga *hilo, Cliente *cliente, uint64_t ahora) {
+    for (;;) {
+        static __thread char descarte[65536];
+        char *destino_lectura = cliente->cuerpo_restante < 0 ? cliente->encabezado + cliente->leidos : descarte;
+        size_t espacio = cliente->cuerpo_restante < 0 ? sizeof(cliente->encabezado) - 1 - cliente->leidos : sizeof(descarte);
+        if (espacio == 0) {
+            fallo(hilo, cliente, ahora); // encabezado de respuesta demasiado grande
+            return;
+        }
+        ssize_t n = recv(cliente->fd, destino_lectura, espacio, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            fallo(hilo, cliente, ahora);
+            return;
+        }
+        if (n == 0) {
+            fallo(hilo, cliente, ahora);
+            return;
+        }
+        hilo->bytes += n;
+        if (cliente->cuerpo_restante < 0) {
+            size_t antes = cliente->leidos;
+            cliente->leidos += n;
+            cliente->encabezado[cliente->leidos] = '\0';
+            char *fin = strstr(cliente->encabezado + (antes > 3 ? antes - 3 : 0), "\r\n\r\n");
+            if (!fin) {
+                continue;
+            }
+            if (analizar_respuesta(cliente, fin + 4 - cliente->encabezado) < 0) {
+                fallo(hilo, cliente, ahora);
+                return;
+            }
+        } else {
+            cliente->cuerpo_restante -= n;
+        }
+        if (cliente->cuerpo_restante <= 0) {
+            uint64_t fin_respuesta = ahora_ns();
+            registrar(hilo, cliente, fin_respuesta);
+            if (cliente->cerrar || escenario == ESCENARIO_ROTACION) {
+                cerrar_cliente(hilo, cliente);
+            } else {
+                cliente->estado = CLIENTE_LIBRE;
+                vigilar(hilo, cliente, 0);
+            }
+            if (fin_respuesta < fin_ns) {
+                siguiente_peticion(hilo, cliente, fin_respuesta);
+            }
+            return;
+        }
+    }
+}
+
+static void enviar(HiloCarga *hilo, Cliente *cliente, uint64_t ahora) {
+    while (cliente->enviados < cliente->tam_peticion) {
+        if (cliente->lento) {
+            if (ahora < cliente->proximo_byte_ns) {
+                return;
+            }
+            cliente->proximo_byte_ns = ahora + INTERVALO_LENTO_NS;
+        }
+        size_t tam = cliente->lento ? 1 : cliente->tam_peticion - cliente->enviados;
+        ssize_t n = send(cliente->fd, cliente->peticion + cliente->enviados, tam, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            fallo(hilo, cliente, ahora);
+            return;
+        }
+        cliente->enviados += n;
+    }
+    cliente->estado = CLIENTE_LEYENDO;
+    vigilar(hilo, cliente, EPOLLIN);
+}
+
+static void atender_evento(HiloCarga *hilo, Cliente *cliente, uint32_t eventos, uint64_t ahora) {
+    if (cliente->estado == CLIENTE_CONECTANDO) {
+        int error = 0;
+        socklen_t tam = sizeof(error);
+        if ((eventos & (EPOLLERR | EPOLLHUP)) ||
+            getsockopt(cliente->fd, SOL_SOCKET, SO_ERROR, &error, &tam) < 0 || error != 0) {
+            fallo(hilo, cliente, ahora);
+            return;
+        }
+        cliente->estado = CLIENTE_ENVIANDO;
+        if (cliente->lento) {
+            vigilar(hilo, cliente, 0); // los bytes salen al ritmo del temporizador
+        }
+    }
+    if (cliente->estado == CLIENTE_ENVIANDO) {
+        enviar(hilo, cliente, ahora);
+    } else if (cliente->estado == CLIENTE_LEYENDO) {
+        leer(hilo, cliente, ahora);
+    } else if (eventos & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+        cerrar_cliente(hilo, cliente); // el servidor cerró una conexión keep-alive ociosa
+    }
+}
+
+static void *hilo_carga(void *arg) {
+    HiloCarga *hilo = arg;
+    struct epoll_event eventos[256];
+    uint64_t ahora = ahora_ns();
+    hilo->proxima_ns = ahora;
+    for (int i = 0; i < hilo->num_clientes; i++) {
+        Cliente *cliente = &hilo->clientes[i];
+        if (cliente->lento || !modo_abierto) {
+            empezar_peticion(hilo, cliente, ahora);
+        }
+    }
+
+    while ((ahora = ahora_ns()) < fin_ns) {
+        // Modo abierto: se programan las peticiones que ya tocan y se reparten entre
+        // los clientes libres; las que no tienen cliente esperan en el anillo.
+        if (modo_abierto) {
+            while (hilo->proxima_ns <= ahora) {
+                if (hilo->cabeza - hilo->cola < CAPACIDAD_PENDIENTES) {
+                    hilo->pendientes[hilo->cabeza++ % CAPACIDAD_PENDIENTES] = hilo->proxima_ns;
+                } else if (hilo->proxima_ns >= inicio_medida_ns) {
+                    hilo->descartadas++;
+                }
+                hilo->proxima_ns += hilo->intervalo_ns;
+            }
+            for (int i = 0; i < hilo->num_clientes && hilo->cola != hilo->cabeza; i++) {
+                Cliente *cliente = &hilo->clientes[i];
+                if (!cliente->lento && cliente->estado == CLIENTE_LIBRE) {
+                    empezar_peticion(hilo, cliente, hilo->pendientes[hilo->cola++ % CAPACIDAD_PENDIENTES]);
+                }
+            }
+        }
+        uint64_t espera_ns = 100000000ULL;
+        for (int i = 0; i < hilo->num_clientes; i++) {
+            Cliente *cliente = &hilo->clientes[i];
+            if (cliente->estado == CLIENTE_LIBRE && (cliente->lento || !modo_abierto)) {
+                empezar_peticion(hilo, cliente, ahora); // no pudo conectar en la vuelta anterior
+            }
+            if (cliente->lento && cliente->estado == CLIENTE_ENVIANDO) {
+                enviar(hilo, cliente, ahora);
+                if (cliente->estado == CLIENTE_ENVIANDO && cliente->proximo_byte_ns - ahora < espera_ns) {
+                    espera_ns = cliente->proximo_byte_ns - ahora;
+                }
+            }
+        }
+        if (modo_abierto && hilo->proxima_ns - ahora < espera_ns) {
+            espera_ns = hilo->proxima_ns - ahora;
+        }
+        int n = epoll_wait(hilo->epoll_fd, eventos, 256, (int)((espera_ns + 999999) / 1000000));
+        ahora = ahora_ns();
+        for (int i = 0; i < n; i++) {
+            atender_evento(hilo, eventos[i].data.ptr, eventos[i].events, ahora);
+        }
+    }
+    for (int i = 0; i < hilo->num_clientes; i++) {
+        cerrar_cliente(hilo, &hilo->clientes[i]);
+    }
+    return NULL;
+}
+
+static void uso(const char *programa) {
+    fprintf(stderr,
+            "Uso: %s [-h ip] [-p puerto] [-e escenario] [-m cerrado|abierto] [-c conexiones]\n"
+            "          [-r peticiones/s] [-d segundos] [-w calentamiento] [-t hilos] [-l lentas] [-E etiqueta]\n"
+            "Escenarios: html, imagenes, expulsion, lentos, rotacion\n",
+            programa);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *ip = "127.0.0.1";
+    int puerto = 8000;
+    int opcion;
+    while ((opcion = getopt(argc, argv, "h:p:e:m:c:r:d:w:t:l:E:")) != -1) {
+        switch (opcion) {
+        case 'h': ip = optarg; break;
+        case 'p': puerto = atoi(optarg); break;
+        case 'e': {
+            int encontrado = 0;
+            for (int i = 0; i < NUM_ESCENARIOS; i++) {
+                if (strcmp(optarg, nombres_escenario[i]) == 0) {
+                    escenario = i;
+                    encontrado = 1;
+                }
+            }
+            if (!encontrado) {
+                uso(argv[0]);
+            }
+            break;
+        }
+        case 'm':
+            if (strcmp(optarg, "abierto") != 0 && strcmp(optarg, "cerrado") != 0) {
+                uso(argv[0]);
+            }
+            modo_abierto = strcmp(optarg, "abierto") == 0;
+            break;
+        case 'c': num_conexiones = atoi(optarg); break;
+        case 'r': tasa = atof(optarg); break;
+        case 'd': duracion = atof(optarg); break;
+        case 'w': calentamiento = atof(optarg); break;
+        case 't': num_hilos = atoi(optarg); break;
+        case 'l': num_lentas = atoi(optarg); break;
+        case 'E': etiqueta = optarg; break;
+        default: uso(argv[0]);
+        }
+    }
+    if (num_conexiones < 1 || num_hilos < 1 || num_hilos > MAX_HILOS_CARGA || tasa <= 0 || duracion <= 0 ||
+        calentamiento < 0 || num_lentas < 0) {
+        uso(argv[0]);
+    }
+    if (escenario != ESCENARIO_LENTOS) {
+        num_lentas = 0;
+    }
+    destino.sin_family = AF_INET;
+    destino.sin_port = htons(puerto);
+    if (inet_pton(AF_INET, ip, &destino.sin_addr) != 1) {
+        uso(argv[0]);
+    }
+
+    agregar_directorio("paginas");
+    num_paginas = num_rutas;
+    agregar_directorio("imagenes");
+    if (num_paginas == 0 || (escenario == ESCENARIO_IMAGENES && num_rutas == num_paginas)) {
+        fprintf(stderr, "No se encontraron paginas/ o imagenes/; ejecutar desde la raíz del repositorio.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t inicio_ns = ahora_ns();
+    inicio_medida_ns = inicio_ns + (uint64_t)(calentamiento * 1e9);
+    fin_ns = inicio_medida_ns + (uint64_t)(duracion * 1e9);
+
+    HiloCarga *hilos = calloc(num_hilos, sizeof(HiloCarga));
+    int total_clientes = num_conexiones + num_lentas;
+    Cliente *clientes = calloc(total_clientes, sizeof(Cliente));
+    if (!hilos || !clientes) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < total_clientes; i++) {
+        clientes[i].fd = -1;
+        clientes[i].lento = i >= num_conexiones;
+        clientes[i].siguiente = i; // cada conexión empieza en una ruta distinta
+    }
+    // Clientes contiguos por hilo: las conexiones normales y las lentas se reparten igual.
+    int inicio_cliente = 0;
+    for (int h = 0; h < num_hilos; h++) {
+        HiloCarga *hilo = &hilos[h];
+        hilo->id = h;
+        hilo->semilla = 12345u + h;
+        hilo->intervalo_ns = (uint64_t)(1e9 * num_hilos / tasa);
+        hilo->pendientes = modo_abierto ? malloc(CAPACIDAD_PENDIENTES * sizeof(uint64_t)) : NULL;
+        hilo->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        hilo->num_clientes = total_clientes / num_hilos + (h < total_clientes % num_hilos);
+        hilo->clientes = &clientes[inicio_cliente];
+        inicio_cliente += hilo->num_clientes;
+        if (hilo->epoll_fd < 0 || (modo_abierto && !hilo->pendientes) ||
+            pthread_create(&hilo->hilo, NULL, hilo_carga, hilo) != 0) {
+            perror("Error preparando los hilos de carga");
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t cubetas[NUM_CUBETAS] = {0};
+    uint64_t completadas = 0, errores = 0, no_2xx = 0, descartadas = 0, pendientes = 0, bytes = 0;
+    uint64_t suma_ns = 0, maximo_ns = 0;
+    for (int h = 0; h < num_hilos; h++) {
+        HiloCarga *hilo = &hilos[h];
+        pthread_join(hilo->hilo, NULL);
+        for (int i = 0; i < NUM_CUBETAS; i++) {
+            cubetas[i] += hilo->cubetas[i];
+        }
+        completadas += hilo->completadas;
+        errores += hilo->errores;
+        no_2xx += hilo->no_2xx;
+        descartadas += hilo->descartadas;
+        pendientes += hilo->cabeza - hilo->cola;
+        bytes += hilo->bytes;
+        suma_ns += hilo->suma_ns;
+        if (hilo->maximo_ns > maximo_ns) {
+            maximo_ns = hilo->maximo_ns;
+        }
+    }
+
+    double por_segundo = completadas / duracion;
+    double p50 = percentil(cubetas, completadas, 0.50, maximo_ns) / 1e3;
+    double p99 = percentil(cubetas, completadas, 0.99, maximo_ns) / 1e3;
+    double p999 = percentil(cubetas, completadas, 0.999, maximo_ns) / 1e3;
+    double media = completadas ? suma_ns / 1e3 / completadas : 0;
+    fprintf(stderr, "%s (%s, %d conexiones%s): %.0f peticiones/s, %.1f MB/s, p50 %.0f us, p99 %.0f us, "
+                    "p999 %.0f us, máx %.0f us, errores %llu\n",
+            nombres_escenario[escenario], modo_abierto ? "abierto" : "cerrado", num_conexiones,
+            num_lentas ? " y lentas" : "", por_segundo, bytes / duracion / 1e6, p50, p99, p999, maximo_ns / 1e3,
+            (unsigned long long)errores);
+    printf("{\"escenario\":\"%s\",\"modo\":\"%s\",\"etiqueta\":\"%s\",\"conexiones\":%d,\"lentas\":%d,"
+           "\"hilos\":%d,\"tasa_objetivo\":%.0f,\"duracion_s\":%.1f,\"peticiones\":%llu,\"errores\":%llu,"
+           "\"no_2xx\":%llu,\"descartadas\":%llu,\"pendientes\":%llu,\"peticiones_s\":%.1f,\"mb_s\":%.2f,"
+           "\"latencia_us\":{\"media\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+           nombres_escenario[escenario], modo_abierto ? "abierto" : "cerrado", etiqueta ? etiqueta : "",
+           num_conexiones, num_lentas, num_hilos, modo_abierto ? tasa : 0.0, duracion,
+           (unsigned long long)completadas, (unsigned long long)errores, (unsigned long long)no_2xx,
+           (unsigned long long)descartadas, (unsigned long long)pendientes, por_segundo, bytes / duracion / 1e6,
+           media, p50, p99, p999, maximo_ns / 1e3);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+// Cuenta las llamadas al sistema de un proceso en marcha, en todos sus hilos, durante
+// un intervalo; hace las veces de `strace -c -f` donde no está instalado. Se engancha
+// a cada hilo con PTRACE_SEIZE (y a los que cree después, con PTRACE_O_TRACECLONE),
+// anota cada entrada a una llamada con PTRACE_GET_SYSCALL_INFO y al terminar se suelta
+// dejando el proceso como estaba. El resultado es una línea JSON en la salida
+// estándar: el total y el desglose por llamada, de más a menos frecuente.
+// Mientras dura, cada llamada para el hilo dos veces: el proceso va mucho más lento y
+// esto sirve para contar llamadas por petición, no para medir rendimiento.
+//
+// Compilar:
+//   make bench/contar_llamadas
+// o a mano:
+//   gcc -O2 -o contar_llamadas bench/contar_llamadas.c
+// Ejemplos:
+//   bench/contar_llamadas -p $(pgrep -o servidor) -d 5
+//   bench/contar_llamadas -p 1234       (hasta SIGINT o SIGTERM)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define MAX_HILOS 1024
+#define MAX_LLAMADAS 512
+
+// Nombres de las llamadas que hace el servidor (y alguna más habitual). Las que no
+// estén aquí salen por su número.
+static const char *const nombres[MAX_LLAMADAS] = {
+    [__NR_read] = "read", [__NR_write] = "write", [__NR_close] = "close",
+    [__NR_fstat] = "fstat", [__NR_lseek] = "lseek", [__NR_mmap] = "mmap",
+    [__NR_mprotect] = "mprotect", [__NR_munmap] = "munmap", [__NR_brk] = "brk",
+    [__NR_rt_sigaction] = "rt_sigaction", [__NR_rt_sigprocmask] = "rt_sigprocmask",
+    [__NR_ioctl] = "ioctl", [__NR_pread64] = "pread64", [__NR_pwrite64] = "pwrite64",
+    [__NR_readv] = "readv", [__NR_writev] = "writev", [__NR_sched_yield] = "sched_yield",
+    [__NR_madvise] = "madvise", [__NR_dup] = "dup", [__NR_nanosleep] = "nanosleep",
+    [__NR_getpid] = "getpid", [__NR_sendfile] = "sendfile", [__NR_socket] = "socket",
+    [__NR_connect] = "connect", [__NR_accept] = "accept", [__NR_sendto] = "sendto",
+    [__NR_recvfrom] = "recvfrom", [__NR_sendmsg] = "sendmsg", [__NR_recvmsg] = "recvmsg",
+    [__NR_shutdown] = "shutdown", [__NR_bind] = "bind", [__NR_listen] = "listen",
+    [__NR_getsockname] = "getsockname", [__NR_getpeername] = "getpeername",
+    [__NR_setsockopt] = "setsockopt", [__NR_getsockopt] = "getsockopt", [__NR_clone] = "clone",
+    [__NR_exit] = "exit", [__NR_kill] = "kill", [__NR_fcntl] = "fcntl", [__NR_fsync] = "fsync",
+    [__NR_getdents64] = "getdents64", [__NR_gettid] = "gettid", [__NR_futex] = "futex",
+    [__NR_sched_setaffinity] = "sched_setaffinity", [__NR_sched_getaffinity] = "sched_getaffinity",
+    [__NR_clock_gettime] = "clock_gettime", [__NR_clock_nanosleep] = "clock_nanosleep",
+    [__NR_exit_group] = "exit_group", [__NR_epoll_ctl] = "epoll_ctl", [__NR_tgkill] = "tgkill",
+    [__NR_openat] = "openat", [__NR_newfstatat] = "newfstatat", [__NR_ppoll] = "ppoll",
+    [__NR_epoll_pwait] = "epoll_pwait", [__NR_signalfd4] = "signalfd4",
+    [__NR_eventfd2] = "eventfd2", [__NR_epoll_create1] = "epoll_create1", [__NR_pipe2] = "pipe2",
+    [__NR_inotify_init1] = "inotify_init1", [__NR_inotify_add_watch] = "inotify_add_watch",
+    [__NR_accept4] = "accept4", [__NR_prctl] = "prctl", [__NR_getrandom] = "getrandom",
+    [__NR_restart_syscall] = "restart_syscall", [__NR_statx] = "statx", [__NR_rseq] = "rseq",
+    [__NR_io_uring_setup] = "io_uring_setup", [__NR_io_uring_enter] = "io_uring_enter",
+    [__NR_io_uring_register] = "io_uring_register",
+#ifdef __NR_open
+    // Llamadas antiguas que solo existen en algunas arquitecturas (x86_64 sí).
+    [__NR_open] = "open", [__NR_stat] = "stat", [__NR_poll] = "poll",
+    [__NR_access] = "access", [__NR_pipe] = "pipe", [__NR_select] = "select",
+    [__NR_dup2] = "dup2", [__NR_epoll_wait] = "epoll_wait",
+#endif
+};
+
+static pid_t hilos[MAX_HILOS];
+static int num_hilos = 0;
+static int hilos_vistos = 0; // todos los que se han trazado, aunque ya hayan terminado
+static unsigned long long cuentas[MAX_LLAMADAS];
+static unsigned long long fuera_de_tabla = 0;
+static volatile sig_atomic_t terminar = 0;
+
+static void pedir_fin(int senal) {
+    (void)senal;
+    terminar = 1;
+}
+
+static int buscar_hilo(pid_t tid) {
+    for (int i = 0; i < num_hilos; i++) {
+        if (hilos[i] == tid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void anadir_hilo(pid_t tid) {
+    if (buscar_hilo(tid) < 0 && num_hilos < MAX_HILOS) {
+        hilos[num_hilos++] = tid;
+        hilos_vistos++;
+    }
+}
+
+static void quitar_hilo(pid_t tid) {
+    int i = buscar_hilo(tid);
+    if (i >= 0) {
+        hilos[i] = hilos[--num_hilos];
+    }
+}
+
+// Se engancha a los hilos que tenga ahora el proceso. Se repite hasta que una pasada
+// no encuentra ninguno nuevo: un hilo creado antes de engancharse al que lo crea no lo
+// trae PTRACE_O_TRACECLONE. Devuelve cuántos hay, o -1 si no se pudo con ninguno.
+static int enganchar(pid_t pid) {
+    char ruta[64];
+    snprintf(ruta, sizeof(ruta), "/proc/%d/task", (int)pid);
+    int nuevos;
+    do {
+        DIR *dir = opendir(ruta);
+        if (!dir) {
+            perror("Error abriendo la lista de hilos");
+            return -1;
+        }
+        nuevos = 0;
+        struct dirent *entrada;
+        while ((entrada = readdir(dir)) != NULL) {
+            pid_t tid = (pid_t)atoi(entrada->d_name);
+            if (tid <= 0 || buscar_hilo(tid) >= 0) {
+                continue;
+            }
+            if (ptrace(PTRACE_SEIZE, tid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE) != 0) {
+                if (errno != ESRCH) { // ESRCH: el hilo terminó entretanto
+                    fprintf(stderr, "Error enganchando el hilo %d: %s\n", (int)tid, strerror(errno));
+                }
+                continue;
+            }
+            // Con PTRACE_SEIZE el hilo sigue en marcha: se para para empezar a trazarlo.
+            ptrace(PTRACE_INTERRUPT, tid, 0, 0);
+            anadir_hilo(tid);
+            nuevos++;
+        }
+        closedir(dir);
+    } while (nuevos > 0);
+    return num_hilos > 0 ? num_hilos : -1;
+}
+
+// Atiende la parada de un hilo trazado y lo deja seguir hasta la siguiente llamada.
+static void atender_parada(pid_t tid, int estado) {
+    int senal = WSTOPSIG(estado);
+    int evento = estado >> 16;
+    int reenviar = 0;
+    if (senal == (SIGTRAP | 0x80)) {
+        struct __ptrace_syscall_info info;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0 &&
+            info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+            if (info.entry.nr < MAX_LLAMADAS) {
+                cuentas[info.entry.nr]++;
+            } else {
+                fuera_de_tabla++;
+            }
+        }
+    } else if (evento == PTRACE_EVENT_CLONE) {
+        unsigned long nuevo;
+        if (ptrace(PTRACE_GETEVENTMSG, tid, 0, &nuevo) == 0) {
+            anadir_hilo((pid_t)nuevo);
+        }
+    } else if (evento == 0) {
+        reenviar = senal; // una señal para el proceso: se le entrega
+    }
+    // PTRACE_EVENT_STOP (el PTRACE_INTERRUPT inicial, o un hilo recién creado) solo
+    // necesita que se le deje seguir.
+    ptrace(PTRACE_SYSCALL, tid, 0, reenviar);
+}
+
+// Para todos los hilos y se suelta de ellos. Cada uno vuelve a su ejecución normal; a
+// los que esperaban para recibir una señal se les entrega.
+static void soltar(void) {
+    for (int i = 0; i < num_hilos; i++) {
+        ptrace(PTRACE_INTERRUPT, hilos[i], 0, 0);
+    }
+    while (num_hilos > 0) {
+        int estado;
+        pid_t tid = waitpid(-1, &estado, __WALL);
+        if (tid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (WIFSTOPPED(estado)) {
+            int senal = WSTOPSIG(estado);
+            int entregar = (estado >> 16) == 0 && senal != (SIGTRAP | 0x80) ? senal : 0;
+            ptrace(PTRACE_DETACH, tid, 0, entregar);
+        }
+        quitar_hilo(tid);
+    }
+}
+
+static double segundos_desde(const struct timespec *inicio) {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (ahora.tv_sec - inicio->tv_sec) + (ahora.tv_nsec - inicio->tv_nsec) / 1e9;
+}
+
+static void imprimir(pid_t pid, double segundos) {
+    unsigned long long total = fuera_de_tabla;
+    for (int i = 0; i < MAX_LLAMADAS; i++) {
+        total += cuentas[i];
+    }
+    printf("{\"pid\":%d,\"hilos_trazados\":%d,\"segundos_trazados\":%.1f,\"llamadas\":%llu,\"por_llamada\":{",
+           (int)pid, hilos_vistos, segundos, total);
+    // De más a menos frecuente: se va sacando el mayor que quede.
+    int primera = 1;
+    for (;;) {
+        int mayor = -1;
+        for (int i = 0; i < MAX_LLAMADAS; i++) {
+            if (cuentas[i] > 0 && (mayor < 0 || cuentas[i] > cuentas[mayor])) {
+                mayor = i;
+            }
+        }
+        if (mayor < 0) {
+            break;
+        }
+        if (nombres[mayor]) {
+            printf("%s\"%s\":%llu", primera ? "" : ",", nombres[mayor], cuentas[mayor]);
+        } else {
+            printf("%s\"%d\":%llu", primera ? "" : ",", mayor, cuentas[mayor]);
+        }
+        cuentas[mayor] = 0;
+        primera = 0;
+    }
+    if (fuera_de_tabla > 0) {
+        printf("%s\"otras\":%llu", primera ? "" : ",", fuera_de_tabla);
+    }
+    printf("}}\n");
+    fflush(stdout);
+}
+
+static void uso(const char *programa) {
+    fprintf(stderr, "Uso: %s -p pid [-d segundos]\n", programa);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    pid_t pid = 0;
+    double duracion = 0;
+    int opcion;
+    while ((opcion = getopt(argc, argv, "p:d:")) != -1) {
+        switch (opcion) {
+        case 'p': pid = (pid_t)atoi(optarg); break;
+        case 'd': duracion = atof(optarg); break;
+        default: uso(argv[0]);
+        }
+    }
+    if (pid <= 0) {
+        uso(argv[0]);
+    }
+
+    // Sin SA_RESTART: la señal interrumpe el waitpid() y el bucle ve 'terminar'.
+    struct sigaction accion;
+    memset(&accion, 0, sizeof(accion));
+    accion.sa_handler = pedir_fin;
+    sigaction(SIGALRM, &accion, NULL);
+    sigaction(SIGINT, &accion, NULL);
+    sigaction(SIGTERM, &accion, NULL);
+
+    if (enganchar(pid) < 0) {
+        fprintf(stderr, "No se pudo trazar el proceso %d.\n", (int)pid);
+        return EXIT_FAILURE;
+    }
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    if (duracion > 0) {
+        struct itimerval intervalo = {{0, 0}, {(time_t)duracion, (long)((duracion - (time_t)duracion) * 1e6)}};
+        setitimer(ITIMER_REAL, &intervalo, NULL);
+    }
+
+    while (!terminar && num_hilos > 0) {
+        int estado;
+        pid_t tid = waitpid(-1, &estado, __WALL);
+        if (tid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error en waitpid");
+            break;
+        }
+        if (WIFEXITED(estado) || WIFSIGNALED(estado)) {
+            quitar_hilo(tid);
+            continue;
+        }
+        if (WIFSTOPPED(estado)) {
+            anadir_hilo(tid); // un hilo nuevo puede pararse antes de que llegue su evento
+            atender_parada(tid, estado);
+        }
+    }
+    double segundos = segundos_desde(&inicio);
+    soltar();
+    imprimir(pid, segundos);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#!/bin/bash
+# Batería de escenarios de carga contra un servidor local. Para cada motor y escenario
+# arranca ./servidor con la configuración del escenario, ejecuta bench/carga y escribe
+# su línea JSON en la salida estándar (el resumen legible sale por la de errores), con
+# el tiempo de CPU del servidor durante la carga: "cpu_s" y "cpu_us_peticion".
+# Cada motor repite además el escenario html con bench/contar_llamadas enganchado al
+# servidor: esa línea añade "llamadas", "llamadas_peticion" y el desglose por llamada
+# (su rendimiento no vale, el trazado frena al servidor). Trazar necesita permiso de
+# ptrace sobre el servidor (root, o kernel.yama.ptrace_scope a 0); si no lo hay, la
+# línea sale sin esos campos.
+# Desde la raíz del repositorio, tras `make bench`:
+#   bench/ejecutar_bench.sh [segundos por escenario] > resultados.jsonl
+# Variables: MOTORES ("hilos epoll uring"), PUERTO (8099), CONEXIONES (64), TASA
+# (peticiones/s del modo abierto, 5000), LENTAS (64), HILOS_CARGA (1).
+set -eu
+
+DURACION=${1:-10}
+MOTORES=${MOTORES:-"hilos epoll uring"}
+PUERTO=${PUERTO:-8099}
+CONEXIONES=${CONEXIONES:-64}
+TASA=${TASA:-5000}
+LENTAS=${LENTAS:-64}
+HILOS_CARGA=${HILOS_CARGA:-1}
+TICKS=$(getconf CLK_TCK)
+
+# Tiempo de CPU (usuario + sistema) consumido por un proceso, en ticks.
+ticks_cpu() {
+    awk '{print $14 + $15}' "/proc/$1/stat"
+}
+
+# Valor numérico de un campo de primer nivel de una línea JSON.
+campo() {
+    local valor=${1#*\"$2\":}
+    echo "${valor%%[,\}]*}"
+}
+
+# ejecutar <motor> "<variables del servidor>" <opciones de carga...>
+# Con trazar=1 cuenta las llamadas al sistema del servidor en vez de su CPU.
+ejecutar() {
+    local motor=$1 entorno=$2
+    shift 2
+    env $entorno SERVIDOR_MOTOR="$motor" SERVIDOR_NIVEL_LOG=error ./servidor "$PUERTO" 127.0.0.1 >/dev/null 2>&1 &
+    local pid=$!
+    for _ in $(seq 50); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PUERTO") 2>/dev/null; then
+            break
+        fi
+        sleep 0.1
+    done
+    local traza="" trazador=0 antes linea llamadas=""
+    if [ "${trazar:-0}" = 1 ]; then
+        traza=$(mktemp)
+        bench/contar_llamadas -p "$pid" >"$traza" &
+        trazador=$!
+        sleep 0.5
+    fi
+    antes=$(ticks_cpu "$pid")
+    linea=$(bench/carga -p "$PUERTO" -t "$HILOS_CARGA" -d "$DURACION" -E "$motor" "$@") || true
+    if [ -n "$traza" ]; then
+        kill -INT "$trazador" 2>/dev/null || true
+        wait "$trazador" || true
+        llamadas=$(cat "$traza")
+        rm -f "$traza"
+    fi
+    if [ -n "$linea" ]; then
+        local peticiones
+        peticiones=$(campo "$linea" peticiones)
+        if [ -n "$llamadas" ]; then
+            linea="${linea%\}},\"llamadas_peticion\":$(awk -v l="$(campo "$llamadas" llamadas)" -v p="$peticiones" \
+                'BEGIN {printf "%.2f", (p > 0 ? l / p : 0)}'),${llamadas#\{}"
+        elif [ -z "$traza" ]; then
+            linea="${linea%\}},$(awk -v t="$(($(ticks_cpu "$pid") - antes))" -v hz="$TICKS" -v p="$peticiones" \
+                'BEGIN {printf "\"cpu_s\":%.2f,\"cpu_us_peticion\":%.1f", t / hz, (p > 0 ? t / hz * 1e6 / p : 0)}')}"
+        fi
+        echo "$linea"
+    fi
+    kill -TERM "$pid"
+    wait "$pid" || true
+}
+
+for motor in $MOTORES; do
+    ejecutar "$motor" "" -e html -c "$CONEXIONES"
+    ejecutar "$motor" "" -e html -m abierto -r "$TASA" -c "$CONEXIONES"
+    ejecutar "$motor" "" -e imagenes -c "$CONEXIONES"
+    # Caché de 16 KB sin precarga: el conjunto de trabajo no cabe.
+    ejecutar "$motor" "SERVIDOR_CACHE_KB=16 SERVIDOR_PRECARGA=ninguna" -e expulsion -c "$CONEXIONES"
+    ejecutar "$motor" "" -e lentos -c "$CONEXIONES" -l "$LENTAS"
+    ejecutar "$motor" "" -e rotacion -c "$CONEXIONES"
+    trazar=1 ejecutar "$motor" "" -e html -c "$CONEXIONES"
+done
@@ -0,0 +1,155 @@
+// Arnés de fuzzing del analizador de peticiones. Para cada entrada comprueba que:
+//   - el análisis termina y devuelve un resultado válido (completo, incompleto o un
+//     código de error HTTP conocido);
+//   - todas las vistas de una petición completa caen dentro de sus bytes;
+//   - entregar la entrada byte a byte da el mismo resultado que entregarla de una vez
+//     (si se rechaza, el código puede variar porque troceada se rechaza antes).
+// Cualquier discrepancia aborta, para que el fuzzer guarde la entrada.
+//
+// Con libFuzzer (desde la raíz del repositorio):
+//   clang -g -O1 -fsanitize=fuzzer,address,undefined -DFUZZ_LIBFUZZER -o fuzz_parser bench/fuzz_parser.c parser_http.c
+//   ./fuzz_parser
+// Sin libFuzzer, mutando al azar peticiones de ejemplo:
+//   gcc -g -O1 -fsanitize=address,undefined -o fuzz_parser bench/fuzz_parser.c parser_http.c
+//   ./fuzz_parser [iteraciones] [semilla]
+
+#include "../servidor_web.h"
+
+static const LimitesHttp limites = {256, 16, 512};
+
+static void comprobar(int condicion, const char *motivo) {
+    if (!condicion) {
+        fprintf(stderr, "Fallo: %s\n", motivo);
+        abort();
+    }
+}
+
+static void comprobar_vista(VistaCadena vista, const char *datos, size_t tam) {
+    comprobar(vista.longitud <= tam, "vista más larga que la petición");
+    if (vista.longitud > 0) {
+        comprobar(vista.datos >= datos && vista.datos + vista.longitud <= datos + tam, "vista fuera de la petición");
+    }
+}
+
+static int resultado_valido(int estado) {
+    switch (estado) {
+    case ANALISIS_INCOMPLETO: case ANALISIS_COMPLETO:
+    case -400: case -413: case -414: case -431: case -501: case -505:
+        return 1;
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *entrada, size_t tam) {
+    // Como en el servidor, la entrada vive en un buffer de TAMANO_BUFFER - 1 bytes útiles.
+    static char datos[TAMANO_BUFFER];
+    if (tam > TAMANO_BUFFER - 1) {
+        tam = TAMANO_BUFFER - 1;
+    }
+    memcpy(datos, entrada, tam);
+
+    PeticionHttp entera;
+    iniciar_peticion_http(&entera);
+    int estado = analizar_peticion(&entera, datos, tam, &limites);
+    comprobar(resultado_valido(estado), "resultado desconocido");
+
+    if (estado == ANALISIS_COMPLETO) {
+        size_t longitud = entera.longitud;
+        comprobar(longitud > 0 && longitud <= tam, "longitud fuera de la entrada");
+        comprobar(entera.num_encabezados <= limites.max_encabezados, "demasiados encabezados");
+        comprobar(entera.ruta.longitud <= limites.max_uri, "ruta más larga que el límite");
+        comprobar(entera.tam_cuerpo <= limites.max_cuerpo, "cuerpo más largo que el límite");
+        comprobar_vista(entera.metodo, datos, longitud);
+        comprobar_vista(entera.ruta, datos, longitud);
+        comprobar_vista(entera.consulta, datos, longitud);
+        comprobar_vista(entera.version, datos, longitud);
+        for (int i = 0; i < entera.num_encabezados; i++) {
+            comprobar_vista(entera.encabezados[i].nombre, datos, longitud);
+            comprobar_vista(entera.encabezados[i].valor, datos, longitud);
+        }
+    }
+
+    // La misma entrada byte a byte: el resultado final tiene que coincidir. Un error
+    // puede aparecer antes, con menos bytes, y por eso con otro código.
+    PeticionHttp troceada;
+    iniciar_peticion_http(&troceada);
+    int estado_troceado = ANALISIS_INCOMPLETO;
+    for (size_t disponibles = 0; disponibles <= tam; disponibles++) {
+        estado_troceado = analizar_peticion(&troceada, datos, disponibles, &limites);
+        if (estado_troceado != ANALISIS_INCOMPLETO) {
+            break;
+        }
+    }
+    comprobar(estado_troceado == estado || (estado_troceado < 0 && estado < 0),
+              "el análisis troceado no coincide con el entero");
+    if (estado == ANALISIS_COMPLETO) {
+        comprobar(troceada.longitud == entera.longitud, "longitud troceada distinta");
+        comprobar(troceada.num_encabezados == entera.num_encabezados, "encabezados troceados distintos");
+    }
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static const char *const semillas[] = {
+    "GET /index.html HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip, br\r\n\r\n",
+    "GET /a?b=c HTTP/1.0\nConnection: keep-alive\n\n",
+    "POST /contacto.html HTTP/1.1\r\nContent-Length: 5\r\n\r\nhola!",
+    "\r\n\r\nHEAD / HTTP/1.1\r\nIf-None-Match: W/\"x\", \"y\"\r\n\r\nGET / HTTP/1.1\r\n\r\n",
+};
+#define NUM_SEMILLAS (sizeof(semillas) / sizeof(semillas[0]))
+
+// Mutaciones sencillas: cambiar, insertar, borrar o duplicar bytes, y bytes "interesantes".
+static size_t mutar(uint8_t *datos, size_t tam, size_t capacidad) {
+    static const char interesantes[] = "\r\n :\t?/0123456789\x00\x7f\x80\xff";
+    int cambios = 1 + rand() % 4;
+    for (int c = 0; c < cambios; c++) {
+        size_t pos = tam ? (size_t)rand() % tam : 0;
+        uint8_t byte = rand() % 2 ? (uint8_t)rand() : (uint8_t)interesantes[rand() % (sizeof(interesantes) - 1)];
+        switch (rand() % 4) {
+        case 0:
+            if (tam) {
+                datos[pos] = byte;
+            }
+            break;
+        case 1:
+            if (tam < capacidad) {
+                memmove(datos + pos + 1, datos + pos, tam - pos);
+                datos[pos] = byte;
+                tam++;
+            }
+            break;
+        case 2:
+            if (tam) {
+                memmove(datos + pos, datos + pos + 1, tam - pos - 1);
+                tam--;
+            }
+            break;
+        default: {
+            size_t largo = 1 + rand() % 64;
+            if (pos + largo <= tam && tam + largo <= capacidad) {
+                memmove(datos + pos + largo, datos + pos, tam - pos);
+                tam += largo;
+            }
+            break;
+        }
+        }
+    }
+    return tam;
+}
+
+int main(int argc, char *argv[]) {
+    long iteraciones = argc > 1 ? atol(argv[1]) : 200000;
+    srand(argc > 2 ? (unsigned)atoi(argv[2]) : (unsigned)time(NULL));
+
+    static uint8_t entrada[TAMANO_BUFFER];
+    for (long i = 0; i < iteraciones; i++) {
+        const char *semilla = semillas[i % NUM_SEMILLAS];
+        size_t tam = strlen(semilla);
+        memcpy(entrada, semilla, tam);
+        tam = mutar(entrada, tam, sizeof(entrada) - 1);
+        LLVMFuzzerTestOneInput(entrada, tam);
+    }
+    printf("%ld entradas sin fallos\n", iteraciones);
+    return EXIT_SUCCESS;
+}
+#endif
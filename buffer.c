@@ -1,73 +1,977 @@
 #include "servidor_web.h"
 
-// Función para cargar el contenido de un archivo en una estructura Pagina.
-static int cargar_archivo_en_pagina(const char *ruta_archivo, Pagina *pagina) {
-    FILE *archivo = fopen(ruta_archivo, "rb");
-    if (!archivo) {
-        printf("Error: No se pudo abrir el archivo %s\n", ruta_archivo);
-        return -1;
+// Caché de recursos: tabla hash por ruta de archivo, limitada por bytes y con
+// reemplazo CLOCK sobre un arreglo de ranuras. Cada Pagina lleva un contador de
+// referencias: la caché tiene una y cada respuesta en curso otra, así que expulsar
+// una entrada nunca libera memoria que se esté enviando.
+//
+// Los aciertos no toman ningún mutex. Los lectores recorren la tabla protegidos por
+// épocas (reclamación diferida): una página sacada de la tabla se retira con la época
+// en curso y la caché no suelta su referencia hasta que ningún lector pueda seguir
+// viéndola. El uso reciente para CLOCK se cuenta en contadores por hilo que solo
+// escribe su dueño; el mutex queda para fallos, inserciones y expulsiones.
+
+#define EPOCA_INACTIVA UINT64_MAX
+
+// Valores de Content-Encoding, indexados por Codificacion
+const char *const nombres_codificacion[NUM_CODIFICACIONES] = {"gzip", "br"};
+
+// Estado por hilo lector: su época y sus aciertos por ranura del reloj. Cuando el hilo
+// termina, el registro queda libre para el siguiente hilo que lo necesite; sus aciertos
+// siguen sumando, así que CLOCK no ve retroceder ningún contador.
+typedef struct {
+    _Atomic uint64_t epoca;                         // época al entrar, o EPOCA_INACTIVA
+    _Atomic int en_uso;                             // lo tiene asignado un hilo vivo
+    _Atomic uint32_t aciertos[MAX_ENTRADAS_CACHE];  // solo los escribe el hilo dueño
+} __attribute__((aligned(64))) RegistroHiloCache;
+
+static _Atomic(RegistroHiloCache *) registros[MAX_HILOS_CACHE];
+static _Atomic int num_registros = 0;
+static __thread RegistroHiloCache *registro_hilo = NULL;
+static __thread int registro_agotado = 0;
+static pthread_key_t clave_registro;      // su destructor devuelve el registro al terminar el hilo
+static pthread_once_t clave_registro_creada = PTHREAD_ONCE_INIT;
+
+static void devolver_registro(void *arg) {
+    RegistroHiloCache *registro = arg;
+    atomic_store(&registro->epoca, EPOCA_INACTIVA);
+    atomic_store_explicit(&registro->en_uso, 0, memory_order_release);
+}
+
+static void crear_clave_registro(void) {
+    pthread_key_create(&clave_registro, devolver_registro);
+}
+
+// Toma un registro que haya dejado libre un hilo terminado, o NULL si no hay ninguno.
+static RegistroHiloCache *reutilizar_registro(void) {
+    int n = atomic_load(&num_registros);
+    if (n > MAX_HILOS_CACHE) {
+        n = MAX_HILOS_CACHE;
+    }
+    for (int i = 0; i < n; i++) {
+        RegistroHiloCache *registro = atomic_load_explicit(&registros[i], memory_order_acquire);
+        int libre = 0;
+        if (registro && atomic_compare_exchange_strong(&registro->en_uso, &libre, 1)) {
+            return registro;
+        }
+    }
+    return NULL;
+}
+
+// Devuelve el registro del hilo actual, tomándolo la primera vez: uno libre o uno nuevo.
+// NULL si no quedan registros: ese hilo usa entonces la búsqueda con mutex.
+static RegistroHiloCache *registro_local(void) {
+    if (registro_hilo || registro_agotado) {
+        return registro_hilo;
+    }
+    pthread_once(&clave_registro_creada, crear_clave_registro);
+    RegistroHiloCache *registro = reutilizar_registro();
+    if (!registro) {
+        int indice = atomic_fetch_add(&num_registros, 1);
+        if (indice < MAX_HILOS_CACHE) {
+            registro = aligned_alloc(64, sizeof(RegistroHiloCache));
+        }
+        if (!registro) {
+            registro_agotado = 1;
+            return NULL;
+        }
+        atomic_init(&registro->epoca, EPOCA_INACTIVA);
+        atomic_init(&registro->en_uso, 1);
+        for (int i = 0; i < MAX_ENTRADAS_CACHE; i++) {
+            atomic_init(&registro->aciertos[i], 0);
+        }
+        // Se publica antes de la primera entrada en época (ver entrar_epoca).
+        atomic_store(&registros[indice], registro);
+    }
+    pthread_setspecific(clave_registro, registro);
+    registro_hilo = registro;
+    return registro;
+}
+
+// Marca al hilo como lector activo en la época global. Tras publicar la época se vuelve
+// a leer la global: si no cambió, cualquier retirada posterior verá a este lector.
+static void entrar_epoca(BufferPaginas *buffer, RegistroHiloCache *registro) {
+    uint64_t epoca = atomic_load(&buffer->epoca);
+    for (;;) {
+        atomic_store(&registro->epoca, epoca);
+        uint64_t actual = atomic_load(&buffer->epoca);
+        if (actual == epoca) {
+            return;
+        }
+        epoca = actual;
+    }
+}
+
+static void salir_epoca(RegistroHiloCache *registro) {
+    atomic_store_explicit(&registro->epoca, EPOCA_INACTIVA, memory_order_release);
+}
+
+// Anota un acierto en el contador propio del hilo; nadie más escribe esa línea de caché.
+static void contar_acierto(RegistroHiloCache *registro, int ranura) {
+    uint32_t valor = atomic_load_explicit(&registro->aciertos[ranura], memory_order_relaxed);
+    atomic_store_explicit(&registro->aciertos[ranura], valor + 1, memory_order_relaxed);
+}
+
+// Suma aproximada de los aciertos de todos los hilos sobre una ranura.
+static uint64_t sumar_aciertos(int ranura) {
+    uint64_t total = 0;
+    int n = atomic_load(&num_registros);
+    if (n > MAX_HILOS_CACHE) {
+        n = MAX_HILOS_CACHE;
+    }
+    for (int i = 0; i < n; i++) {
+        RegistroHiloCache *registro = atomic_load_explicit(&registros[i], memory_order_acquire);
+        if (registro) {
+            total += atomic_load_explicit(&registro->aciertos[ranura], memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+// Época más antigua que algún lector puede estar usando.
+static uint64_t epoca_minima_activa(void) {
+    uint64_t minima = EPOCA_INACTIVA;
+    int n = atomic_load(&num_registros);
+    if (n > MAX_HILOS_CACHE) {
+        n = MAX_HILOS_CACHE;
+    }
+    for (int i = 0; i < n; i++) {
+        RegistroHiloCache *registro = atomic_load(&registros[i]);
+        if (registro) {
+            uint64_t epoca = atomic_load(&registro->epoca);
+            if (epoca < minima) {
+                minima = epoca;
+            }
+        }
+    }
+    return minima;
+}
+
+// Suelta la referencia de la caché de las páginas retiradas que ya ningún lector
+// puede alcanzar desde la tabla. Requiere el mutex.
+static void recolectar_retiradas(BufferPaginas *buffer) {
+    uint64_t minima = epoca_minima_activa();
+    Pagina **enlace = &buffer->retiradas;
+    while (*enlace) {
+        Pagina *pagina = *enlace;
+        if (pagina->epoca_retiro < minima) {
+            *enlace = pagina->retirada_siguiente;
+            buffer->num_retiradas--;
+            soltar_pagina(pagina);
+        } else {
+            enlace = &pagina->retirada_siguiente;
+        }
     }
+}
+
+static int es_imagen(const char *extension) {
+    return extension && (strcmp(extension, ".png") == 0 || strcmp(extension, ".jpg") == 0 ||
+                         strcmp(extension, ".jpeg") == 0 || strcmp(extension, ".gif") == 0);
+}
 
-    fseek(archivo, 0, SEEK_END);
-    size_t tam = ftell(archivo);
-    fseek(archivo, 0, SEEK_SET);
+// Registro de tipos de contenido. El switch por longitud y primera letra de la
+// extensión deja como mucho dos comparaciones; solo se consulta al cargar un archivo.
+static const char *tipo_contenido(const char *extension) {
+    if (!extension) {
+        return "text/html";
+    }
+    const char *e = extension + 1;
+    switch (strlen(e)) {
+    case 2:
+        if (memcmp(e, "js", 2) == 0) return "application/javascript";
+        break;
+    case 3:
+        switch (e[0]) {
+        case 'c': if (memcmp(e, "css", 3) == 0) return "text/css"; break;
+        case 'g': if (memcmp(e, "gif", 3) == 0) return "image/gif"; break;
+        case 'h': if (memcmp(e, "htm", 3) == 0) return "text/html"; break;
+        case 'i': if (memcmp(e, "ico", 3) == 0) return "image/x-icon"; break;
+        case 'j': if (memcmp(e, "jpg", 3) == 0) return "image/jpeg"; break;
+        case 'p': if (memcmp(e, "png", 3) == 0) return "image/png"; break;
+        case 's': if (memcmp(e, "svg", 3) == 0) return "image/svg+xml"; break;
+        case 't': if (memcmp(e, "txt", 3) == 0) return "text/plain"; break;
+        }
+        break;
+    case 4:
+        switch (e[0]) {
+        case 'h': if (memcmp(e, "html", 4) == 0) return "text/html"; break;
+        case 'j':
+            if (memcmp(e, "jpeg", 4) == 0) return "image/jpeg";
+            if (memcmp(e, "json", 4) == 0) return "application/json";
+            break;
+        case 'w': if (memcmp(e, "webp", 4) == 0) return "image/webp"; break;
+        }
+        break;
+    }
+    return "text/html";
+}
 
-    // Reservar un byte extra para el caracter nulo de terminación
-    pagina->contenido = malloc(tam + 1);
-    if (!pagina->contenido) {
-        perror("Error reservando memoria para el contenido del archivo");
-        fclose(archivo);
+// malloc() de las cargas de la caché, contado en servidor_reservas_monticulo_total:
+// cada fallo o recarga reserva la página, su cuerpo, sus encabezados y sus variantes.
+static void *reservar_bloque(size_t tam) {
+    void *bloque = malloc(tam);
+    if (bloque) {
+        contar_metrica(METRICA_RESERVAS_MONTICULO, 1);
+    }
+    return bloque;
+}
+
+// Libera un cuerpo o un encabezado, salvo si se copió al segmento compartido.
+static void liberar_bloque(void *bloque) {
+    if (!en_segmento(bloque)) {
+        free(bloque);
+    }
+}
+
+// Cuerpos mapeados vivos. Si alguien trunca o reescribe en su sitio un archivo mapeado,
+// leer las páginas que quedaron más allá del final da SIGBUS, y eso tumbaría el
+// proceso entero. El manejador comprueba que la dirección es de uno de estos mapeos y
+// pone encima una página anónima de ceros: la lectura termina con ceros en lugar de los
+// bytes perdidos hasta que la vigilancia recarga el archivo. Una ranura se reserva con
+// inicio 1 mientras se rellena; el manejador solo mira las que tienen el inicio real.
+typedef struct {
+    _Atomic uintptr_t inicio;
+    _Atomic size_t tam;
+} MapeoVigilado;
+
+static MapeoVigilado mapeos[MAX_MAPEOS_CACHE];
+static size_t tam_pagina_memoria;
+
+static void manejar_sigbus(int senal, siginfo_t *info, void *contexto) {
+    (void)contexto;
+    uintptr_t direccion = (uintptr_t)info->si_addr;
+    for (int i = 0; i < MAX_MAPEOS_CACHE; i++) {
+        uintptr_t inicio = atomic_load_explicit(&mapeos[i].inicio, memory_order_acquire);
+        if (inicio > 1 && direccion - inicio < atomic_load_explicit(&mapeos[i].tam, memory_order_relaxed)) {
+            void *pagina = (void *)(direccion & ~(uintptr_t)(tam_pagina_memoria - 1));
+            if (mmap(pagina, tam_pagina_memoria, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+                static const char aviso[] = "[BUFFER] Un archivo mapeado se truncó en disco; se sirven ceros hasta recargarlo.\n";
+                ssize_t escritos = write(STDERR_FILENO, aviso, sizeof(aviso) - 1);
+                (void)escritos;
+                return;
+            }
+            break;
+        }
+    }
+    // No es de un cuerpo mapeado: se deja que la señal haga lo de siempre al repetir el acceso.
+    signal(senal, SIG_DFL);
+}
+
+static void instalar_manejador_sigbus(void) {
+    tam_pagina_memoria = sysconf(_SC_PAGESIZE);
+    struct sigaction accion;
+    memset(&accion, 0, sizeof(accion));
+    accion.sa_sigaction = manejar_sigbus;
+    accion.sa_flags = SA_SIGINFO;
+    sigemptyset(&accion.sa_mask);
+    sigaction(SIGBUS, &accion, NULL);
+}
+
+// Mapea el cuerpo de un archivo y lo anota para el manejador de SIGBUS. Devuelve NULL si
+// no se pudo o no queda ranura; entonces el archivo se copia a memoria.
+static char *mapear_cuerpo(int fd, size_t tam) {
+    int ranura = -1;
+    for (int i = 0; i < MAX_MAPEOS_CACHE && ranura < 0; i++) {
+        uintptr_t libre = 0;
+        if (atomic_compare_exchange_strong(&mapeos[i].inicio, &libre, 1)) {
+            ranura = i;
+        }
+    }
+    if (ranura < 0) {
+        return NULL;
+    }
+    void *mapa = mmap(NULL, tam, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapa == MAP_FAILED) {
+        perror("Error mapeando el archivo");
+        atomic_store(&mapeos[ranura].inicio, 0);
+        return NULL;
+    }
+    atomic_store_explicit(&mapeos[ranura].tam, tam, memory_order_relaxed);
+    atomic_store_explicit(&mapeos[ranura].inicio, (uintptr_t)mapa, memory_order_release);
+    madvise(mapa, tam, MADV_WILLNEED);
+    if (tam >= MIN_TAM_PAGINAS_ENORMES) {
+        madvise(mapa, tam, MADV_HUGEPAGE); // solo es una pista; se ignora si falla
+    }
+    return mapa;
+}
+
+// Deshace un mapeo de mapear_cuerpo(). La ranura se suelta antes del munmap: después
+// la dirección puede pasar a otro mapeo que no es de la caché.
+static void desmapear_cuerpo(char *mapa, size_t tam) {
+    for (int i = 0; i < MAX_MAPEOS_CACHE; i++) {
+        if (atomic_load_explicit(&mapeos[i].inicio, memory_order_relaxed) == (uintptr_t)mapa) {
+            atomic_store(&mapeos[i].inicio, 0);
+            break;
+        }
+    }
+    munmap(mapa, tam);
+}
+
+static void destruir_pagina(Pagina *pagina) {
+    if (pagina->fd >= 0) {
+        close(pagina->fd);
+    }
+    if (pagina->mapeada) {
+        desmapear_cuerpo(pagina->identidad.contenido, pagina->identidad.tamano);
+    } else {
+        liberar_bloque(pagina->identidad.contenido);
+    }
+    liberar_bloque(pagina->identidad.encabezado);
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        liberar_bloque(pagina->variantes[c].contenido);
+        liberar_bloque(pagina->variantes[c].encabezado);
+    }
+    free(pagina->nombre_archivo);
+    free(pagina);
+}
+
+// Tipos de texto para los que merece la pena guardar variantes comprimidas.
+static int es_comprimible(const char *tipo) {
+    return strncmp(tipo, "text/", 5) == 0 || strcmp(tipo, "application/javascript") == 0 ||
+           strcmp(tipo, "application/json") == 0 || strcmp(tipo, "image/svg+xml") == 0;
+}
+
+// Formatea en memoria propia el encabezado 200 de una representación, sin la línea
+// Connection. 'codificacion' es el valor de Content-Encoding o NULL para la identidad,
+// la única que admite rangos; 'etag_debil' antepone W/ al ETag;
+// 'validadores' son las líneas comunes a todas las representaciones de la página
+// (Last-Modified, Cache-Control y Vary). Devuelve -1 si no se pudo.
+static int formatear_encabezado(VariantePagina *variante, const char *tipo, const char *codificacion,
+                                const char *etag_base, int etag_debil, const char *validadores) {
+    snprintf(variante->etag, sizeof(variante->etag), "%s\"%s%s%s\"", etag_debil ? "W/" : "", etag_base,
+             codificacion ? "-" : "", codificacion ? codificacion : "");
+    char encabezado[512];
+    int inicio = snprintf(encabezado, sizeof(encabezado),
+                          "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %zu\r\n"
+                          "%s%s%s",
+                          tipo, variante->tamano, codificacion ? "Content-Encoding: " : "Accept-Ranges: bytes",
+                          codificacion ? codificacion : "", "\r\n");
+    int n = inicio + snprintf(encabezado + inicio, sizeof(encabezado) - inicio, "ETag: %s\r\n%s",
+                              variante->etag, validadores);
+    if ((size_t)n >= sizeof(encabezado)) {
+        return -1;
+    }
+    variante->encabezado = reservar_bloque(n);
+    if (!variante->encabezado) {
         return -1;
     }
+    memcpy(variante->encabezado, encabezado, n);
+    variante->tam_encabezado = n;
+    variante->inicio_validadores = inicio;
+    return 0;
+}
 
-    if (fread(pagina->contenido, 1, tam, archivo) != tam) {
-        perror("Error leyendo el archivo");
-        free(pagina->contenido);
-        fclose(archivo);
+// Calcula la base del ETag: CRC-32 del contenido y tamaño, ambos en hexadecimal.
+// Las imágenes se leen una vez desde su descriptor. '*debil' queda a 1 si el ETag no
+// sale del contenido. Devuelve -1 si falla la lectura.
+static int calcular_etag(Pagina *pagina, size_t umbral_transmision, char *etag, size_t tam_etag, int *debil) {
+    *debil = pagina->mapeada || pagina->identidad.tamano > umbral_transmision;
+    if (*debil) {
+        // Ni un mapeo ni un archivo grande se recorren al cargarlos: el ETag sale de mtime y
+        // tamaño, y es débil porque una reescritura en el mismo instante no lo cambiaría.
+        snprintf(etag, tam_etag, "%lx.%lx-%zx", (unsigned long)pagina->info.st_mtim.tv_sec,
+                 (unsigned long)pagina->info.st_mtim.tv_nsec, pagina->identidad.tamano);
+        return 0;
+    }
+    uLong crc = crc32(0L, Z_NULL, 0);
+    if (pagina->identidad.contenido) {
+        const char *datos = pagina->identidad.contenido;
+        size_t restantes = pagina->identidad.tamano;
+        while (restantes > 0) {
+            uInt trozo = restantes > UINT_MAX ? UINT_MAX : (uInt)restantes;
+            crc = crc32(crc, (const Bytef *)datos, trozo);
+            datos += trozo;
+            restantes -= trozo;
+        }
+    } else {
+        char bloque[65536];
+        off_t desplazamiento = 0;
+        while ((size_t)desplazamiento < pagina->identidad.tamano) {
+            ssize_t n = pread(pagina->fd, bloque, sizeof(bloque), desplazamiento);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            crc = crc32(crc, (const Bytef *)bloque, (uInt)n);
+            desplazamiento += n;
+        }
+    }
+    snprintf(etag, tam_etag, "%08lx-%zx", (unsigned long)crc, pagina->identidad.tamano);
+    return 0;
+}
+
+// Comprime un cuerpo en formato gzip. Devuelve NULL si no se pudo.
+static char *comprimir_gzip(const char *datos, size_t tam, int nivel, size_t *tam_comprimido) {
+    if (tam > UINT_MAX) {
+        return NULL;
+    }
+    z_stream flujo = {0};
+    if (deflateInit2(&flujo, nivel, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t capacidad = deflateBound(&flujo, tam);
+    char *salida = reservar_bloque(capacidad);
+    if (!salida) {
+        deflateEnd(&flujo);
+        return NULL;
+    }
+    flujo.next_in = (Bytef *)datos;
+    flujo.avail_in = tam;
+    flujo.next_out = (Bytef *)salida;
+    flujo.avail_out = capacidad;
+    int estado = deflate(&flujo, Z_FINISH);
+    *tam_comprimido = flujo.total_out;
+    deflateEnd(&flujo);
+    if (estado != Z_STREAM_END) {
+        free(salida);
+        return NULL;
+    }
+    return salida;
+}
+
+#ifdef SERVIDOR_BROTLI
+// Comprime un cuerpo con brotli a la calidad máxima. Devuelve NULL si no se pudo.
+static char *comprimir_brotli(const char *datos, size_t tam, size_t *tam_comprimido) {
+    size_t capacidad = BrotliEncoderMaxCompressedSize(tam);
+    char *salida = capacidad ? reservar_bloque(capacidad) : NULL;
+    if (!salida) {
+        return NULL;
+    }
+    *tam_comprimido = capacidad;
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, tam,
+                               (const uint8_t *)datos, tam_comprimido, (uint8_t *)salida)) {
+        free(salida);
+        return NULL;
+    }
+    return salida;
+}
+#endif
+
+// Genera las variantes comprimidas de una página de texto en memoria. Solo se guardan
+// las que ahorran al menos un octavo del cuerpo; un fallo al comprimir deja la variante vacía.
+static void comprimir_variantes(BufferPaginas *buffer, Pagina *pagina) {
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        if (!(buffer->compresion & (1 << c))) {
+            continue;
+        }
+        size_t tam = 0;
+        char *comprimido = NULL;
+        if (c == CODIFICACION_GZIP) {
+            comprimido = comprimir_gzip(pagina->identidad.contenido, pagina->identidad.tamano, buffer->nivel_gzip, &tam);
+        }
+#ifdef SERVIDOR_BROTLI
+        if (c == CODIFICACION_BROTLI) {
+            comprimido = comprimir_brotli(pagina->identidad.contenido, pagina->identidad.tamano, &tam);
+        }
+#endif
+        if (comprimido && tam > pagina->identidad.tamano - pagina->identidad.tamano / 8) {
+            free(comprimido);
+            comprimido = NULL;
+        }
+        if (comprimido) {
+            char *ajustado = realloc(comprimido, tam);
+            pagina->variantes[c].contenido = ajustado ? ajustado : comprimido;
+            pagina->variantes[c].tamano = tam;
+        }
+    }
+}
+
+// Pasa un bloque de memoria propia al segmento compartido, si está abierto y cabe.
+static void mover_a_segmento(char **bloque, size_t tam) {
+    if (!*bloque) {
+        return;
+    }
+    char *copia = copiar_a_segmento(*bloque, tam);
+    if (copia) {
+        free(*bloque);
+        *bloque = copia;
+    }
+}
+
+// En el modo de procesos, lo que carga el maestro antes de lanzar a los trabajadores
+// se sirve desde el segmento compartido. Los metadatos de la página siguen siendo de
+// cada proceso: los trabajadores los heredan con fork() y solo copian lo que escriben.
+static void compartir_pagina(Pagina *pagina) {
+    if (!pagina->mapeada) {
+        mover_a_segmento(&pagina->identidad.contenido, pagina->identidad.tamano + 1);
+    }
+    mover_a_segmento(&pagina->identidad.encabezado, pagina->identidad.tam_encabezado);
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        mover_a_segmento(&pagina->variantes[c].contenido, pagina->variantes[c].tamano);
+        mover_a_segmento(&pagina->variantes[c].encabezado, pagina->variantes[c].tam_encabezado);
+    }
+}
+
+// Función hash FNV-1a para indexar rutas de archivo.
+static unsigned int hash_nombre(const char *nombre) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)nombre; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+// Traduce la ruta pedida a la ruta del archivo en disco. Devuelve -1 si no es válida.
+static int resolver_ruta(const char *ruta, char *ruta_archivo, size_t tam) {
+    // 1. Quitar el '/' inicial de la ruta y obtener el nombre del archivo.
+    const char *nombre_solicitado = (ruta[0] == '/') ? ruta + 1 : ruta;
+    if (nombre_solicitado[0] == '\0' || strstr(nombre_solicitado, "..")) {
         return -1;
     }
-    pagina->contenido[tam] = '\0';
-    pagina->tamano = tam;
-    
-    // Almacenar solo el nombre del archivo, no la ruta completa
-    const char *nombre_archivo = strrchr(ruta_archivo, '/');
-    if (nombre_archivo == NULL) {
-        nombre_archivo = ruta_archivo;
+
+    // Una ruta que ya empieza por una de las carpetas se toma tal cual, sea cual sea su
+    // extensión: así la clave de una imagen guardada en paginas/ es la que pide el cliente.
+    const char *directorio = es_imagen(strrchr(nombre_solicitado, '.')) ? IMAGENES_DIR : PAGINAS_DIR;
+    if (strncmp(nombre_solicitado, PAGINAS_DIR, strlen(PAGINAS_DIR)) == 0 ||
+        strncmp(nombre_solicitado, IMAGENES_DIR, strlen(IMAGENES_DIR)) == 0) {
+        directorio = "";
+    }
+    int n = snprintf(ruta_archivo, tam, "%s%s", directorio, nombre_solicitado);
+    return (n > 0 && (size_t)n < tam) ? 0 : -1;
+}
+
+// Carga un archivo en una Pagina nueva con una referencia. Las imágenes no se copian:
+// se mantiene su descriptor abierto para enviarlas con sendfile(). Los textos se
+// comprimen aquí, una sola vez, en las codificaciones que pida la configuración.
+static Pagina *cargar_archivo_en_pagina(BufferPaginas *buffer, const char *ruta_archivo) {
+    int fd = open(ruta_archivo, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        DIAG_DEPURACION("[BUFFER] No se pudo abrir el archivo %s\n", ruta_archivo);
+        return NULL;
+    }
+
+    Pagina *pagina = reservar_bloque(sizeof(Pagina));
+    if (!pagina) {
+        perror("Error reservando memoria para la página");
+        close(fd);
+        return NULL;
+    }
+    memset(pagina, 0, sizeof(*pagina));
+    if (fstat(fd, &pagina->info) != 0 || !S_ISREG(pagina->info.st_mode)) {
+        free(pagina);
+        close(fd);
+        return NULL;
+    }
+    size_t tam = pagina->info.st_size;
+
+    VariantePagina *identidad = &pagina->identidad;
+    identidad->tamano = tam;
+    int imagen = es_imagen(strrchr(ruta_archivo, '.'));
+    if (imagen || tam > buffer->umbral_transmision) {
+        // Se envía desde disco con sendfile(): ni la memoria ni el tiempo hasta el primer
+        // byte crecen con el tamaño del archivo.
+        pagina->fd = fd;
+        identidad->contenido = NULL;
+    } else if (buffer->respaldo == RESPALDO_MMAP && tam > 0 && (identidad->contenido = mapear_cuerpo(fd, tam))) {
+        // El mapeo comparte las páginas de la caché del kernel con cualquier otro proceso
+        // que sirva el mismo archivo. Si se trunca en su sitio, ver manejar_sigbus().
+        close(fd);
+        pagina->mapeada = 1;
+        pagina->fd = -1;
     } else {
-        nombre_archivo++;
+        // Reservar un byte extra para el caracter nulo de terminación
+        identidad->contenido = reservar_bloque(tam + 1);
+        if (!identidad->contenido) {
+            perror("Error reservando memoria para el contenido del archivo");
+            free(pagina);
+            close(fd);
+            return NULL;
+        }
+        size_t leidos = 0;
+        while (leidos < tam) {
+            ssize_t n = read(fd, identidad->contenido + leidos, tam - leidos);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                perror("Error leyendo el archivo");
+                free(identidad->contenido);
+                free(pagina);
+                close(fd);
+                return NULL;
+            }
+            leidos += n;
+        }
+        identidad->contenido[tam] = '\0';
+        pagina->fd = -1;
+        close(fd);
     }
-    pagina->nombre_archivo = strdup(nombre_archivo);
 
-    fclose(archivo);
-    return 0;
+    size_t tam_nombre = strlen(ruta_archivo) + 1;
+    pagina->nombre_archivo = reservar_bloque(tam_nombre);
+    if (pagina->nombre_archivo) {
+        memcpy(pagina->nombre_archivo, ruta_archivo, tam_nombre);
+    }
+    const char *tipo = tipo_contenido(strrchr(ruta_archivo, '.'));
+    pagina->tipo = tipo;
+    // Un cuerpo mapeado se sirve solo en identidad: comprimirlo recorrería todo el mapeo.
+    if (identidad->contenido && !pagina->mapeada && tam >= MIN_TAM_COMPRESION && es_comprimible(tipo)) {
+        comprimir_variantes(buffer, pagina);
+    }
+
+    // Los validadores se calculan una sola vez: un ETag por representación a partir del
+    // CRC del contenido (débil si sale de mtime y tamaño), y Last-Modified según fstat.
+    char etag[32];
+    int etag_debil;
+    if (calcular_etag(pagina, buffer->umbral_transmision, etag, sizeof(etag), &etag_debil) != 0) {
+        perror("Error leyendo el archivo");
+        destruir_pagina(pagina);
+        return NULL;
+    }
+    int hay_variantes = 0;
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        hay_variantes |= pagina->variantes[c].contenido != NULL;
+    }
+    char fecha[64];
+    struct tm tm_modificacion;
+    gmtime_r(&pagina->info.st_mtime, &tm_modificacion);
+    strftime(fecha, sizeof(fecha), "%a, %d %b %Y %H:%M:%S GMT", &tm_modificacion);
+    char validadores[256];
+    snprintf(validadores, sizeof(validadores), "Last-Modified: %s\r\nCache-Control: %s\r\n%s", fecha,
+             imagen ? buffer->cache_control_imagenes : buffer->cache_control_paginas,
+             hay_variantes ? "Vary: Accept-Encoding\r\n" : "");
+
+    // Los encabezados de un 200 se construyen una sola vez; al responder solo falta la
+    // línea Connection, que es una cadena fija.
+    int completa = pagina->nombre_archivo != NULL &&
+                   formatear_encabezado(identidad, tipo, NULL, etag, etag_debil, validadores) == 0;
+    // Lo que se envía desde 'fd' y los mapeos no ocupan memoria propia: sus bytes están en
+    // la caché del kernel.
+    pagina->coste = sizeof(Pagina) + strlen(ruta_archivo) + 1 + identidad->tam_encabezado +
+                    (identidad->contenido && !pagina->mapeada ? tam + 1 : 0);
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        VariantePagina *variante = &pagina->variantes[c];
+        if (completa && variante->contenido) {
+            completa = formatear_encabezado(variante, tipo, nombres_codificacion[c], etag, etag_debil, validadores) == 0;
+            pagina->coste += variante->tamano + variante->tam_encabezado;
+        }
+    }
+    if (!completa) {
+        perror("Error reservando memoria para la página");
+        destruir_pagina(pagina);
+        return NULL;
+    }
+    compartir_pagina(pagina);
+    pagina->ranura = -1;
+    atomic_init(&pagina->referencias, 1);
+    return pagina;
+}
+
+// Devuelve una referencia obtenida con obtener_pagina(). La última referencia libera la página.
+void soltar_pagina(Pagina *pagina) {
+    if (atomic_fetch_sub_explicit(&pagina->referencias, 1, memory_order_acq_rel) == 1) {
+        destruir_pagina(pagina);
+    }
+}
+
+// Busca en la cubeta correspondiente. Requiere estar en una época o tener el mutex.
+static Pagina *buscar_en_tabla(BufferPaginas *buffer, const char *ruta_archivo, unsigned int cubeta) {
+    Pagina *pagina = atomic_load_explicit(&buffer->tabla[cubeta], memory_order_acquire);
+    while (pagina) {
+        if (strcmp(pagina->nombre_archivo, ruta_archivo) == 0) {
+            return pagina;
+        }
+        pagina = atomic_load_explicit(&pagina->siguiente, memory_order_acquire);
+    }
+    return NULL;
+}
+
+// Anota una página ya inalcanzable desde la tabla como retirada en la época actual.
+// Requiere el mutex.
+static void diferir_liberacion(BufferPaginas *buffer, Pagina *pagina) {
+    pagina->epoca_retiro = atomic_fetch_add(&buffer->epoca, 1);
+    pagina->retirada_siguiente = buffer->retiradas;
+    buffer->retiradas = pagina;
+    buffer->num_retiradas++;
+}
+
+// Saca una página de la tabla y de su ranura y la retira con la época actual. Su
+// 'siguiente' no se toca para que un lector que esté sobre ella pueda seguir la cadena.
+// Requiere el mutex.
+static void retirar_pagina(BufferPaginas *buffer, Pagina *pagina) {
+    unsigned int cubeta = hash_nombre(pagina->nombre_archivo) % TAMANO_TABLA_CACHE;
+    _Atomic(Pagina *) *enlace = &buffer->tabla[cubeta];
+    Pagina *actual;
+    while ((actual = atomic_load_explicit(enlace, memory_order_relaxed)) != pagina) {
+        enlace = &actual->siguiente;
+    }
+    atomic_store_explicit(enlace, atomic_load_explicit(&pagina->siguiente, memory_order_relaxed),
+                          memory_order_release);
+
+    atomic_store_explicit(&buffer->ranuras[pagina->ranura], NULL, memory_order_release);
+    buffer->ranuras_libres[buffer->num_ranuras_libres++] = pagina->ranura;
+    atomic_fetch_sub_explicit(&buffer->num_paginas, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&buffer->bytes_usados, pagina->coste, memory_order_relaxed);
+    buffer->descriptores_abiertos -= pagina->fd >= 0;
+    diferir_liberacion(buffer, pagina);
+}
+
+// Algoritmo CLOCK: la manecilla recorre las ranuras dando una segunda oportunidad a las
+// páginas recién insertadas o con aciertos desde la última vuelta (según la suma de
+// los contadores por hilo). Si los aciertos no dejan de llegar, tras dos vueltas se
+// expulsa la página bajo la manecilla. Con 'solo_descriptores' solo se consideran las
+// páginas con su archivo abierto, y tiene que haber alguna. Requiere el mutex.
+static void expulsar_una(BufferPaginas *buffer, int solo_descriptores) {
+    for (int pasos = 0;; pasos++) {
+        int ranura = buffer->manecilla;
+        buffer->manecilla = (buffer->manecilla + 1) % MAX_ENTRADAS_CACHE;
+        Pagina *pagina = atomic_load_explicit(&buffer->ranuras[ranura], memory_order_relaxed);
+        if (!pagina || (solo_descriptores && pagina->fd < 0)) {
+            continue;
+        }
+        uint64_t aciertos = sumar_aciertos(ranura);
+        if (pasos < 2 * MAX_ENTRADAS_CACHE && (pagina->segunda_oportunidad || aciertos != pagina->aciertos_vistos)) {
+            pagina->segunda_oportunidad = 0;
+            pagina->aciertos_vistos = aciertos;
+            continue;
+        }
+        DIAG_DEPURACION("[BUFFER] Expulsando '%s' (%zu bytes) de la caché.\n", pagina->nombre_archivo, pagina->coste);
+        retirar_pagina(buffer, pagina);
+        contar_metrica(METRICA_EXPULSIONES, 1);
+        return;
+    }
+}
+
+// Inserta una página nueva haciendo sitio si hace falta. Requiere el mutex.
+static void insertar_pagina(BufferPaginas *buffer, Pagina *pagina, unsigned int cubeta) {
+    while (atomic_load_explicit(&buffer->num_paginas, memory_order_relaxed) > 0 &&
+           (atomic_load_explicit(&buffer->bytes_usados, memory_order_relaxed) + pagina->coste > buffer->bytes_maximos ||
+            buffer->num_ranuras_libres == 0)) {
+        expulsar_una(buffer, 0);
+    }
+    // Cada archivo abierto cuenta contra el límite de descriptores que comparten las conexiones.
+    while (pagina->fd >= 0 && buffer->descriptores_abiertos >= buffer->max_descriptores) {
+        expulsar_una(buffer, 1);
+    }
+
+    pagina->ranura = buffer->ranuras_libres[--buffer->num_ranuras_libres];
+    pagina->segunda_oportunidad = 1;
+    pagina->aciertos_vistos = sumar_aciertos(pagina->ranura);
+    atomic_fetch_add_explicit(&pagina->referencias, 1, memory_order_relaxed); // referencia de la caché
+    atomic_fetch_add_explicit(&buffer->num_paginas, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buffer->bytes_usados, pagina->coste, memory_order_relaxed);
+    buffer->descriptores_abiertos += pagina->fd >= 0;
+
+    // Se publica con release: un lector que la encuentre ve la página completa.
+    atomic_store_explicit(&pagina->siguiente, atomic_load_explicit(&buffer->tabla[cubeta], memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&buffer->ranuras[pagina->ranura], pagina, memory_order_release);
+    atomic_store_explicit(&buffer->tabla[cubeta], pagina, memory_order_release);
+
+    recolectar_retiradas(buffer);
+}
+
+// Pone 'nueva' en el lugar de 'vieja' (misma ruta): ocupa su enlace en la cubeta y su
+// ranura, y 'vieja' se retira. Un lector concurrente ve una de las dos, nunca un hueco.
+// Requiere el mutex.
+static void sustituir_pagina(BufferPaginas *buffer, Pagina *vieja, Pagina *nueva, unsigned int cubeta) {
+    _Atomic(Pagina *) *enlace = &buffer->tabla[cubeta];
+    Pagina *actual;
+    while ((actual = atomic_load_explicit(enlace, memory_order_relaxed)) != vieja) {
+        enlace = &actual->siguiente;
+    }
+    nueva->ranura = vieja->ranura;
+    nueva->segunda_oportunidad = 1;
+    nueva->aciertos_vistos = sumar_aciertos(nueva->ranura);
+    atomic_fetch_add_explicit(&nueva->referencias, 1, memory_order_relaxed); // referencia de la caché
+    atomic_fetch_add_explicit(&buffer->bytes_usados, nueva->coste, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&buffer->bytes_usados, vieja->coste, memory_order_relaxed);
+    buffer->descriptores_abiertos += (nueva->fd >= 0) - (vieja->fd >= 0);
+
+    atomic_store_explicit(&nueva->siguiente, atomic_load_explicit(&vieja->siguiente, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&buffer->ranuras[nueva->ranura], nueva, memory_order_release);
+    atomic_store_explicit(enlace, nueva, memory_order_release);
+    diferir_liberacion(buffer, vieja);
+
+    // Si la página creció puede haber que expulsar otras para volver al presupuesto.
+    while (atomic_load_explicit(&buffer->num_paginas, memory_order_relaxed) > 1 &&
+           atomic_load_explicit(&buffer->bytes_usados, memory_order_relaxed) > buffer->bytes_maximos) {
+        expulsar_una(buffer, 0);
+    }
+    while (buffer->descriptores_abiertos > buffer->max_descriptores) {
+        expulsar_una(buffer, 1);
+    }
+    recolectar_retiradas(buffer);
+}
+
+// Vuelve a leer del disco un archivo que cambió y sustituye su entrada de la caché. Si
+// no estaba en caché solo se carga con 'insertar_si_falta'. Si ya no se puede cargar
+// (borrado, ilegible o demasiado grande) se retira la entrada. La carga se hace fuera
+// del mutex y los aciertos no se bloquean en ningún momento.
+void recargar_pagina(BufferPaginas *buffer, const char *ruta_archivo, int insertar_si_falta) {
+    unsigned int cubeta = hash_nombre(ruta_archivo) % TAMANO_TABLA_CACHE;
+    pthread_mutex_lock(&buffer->mutex);
+    int presente = buscar_en_tabla(buffer, ruta_archivo, cubeta) != NULL;
+    pthread_mutex_unlock(&buffer->mutex);
+    if (!presente && !insertar_si_falta) {
+        return;
+    }
+
+    Pagina *nueva = cargar_archivo_en_pagina(buffer, ruta_archivo);
+    if (nueva && nueva->coste > buffer->bytes_maximos) {
+        soltar_pagina(nueva);
+        nueva = NULL;
+    }
+
+    pthread_mutex_lock(&buffer->mutex);
+    Pagina *vieja = buscar_en_tabla(buffer, ruta_archivo, cubeta);
+    if (vieja && nueva) {
+        sustituir_pagina(buffer, vieja, nueva, cubeta);
+        DIAG_INFO("[BUFFER] '%s' recargada tras cambiar en disco.\n", ruta_archivo);
+    } else if (vieja) {
+        retirar_pagina(buffer, vieja);
+        recolectar_retiradas(buffer);
+        DIAG_INFO("[BUFFER] '%s' retirada de la caché: ya no se puede cargar.\n", ruta_archivo);
+    } else if (nueva) {
+        insertar_pagina(buffer, nueva, cubeta);
+        DIAG_DEPURACION("[BUFFER] '%s' cargada tras aparecer en disco.\n", ruta_archivo);
+    }
+    pthread_mutex_unlock(&buffer->mutex);
+    if (nueva) {
+        soltar_pagina(nueva); // la caché conserva su propia referencia
+    }
+}
+
+// Rutas de los archivos a precargar, recogidas por nftw() antes de lanzar los hilos
+static char **rutas_precarga;
+static size_t num_rutas_precarga;
+static size_t capacidad_rutas_precarga;
+static _Atomic size_t siguiente_precarga;
+
+static int anotar_ruta_precarga(const char *ruta, const struct stat *info, int tipo, struct FTW *ftw) {
+    (void)info;
+    (void)ftw;
+    if (tipo != FTW_F) {
+        return 0;
+    }
+    if (num_rutas_precarga == capacidad_rutas_precarga) {
+        size_t capacidad = capacidad_rutas_precarga ? 2 * capacidad_rutas_precarga : 64;
+        char **rutas = realloc(rutas_precarga, capacidad * sizeof(char *));
+        if (!rutas) {
+            return -1;
+        }
+        rutas_precarga = rutas;
+        capacidad_rutas_precarga = capacidad;
+    }
+    rutas_precarga[num_rutas_precarga] = strdup(ruta);
+    return rutas_precarga[num_rutas_precarga++] ? 0 : -1;
+}
+
+// Cada hilo toma la siguiente ruta pendiente hasta agotarlas o llenar la caché.
+static void *hilo_precarga(void *arg) {
+    BufferPaginas *buffer = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&siguiente_precarga, 1)) < num_rutas_precarga &&
+           atomic_load(&buffer->bytes_usados) < buffer->bytes_maximos) {
+        Pagina *pagina = obtener_pagina(buffer, rutas_precarga[i]);
+        if (pagina) {
+            soltar_pagina(pagina);
+        }
+    }
+    return NULL;
+}
+
+// Carga en paralelo todo el árbol de paginas/ e imagenes/ (con subdirectorios) hasta
+// agotar el presupuesto, para que las primeras peticiones ya sean aciertos.
+static void precargar_arbol(BufferPaginas *buffer, int num_hilos) {
+    // nftw() da rutas con el prefijo del directorio, que resolver_ruta() acepta tal cual.
+    static const char *directorios[] = {PAGINAS_DIR, IMAGENES_DIR};
+    for (size_t d = 0; d < sizeof(directorios) / sizeof(directorios[0]); d++) {
+        if (nftw(directorios[d], anotar_ruta_precarga, 16, FTW_PHYS) != 0) {
+            perror("Error recorriendo el directorio de contenido");
+        }
+    }
+
+    uint64_t inicio_ns = tiempo_monotonico_ns();
+    atomic_init(&siguiente_precarga, 0);
+    pthread_t hilos[num_hilos];
+    int lanzados = 0;
+    while (lanzados < num_hilos && pthread_create(&hilos[lanzados], NULL, hilo_precarga, buffer) == 0) {
+        lanzados++;
+    }
+    if (lanzados == 0) {
+        hilo_precarga(buffer);
+    }
+    for (int i = 0; i < lanzados; i++) {
+        pthread_join(hilos[i], NULL);
+    }
+    DIAG_INFO("[BUFFER] Precarga: %d páginas (%zu/%zu bytes) de %zu archivos en %.1f ms con %d hilos.\n",
+              atomic_load(&buffer->num_paginas), atomic_load(&buffer->bytes_usados), buffer->bytes_maximos,
+              num_rutas_precarga, (tiempo_monotonico_ns() - inicio_ns) / 1e6, lanzados ? lanzados : 1);
+
+    for (size_t i = 0; i < num_rutas_precarga; i++) {
+        free(rutas_precarga[i]);
+    }
+    free(rutas_precarga);
+    rutas_precarga = NULL;
+    num_rutas_precarga = capacidad_rutas_precarga = 0;
 }
 
 // Inicializa el buffer de páginas
-void inicializar_buffer(BufferPaginas *buffer) {
-    buffer->num_paginas = 0;
+void inicializar_buffer(BufferPaginas *buffer, const ConfigServidor *config) {
+    size_t bytes_maximos = config->cache_bytes;
+    for (int i = 0; i < TAMANO_TABLA_CACHE; i++) {
+        atomic_init(&buffer->tabla[i], NULL);
+    }
+    for (int i = 0; i < MAX_ENTRADAS_CACHE; i++) {
+        atomic_init(&buffer->ranuras[i], NULL);
+        buffer->ranuras_libres[i] = MAX_ENTRADAS_CACHE - 1 - i;
+    }
+    buffer->num_ranuras_libres = MAX_ENTRADAS_CACHE;
+    buffer->manecilla = 0;
+    atomic_init(&buffer->num_paginas, 0);
+    atomic_init(&buffer->bytes_usados, 0);
+    buffer->bytes_maximos = bytes_maximos;
+    // Las entradas con archivo abierto apenas cuestan bytes; se limitan a la mitad de los
+    // descriptores del proceso para que accept() y open() no se queden sin ellos.
+    struct rlimit limite;
+    buffer->descriptores_abiertos = 0;
+    buffer->max_descriptores = MAX_DESCRIPTORES_CACHE;
+    if (getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur != RLIM_INFINITY &&
+        limite.rlim_cur / 2 < (rlim_t)buffer->max_descriptores) {
+        buffer->max_descriptores = limite.rlim_cur / 2 > 0 ? (int)(limite.rlim_cur / 2) : 1;
+    }
+    buffer->respaldo = config->respaldo;
+    if (buffer->respaldo == RESPALDO_MMAP) {
+        instalar_manejador_sigbus();
+    }
+    buffer->umbral_transmision = config->umbral_transmision;
+    buffer->compresion = config->compresion;
+    buffer->nivel_gzip = config->nivel_gzip;
+    buffer->cache_control_paginas = config->cache_control_paginas;
+    buffer->cache_control_imagenes = config->cache_control_imagenes;
+    atomic_init(&buffer->epoca, 0);
+    buffer->retiradas = NULL;
+    buffer->num_retiradas = 0;
     pthread_mutex_init(&buffer->mutex, NULL);
 
+    if (config->precarga == PRECARGA_TODO) {
+        precargar_arbol(buffer, config->hilos_precarga);
+        return;
+    }
+    if (config->precarga == PRECARGA_NINGUNA) {
+        return;
+    }
     DIR *dir;
     struct dirent *ent;
     if ((dir = opendir(PAGINAS_DIR)) != NULL) {
         // [BUFFER] Iniciando la carga de páginas al buffer
-        printf("[BUFFER] Cargando páginas iniciales en el buffer de memoria...\n");
+        DIAG_INFO("[BUFFER] Cargando páginas iniciales en el buffer de memoria (%zu bytes máximo)...\n", bytes_maximos);
         while ((ent = readdir(dir)) != NULL) {
-           
-            if (buffer->num_paginas >= MAX_PAGINAS) {
-                break;
-            }
-            
             if (ent->d_type == DT_REG) { // Asegurarse de que es un archivo regular
-                char ruta_completa[512];
-                snprintf(ruta_completa, sizeof(ruta_completa), "%s%s", PAGINAS_DIR, ent->d_name);
-                Pagina nueva_pagina;
-                if (cargar_archivo_en_pagina(ruta_completa, &nueva_pagina) == 0) {
-                    time(&nueva_pagina.ultimo_acceso);
-                    buffer->paginas[buffer->num_paginas] = nueva_pagina;
-                    buffer->num_paginas++;
+                Pagina *pagina = obtener_pagina(buffer, ent->d_name);
+                if (pagina) {
                     // Página cargada exitosamente en el buffer
-                    printf("[BUFFER] Página cargada: %s\n", nueva_pagina.nombre_archivo);
+                    DIAG_INFO("[BUFFER] Página cargada: %s\n", pagina->nombre_archivo);
+                    soltar_pagina(pagina);
+                }
+                if (atomic_load(&buffer->bytes_usados) >= buffer->bytes_maximos) {
+                    break;
                 }
             }
         }
@@ -77,131 +981,119 @@ void inicializar_buffer(BufferPaginas *buffer) {
     }
 }
 
-// se obtiene una página del buffer o la carga si no está.
-char *obtener_pagina(BufferPaginas *buffer, const char *ruta, size_t *tam_out) {
-    // 1. Quitar el '/' inicial de la ruta y obtener el nombre del archivo.
-    const char *nombre_solicitado = (ruta[0] == '/') ? ruta + 1 : ruta;
-    const char *extension = strrchr(nombre_solicitado, '.');
-
-    // Las imágenes se sirven directamente desde el disco sin usar el buffer de caché.
-    if (extension && (strcmp(extension, ".png") == 0 || strcmp(extension, ".jpg") == 0 || strcmp(extension, ".jpeg") == 0 || strcmp(extension, ".gif") == 0)) {
-        Pagina imagen_temp;
-        char ruta_imagen[512];
+// se obtiene una página del buffer o la carga si no está. Devuelve una referencia
+// que se debe soltar con soltar_pagina(), o NULL si el recurso no existe.
+Pagina *obtener_pagina(BufferPaginas *buffer, const char *ruta) {
+    char ruta_archivo[512];
+    if (resolver_ruta(ruta, ruta_archivo, sizeof(ruta_archivo)) != 0) {
+        return NULL;
+    }
+    unsigned int cubeta = hash_nombre(ruta_archivo) % TAMANO_TABLA_CACHE;
 
-        // Se verifica si la ruta ya tiene el prefijo de la carpeta 
-        if (strncmp(nombre_solicitado, IMAGENES_DIR, strlen(IMAGENES_DIR)) != 0) {
-            // Si no, se construye la ruta correcta
-            snprintf(ruta_imagen, sizeof(ruta_imagen), "%s%s", IMAGENES_DIR, nombre_solicitado);
-        } else {
-            // Si ya lo tiene, se usa la ruta tal cual
-            snprintf(ruta_imagen, sizeof(ruta_imagen), "%s", nombre_solicitado);
+    // Camino de lectura sin bloqueo: se busca dentro de una época y se toma una referencia.
+    // La página no puede liberarse mientras el hilo está en la época, así que el
+    // incremento es seguro aunque otro hilo la esté expulsando en ese momento.
+    Pagina *pagina;
+    RegistroHiloCache *registro = registro_local();
+    if (registro) {
+        entrar_epoca(buffer, registro);
+        pagina = buscar_en_tabla(buffer, ruta_archivo, cubeta);
+        if (pagina) {
+            atomic_fetch_add_explicit(&pagina->referencias, 1, memory_order_relaxed);
+            contar_acierto(registro, pagina->ranura);
         }
-
-        if (cargar_archivo_en_pagina(ruta_imagen, &imagen_temp) == 0) {
-            *tam_out = imagen_temp.tamano;
-            //  Imágen cargada directamente desde el disco, no se usa el buffer
-            printf("[BUFFER] Sirviendo imagen '%s' directamente del disco.\n", nombre_solicitado);
-            free(imagen_temp.nombre_archivo); 
-            return imagen_temp.contenido; 
+        salir_epoca(registro);
+    } else {
+        pthread_mutex_lock(&buffer->mutex);
+        pagina = buscar_en_tabla(buffer, ruta_archivo, cubeta);
+        if (pagina) {
+            atomic_fetch_add_explicit(&pagina->referencias, 1, memory_order_relaxed);
         }
-        // Si no se encuentra, devuelve NULL.
-        return NULL;
+        pthread_mutex_unlock(&buffer->mutex);
     }
-    
-    pthread_mutex_lock(&buffer->mutex);
-    
-    char *contenido = NULL;
-    int indice_encontrado = -1;
-    char ruta_completa[512];
-    
-    // Buscar la página en el búfer.
-    for (int i = 0; i < buffer->num_paginas; i++) {
-        if (strcmp(buffer->paginas[i].nombre_archivo, nombre_solicitado) == 0) {
-            // Página encontrada en el búfer. Se actualiza el tiempo de acceso.
-            contenido = buffer->paginas[i].contenido;
-            *tam_out = buffer->paginas[i].tamano;
-            time(&buffer->paginas[i].ultimo_acceso);
-            indice_encontrado = i;
-            printf("[BUFFER] Página '%s' encontrada en el caché.\n", nombre_solicitado);
-            break;
-        }
+    if (pagina) {
+        contar_metrica(METRICA_ACIERTOS_CACHE, 1);
+        return pagina;
     }
-    
-    // Si la página no está en el búfer, cargarla y manejar el bufer.
-    if (indice_encontrado == -1) {
-        printf("[BUFFER] Página '%s' no encontrada en el caché. Intentando cargarla desde el disco...\n", nombre_solicitado);
-        Pagina nueva_pagina;
-        snprintf(ruta_completa, sizeof(ruta_completa), "%s%s", PAGINAS_DIR, nombre_solicitado);
-        
-        if (cargar_archivo_en_pagina(ruta_completa, &nueva_pagina) != 0) {
-            pthread_mutex_unlock(&buffer->mutex);
-            return NULL;
-        }
+    contar_metrica(METRICA_FALLOS_CACHE, 1);
 
-        time(&nueva_pagina.ultimo_acceso);
-        
-        // Verificar si hay espacio en el búfer.
-        if (buffer->num_paginas < MAX_PAGINAS) {
-            buffer->paginas[buffer->num_paginas] = nueva_pagina;
-            contenido = nueva_pagina.contenido;
-            *tam_out = nueva_pagina.tamano;
-            buffer->num_paginas++;
-            //  Nueva página '%s' añadida al buffer.
-            printf("[BUFFER] Nueva página '%s' añadida al buffer.\n", nueva_pagina.nombre_archivo);
-        } else {
-            //Aplicar el algoritmo de reemplazo LRU si el búfer está lleno.
-            printf("[BUFFER] Buffer lleno. Aplicando algoritmo LRU para reemplazar una página.\n");
-            int indice_lru = 0;
-            time_t menor_tiempo = buffer->paginas[0].ultimo_acceso;
-            for (int i = 1; i < buffer->num_paginas; i++) {
-                if (buffer->paginas[i].ultimo_acceso < menor_tiempo) {
-                    menor_tiempo = buffer->paginas[i].ultimo_acceso;
-                    indice_lru = i;
-                }
-            }
-            
-            // Reemplazar la página menos usada.
-            printf("[BUFFER] Reemplazando '%s' con '%s'\n", 
-                   buffer->paginas[indice_lru].nombre_archivo, nueva_pagina.nombre_archivo);
-            free(buffer->paginas[indice_lru].nombre_archivo);
-            free(buffer->paginas[indice_lru].contenido);
-            buffer->paginas[indice_lru] = nueva_pagina;
-            contenido = nueva_pagina.contenido;
-            *tam_out = nueva_pagina.tamano;
-        }
+    // La lectura del disco se hace fuera del mutex para no bloquear los aciertos de otros hilos.
+    DIAG_DEPURACION("[BUFFER] Página '%s' no encontrada en el caché. Intentando cargarla desde el disco...\n", ruta_archivo);
+    Pagina *nueva_pagina = cargar_archivo_en_pagina(buffer, ruta_archivo);
+    if (!nueva_pagina) {
+        return NULL;
     }
 
+    // Un recurso más grande que toda la caché se sirve sin guardarlo.
+    if (nueva_pagina->coste > buffer->bytes_maximos) {
+        DIAG_DEPURACION("[BUFFER] '%s' no cabe en la caché; se sirve sin almacenarla.\n", ruta_archivo);
+        return nueva_pagina;
+    }
+
+    pthread_mutex_lock(&buffer->mutex);
+    // Otro hilo pudo cargar el mismo archivo mientras tanto.
+    pagina = buscar_en_tabla(buffer, ruta_archivo, cubeta);
+    if (pagina) {
+        atomic_fetch_add_explicit(&pagina->referencias, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&buffer->mutex);
+        soltar_pagina(nueva_pagina);
+        return pagina;
+    }
+    insertar_pagina(buffer, nueva_pagina, cubeta);
+    //  Nueva página añadida al buffer.
+    DIAG_DEPURACION("[BUFFER] Nueva página '%s' añadida al buffer (%zu/%zu bytes).\n",
+                    ruta_archivo, atomic_load(&buffer->bytes_usados), buffer->bytes_maximos);
     pthread_mutex_unlock(&buffer->mutex);
-    return contenido;
+    return nueva_pagina;
 }
 
-// función para imprimir el estado del búfer de páginas
+// función para imprimir el estado del búfer de páginas. Recorre las ranuras dentro de
+// una época, sin tomar el mutex de la caché.
 void imprimir_buffer(BufferPaginas *buffer) {
     time_t tiempo_actual;
     time(&tiempo_actual);
     printf("\n--- Estado del Buffer de Paginas (%lld) ---\n", (long long)tiempo_actual);
-    pthread_mutex_lock(&buffer->mutex);
-    if (buffer->num_paginas == 0) {
+    RegistroHiloCache *registro = registro_local();
+    if (registro) {
+        entrar_epoca(buffer, registro);
+    } else {
+        pthread_mutex_lock(&buffer->mutex);
+    }
+    if (atomic_load(&buffer->num_paginas) == 0) {
         printf("  (Buffer vacío)\n");
     } else {
-        for (int i = 0; i < buffer->num_paginas; i++) {
-            printf("  [%d] Nombre: %s, Ultimo Acceso: %lld\n",
-                   i, buffer->paginas[i].nombre_archivo, (long long)buffer->paginas[i].ultimo_acceso);
+        for (int i = 0; i < MAX_ENTRADAS_CACHE; i++) {
+            Pagina *pagina = atomic_load_explicit(&buffer->ranuras[i], memory_order_acquire);
+            if (pagina) {
+                printf("  [%d] Nombre: %s, Bytes: %zu, Referencias: %d, Aciertos: %llu\n",
+                       i, pagina->nombre_archivo, pagina->coste,
+                       atomic_load_explicit(&pagina->referencias, memory_order_relaxed),
+                       (unsigned long long)sumar_aciertos(i));
+            }
         }
     }
-    pthread_mutex_unlock(&buffer->mutex);
+    printf("  Total: %d páginas, %zu/%zu bytes\n", atomic_load(&buffer->num_paginas),
+           atomic_load(&buffer->bytes_usados), buffer->bytes_maximos);
+    if (registro) {
+        salir_epoca(registro);
+    } else {
+        pthread_mutex_unlock(&buffer->mutex);
+    }
     printf("-------------------------------------------\n");
+    fflush(stdout);
 }
 
-// Función para liberar toda la memoria usada por el buffer de páginas
+// Función para liberar toda la memoria usada por el buffer de páginas. Las páginas
+// que todavía se estén enviando se liberan cuando su respuesta suelte la referencia.
 void liberar_buffer(BufferPaginas *buffer) {
     pthread_mutex_lock(&buffer->mutex);
-    printf("\n[BUFFER] Liberando memoria del buffer de páginas...\n");
-    for (int i = 0; i < buffer->num_paginas; i++) {
-        free(buffer->paginas[i].nombre_archivo);
-        free(buffer->paginas[i].contenido);
+    DIAG_INFO("\n[BUFFER] Liberando memoria del buffer de páginas...\n");
+    for (int i = 0; i < MAX_ENTRADAS_CACHE; i++) {
+        Pagina *pagina = atomic_load_explicit(&buffer->ranuras[i], memory_order_relaxed);
+        if (pagina) {
+            retirar_pagina(buffer, pagina);
+        }
     }
-    buffer->num_paginas = 0;
+    recolectar_retiradas(buffer);
     pthread_mutex_unlock(&buffer->mutex);
-    pthread_mutex_destroy(&buffer->mutex); // Destruir el mutex
-}
\ No newline at end of file
+}
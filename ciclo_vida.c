@@ -0,0 +1,215 @@
+#include "servidor_web.h"
+
+// Ciclo de vida del proceso. Las señales se bloquean en todos los hilos y las recibe
+// un hilo propio con signalfd(), así que su tratamiento no está limitado a funciones
+// async-signal-safe:
+//   SIGINT, SIGTERM  termina hilo_senales(); main() deja de aceptar y drena
+//   SIGUSR1          imprime el estado de la caché de páginas (el maestro del modo de
+//                    procesos lo reenvía a sus trabajadores)
+//   SIGUSR2          relevo: vuelve a ejecutar el binario con los sockets de escucha
+//                    abiertos. Cuando el proceso nuevo ya atiende, manda SIGTERM al
+//                    anterior, que drena sus conexiones; ninguna conexión se rechaza.
+//                    En el modo de procesos solo lo atiende el maestro.
+//   SIGCHLD          recoge un relevo que terminó sin llegar a atender, o un trabajador
+
+#define VARIABLE_SOCKETS "SERVIDOR_SOCKETS_HEREDADOS"
+#define VARIABLE_RELEVO "SERVIDOR_RELEVO_PID"
+
+extern char **environ;
+
+static char **argumentos;    // argv de main(), para volver a ejecutar el binario
+static pid_t pid_relevo = 0; // proceso nuevo lanzado con SIGUSR2 y aún sin recoger
+static pid_t pid_anterior = 0; // proceso al que avisar en un relevo, leído al arrancar
+
+void guardar_argumentos(char **argv) {
+    argumentos = argv;
+}
+
+static void conjunto_senales(sigset_t *senales) {
+    sigemptyset(senales);
+    sigaddset(senales, SIGINT);
+    sigaddset(senales, SIGTERM);
+    sigaddset(senales, SIGUSR1);
+    sigaddset(senales, SIGUSR2);
+    sigaddset(senales, SIGCHLD);
+}
+
+// Bloquea las señales del servidor en el hilo que llama (y en los que cree después) y
+// devuelve un signalfd por el que llegan, o -1. Se llama antes de crear ningún hilo.
+int bloquear_senales(void) {
+    sigset_t senales;
+    conjunto_senales(&senales);
+    int error = pthread_sigmask(SIG_BLOCK, &senales, NULL);
+    if (error != 0) {
+        fprintf(stderr, "[SEÑALES] Error en pthread_sigmask: %s\n", strerror(error));
+        return -1;
+    }
+    int senal_fd = signalfd(-1, &senales, SFD_CLOEXEC);
+    if (senal_fd < 0) {
+        perror("[SEÑALES] Error en signalfd");
+    }
+    return senal_fd;
+}
+
+// Recoge los sockets de escucha que dejó abiertos el proceso anterior en un relevo.
+// Devuelve cuántos hay; 0 si el proceso no viene de un relevo.
+int heredar_sockets_escucha(int *sockets, int max_sockets) {
+    const char *relevo = getenv(VARIABLE_RELEVO);
+    if (relevo) {
+        pid_anterior = (pid_t)atoi(relevo);
+        unsetenv(VARIABLE_RELEVO);
+    }
+    const char *lista = getenv(VARIABLE_SOCKETS);
+    if (!lista) {
+        return 0;
+    }
+    int num_sockets = 0;
+    const char *p = lista;
+    while (*p && num_sockets < max_sockets) {
+        char *fin;
+        long fd = strtol(p, &fin, 10);
+        int escucha = 0;
+        socklen_t tam = sizeof(escucha);
+        if (fin == p || fd < 0 || fd > INT_MAX ||
+            getsockopt((int)fd, SOL_SOCKET, SO_ACCEPTCONN, &escucha, &tam) != 0 || !escucha) {
+            fprintf(stderr, "[SEÑALES] Socket heredado inválido en %s='%s'.\n", VARIABLE_SOCKETS, lista);
+            break;
+        }
+        // Se heredó sin CLOEXEC; los motores esperan sockets de escucha no bloqueantes.
+        fcntl((int)fd, F_SETFD, FD_CLOEXEC);
+        fcntl((int)fd, F_SETFL, fcntl((int)fd, F_GETFL) | O_NONBLOCK);
+        sockets[num_sockets++] = (int)fd;
+        p = *fin == ',' ? fin + 1 : fin;
+    }
+    unsetenv(VARIABLE_SOCKETS);
+    return num_sockets;
+}
+
+// En un relevo, avisa al proceso anterior de que este ya atiende para que drene.
+void avisar_relevo_listo(void) {
+    if (pid_anterior > 1 && pid_anterior == getppid()) {
+        DIAG_INFO("[SEÑALES] Relevo listo: se pide al proceso %d que drene y termine.\n", (int)pid_anterior);
+        kill(pid_anterior, SIGTERM);
+    }
+    pid_anterior = 0;
+}
+
+// Lanza el relevo: argv[0] se vuelve a buscar, así que se ejecuta el binario que haya
+// ahora en disco. Los sockets de escucha pasan abiertos y sus números van en el entorno.
+static void iniciar_relevo(void) {
+    if (pid_relevo > 0) {
+        DIAG_AVISO("[SEÑALES] Ya hay un relevo en marcha (pid %d).\n", (int)pid_relevo);
+        return;
+    }
+    char sockets[MAX_REACTORES * 12] = "";
+    size_t usado = 0;
+    for (int i = 0; i < num_sockets_escucha && usado < sizeof(sockets); i++) {
+        usado += snprintf(sockets + usado, sizeof(sockets) - usado, "%s%d", i ? "," : "", sockets_escucha[i]);
+    }
+    char variable_sockets[sizeof(sockets) + sizeof(VARIABLE_SOCKETS) + 1];
+    char variable_relevo[sizeof(VARIABLE_RELEVO) + 16];
+    snprintf(variable_sockets, sizeof(variable_sockets), VARIABLE_SOCKETS "=%s", sockets);
+    snprintf(variable_relevo, sizeof(variable_relevo), VARIABLE_RELEVO "=%d", (int)getpid());
+
+    // El entorno del hijo se prepara antes de fork(): después, en un proceso con hilos,
+    // solo se pueden usar funciones async-signal-safe.
+    size_t num_variables = 0;
+    while (environ[num_variables]) {
+        num_variables++;
+    }
+    char **entorno = malloc((num_variables + 3) * sizeof(char *));
+    if (!entorno) {
+        perror("[SEÑALES] Error reservando memoria para el relevo");
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < num_variables; i++) {
+        if (strncmp(environ[i], VARIABLE_SOCKETS "=", sizeof(VARIABLE_SOCKETS)) != 0 &&
+            strncmp(environ[i], VARIABLE_RELEVO "=", sizeof(VARIABLE_RELEVO)) != 0) {
+            entorno[n++] = environ[i];
+        }
+    }
+    entorno[n++] = variable_sockets;
+    entorno[n++] = variable_relevo;
+    entorno[n] = NULL;
+
+    // Los sockets se crearon con CLOEXEC; solo son heredables mientras dura el fork().
+    for (int i = 0; i < num_sockets_escucha; i++) {
+        fcntl(sockets_escucha[i], F_SETFD, 0);
+    }
+    sigset_t ninguna;
+    sigemptyset(&ninguna);
+    pid_t hijo = fork();
+    if (hijo == 0) {
+        sigprocmask(SIG_SETMASK, &ninguna, NULL);
+        execvpe(argumentos[0], argumentos, entorno);
+        _exit(127);
+    }
+    for (int i = 0; i < num_sockets_escucha; i++) {
+        fcntl(sockets_escucha[i], F_SETFD, FD_CLOEXEC);
+    }
+    free(entorno);
+    if (hijo < 0) {
+        perror("[SEÑALES] Error en fork para el relevo");
+        return;
+    }
+    pid_relevo = hijo;
+    DIAG_INFO("[SEÑALES] Relevo lanzado (pid %d); se sigue atendiendo hasta que esté listo.\n", (int)hijo);
+}
+
+// Recoge los hijos terminados. Si es el relevo, este proceso sigue atendiendo; si es un
+// trabajador del modo de procesos, se relanza.
+static void recoger_relevo(void) {
+    int estado;
+    pid_t pid;
+    while ((pid = waitpid(-1, &estado, WNOHANG)) > 0) {
+        if (pid == pid_relevo) {
+            pid_relevo = 0;
+            DIAG_AVISO("[SEÑALES] El relevo (pid %d) terminó sin llegar a atender (%s %d); se sigue atendiendo.\n",
+                       (int)pid, WIFEXITED(estado) ? "estado" : "señal",
+                       WIFEXITED(estado) ? WEXITSTATUS(estado) : WTERMSIG(estado));
+        } else {
+            trabajador_terminado(pid, estado);
+        }
+    }
+}
+
+// Hilo de señales. Termina cuando se pide el apagado; 'arg' apunta al signalfd.
+void *hilo_senales(void *arg) {
+    int senal_fd = *(int *)arg;
+    for (;;) {
+        struct signalfd_siginfo info;
+        ssize_t n = read(senal_fd, &info, sizeof(info));
+        if (n != (ssize_t)sizeof(info)) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            perror("[SEÑALES] Error leyendo el signalfd");
+            return NULL;
+        }
+        switch (info.ssi_signo) {
+        case SIGUSR1:
+            if (reenviar_a_trabajadores(SIGUSR1) == 0) {
+                imprimir_buffer(&buffer_global);
+            }
+            break;
+        case SIGUSR2:
+            if (numero_trabajador() >= 0) {
+                DIAG_AVISO("[SEÑALES] El relevo se pide al maestro, no a un trabajador (pid %d).\n", (int)getpid());
+            } else {
+                iniciar_relevo();
+            }
+            break;
+        case SIGCHLD:
+            recoger_relevo();
+            break;
+        default:
+            if (pid_relevo > 0 && (pid_t)info.ssi_pid == pid_relevo) {
+                DIAG_INFO("[SEÑALES] El relevo (pid %d) ya atiende. Cerrando este proceso...\n", (int)pid_relevo);
+            } else {
+                DIAG_INFO("\n[SEÑALES] Señal de terminación recibida. Cerrando el servidor...\n");
+            }
+            return NULL;
+        }
+    }
+}
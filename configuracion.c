@@ -0,0 +1,271 @@
+#include "servidor_web.h"
+
+ConfigServidor config_global;
+
+// Lee un entero positivo de una variable de entorno, o devuelve el valor por defecto.
+static int leer_entero_entorno(const char *nombre, int valor_defecto) {
+    const char *valor = getenv(nombre);
+    if (!valor || *valor == '\0') {
+        return valor_defecto;
+    }
+    char *fin;
+    long numero = strtol(valor, &fin, 10);
+    if (*fin != '\0' || numero <= 0 || numero > 1000000) {
+        fprintf(stderr, "[CONFIG] Valor inválido para %s: '%s'. Se usa %d.\n", nombre, valor, valor_defecto);
+        return valor_defecto;
+    }
+    return (int)numero;
+}
+
+// Lee un valor de Cache-Control de una variable de entorno. Se rechazan los valores que
+// romperían el encabezado precalculado (saltos de línea o demasiado largos).
+static const char *leer_cache_control(const char *nombre, const char *valor_defecto) {
+    const char *valor = getenv(nombre);
+    if (!valor || *valor == '\0') {
+        return valor_defecto;
+    }
+    if (strlen(valor) > MAX_CACHE_CONTROL || strpbrk(valor, "\r\n")) {
+        fprintf(stderr, "[CONFIG] Valor inválido para %s. Se usa '%s'.\n", nombre, valor_defecto);
+        return valor_defecto;
+    }
+    return valor;
+}
+
+// Redondea hacia arriba a la siguiente potencia de 2 (la cola usa una máscara).
+static int siguiente_potencia_de_2(int n) {
+    int p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+// Carga la configuración desde variables de entorno SERVIDOR_*, con valores por defecto.
+void cargar_configuracion(ConfigServidor *config) {
+    config->motor = MOTOR_HILOS;
+    const char *motor = getenv("SERVIDOR_MOTOR");
+    if (motor) {
+        if (strcmp(motor, "hilos") == 0) {
+            config->motor = MOTOR_HILOS;
+        } else if (strcmp(motor, "epoll") == 0) {
+            config->motor = MOTOR_EPOLL;
+        } else if (strcmp(motor, "uring") == 0) {
+            config->motor = MOTOR_URING;
+        } else {
+            fprintf(stderr, "[CONFIG] Motor desconocido '%s'. Se usa 'hilos'.\n", motor);
+        }
+    }
+
+    long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    // Modo de procesos: 0 (por defecto) atiende en un solo proceso.
+    const char *procesos = getenv("SERVIDOR_PROCESOS");
+    config->procesos = procesos && strcmp(procesos, "0") == 0 ? 0 : leer_entero_entorno("SERVIDOR_PROCESOS", 0);
+    if (config->procesos > MAX_PROCESOS) {
+        config->procesos = MAX_PROCESOS;
+    }
+    const char *fijar_cpu = getenv("SERVIDOR_FIJAR_CPU");
+    config->fijar_cpu = !(fijar_cpu && strcmp(fijar_cpu, "no") == 0);
+    config->backlog = leer_entero_entorno("SERVIDOR_BACKLOG", BACKLOG_DEFECTO);
+    config->num_reactores = leer_entero_entorno("SERVIDOR_REACTORES", nucleos > 0 ? (int)nucleos : 1);
+    if (config->num_reactores > MAX_REACTORES) {
+        config->num_reactores = MAX_REACTORES;
+    }
+    config->num_trabajadores = leer_entero_entorno("SERVIDOR_TRABAJADORES", NUM_TRABAJADORES_DEFECTO);
+    config->tamano_cola = siguiente_potencia_de_2(leer_entero_entorno("SERVIDOR_COLA", TAMANO_COLA_DEFECTO));
+    config->limite_espera = leer_entero_entorno("SERVIDOR_LIMITE_ESPERA", LIMITE_ESPERA_DEFECTO);
+    config->timeout_inactivo = leer_entero_entorno("SERVIDOR_TIMEOUT_INACTIVO", TIMEOUT_INACTIVO_DEFECTO);
+    config->max_peticiones_conexion = leer_entero_entorno("SERVIDOR_MAX_PETICIONES", MAX_PETICIONES_DEFECTO);
+    config->plazo_drenaje = leer_entero_entorno("SERVIDOR_PLAZO_DRENAJE", PLAZO_DRENAJE_DEFECTO);
+    config->cache_bytes = (size_t)leer_entero_entorno("SERVIDOR_CACHE_KB", CACHE_BYTES_DEFECTO / 1024) * 1024;
+
+    // Límites por IP de cliente (ver limitador.c); 0 desactiva cada uno. En el modo de
+    // procesos son del servidor entero: los trabajadores comparten la tabla.
+    const char *conexiones_ip = getenv("SERVIDOR_CONEXIONES_POR_IP");
+    config->conexiones_por_ip = conexiones_ip && strcmp(conexiones_ip, "0") == 0 ? 0 :
+                                leer_entero_entorno("SERVIDOR_CONEXIONES_POR_IP", CONEXIONES_POR_IP_DEFECTO);
+    config->peticiones_por_ip = leer_entero_entorno("SERVIDOR_PETICIONES_POR_IP", 0);
+    config->rafaga_por_ip = config->peticiones_por_ip > 0 ?
+                            leer_entero_entorno("SERVIDOR_RAFAGA_POR_IP", 2 * config->peticiones_por_ip) : 0;
+    config->rechazo_por_ip = RECHAZO_RESPONDER;
+    const char *rechazo = getenv("SERVIDOR_RECHAZO_IP");
+    if (rechazo) {
+        if (strcmp(rechazo, "responder") == 0) {
+            config->rechazo_por_ip = RECHAZO_RESPONDER;
+        } else if (strcmp(rechazo, "cerrar") == 0) {
+            config->rechazo_por_ip = RECHAZO_CERRAR;
+        } else {
+            fprintf(stderr, "[CONFIG] Rechazo por IP desconocido '%s'. Se usa 'responder'.\n", rechazo);
+        }
+    }
+
+    // Variantes comprimidas que se guardan junto a cada página de texto al cargarla.
+    config->compresion = COMPRIMIR_GZIP;
+    const char *compresion = getenv("SERVIDOR_COMPRESION");
+    if (compresion) {
+        if (strcmp(compresion, "gzip") == 0) {
+            config->compresion = COMPRIMIR_GZIP;
+        } else if (strcmp(compresion, "brotli") == 0) {
+#ifdef SERVIDOR_BROTLI
+            config->compresion = COMPRIMIR_GZIP | COMPRIMIR_BROTLI;
+#else
+            fprintf(stderr, "[CONFIG] Compilado sin brotli (-DSERVIDOR_BROTLI). Se usa 'gzip'.\n");
+#endif
+        } else if (strcmp(compresion, "ninguna") == 0) {
+            config->compresion = 0;
+        } else {
+            fprintf(stderr, "[CONFIG] Compresión desconocida '%s'. Se usa 'gzip'.\n", compresion);
+        }
+    }
+    config->nivel_gzip = leer_entero_entorno("SERVIDOR_NIVEL_GZIP", NIVEL_GZIP_DEFECTO);
+    if (config->nivel_gzip > 9) {
+        config->nivel_gzip = 9;
+    }
+
+    config->umbral_transmision = (size_t)leer_entero_entorno("SERVIDOR_UMBRAL_TRANSMISION_KB",
+                                                            UMBRAL_TRANSMISION_DEFECTO / 1024) * 1024;
+    config->respaldo = RESPALDO_MEMORIA;
+    const char *respaldo = getenv("SERVIDOR_RESPALDO");
+    if (respaldo) {
+        if (strcmp(respaldo, "memoria") == 0) {
+            config->respaldo = RESPALDO_MEMORIA;
+        } else if (strcmp(respaldo, "mmap") == 0) {
+            config->respaldo = RESPALDO_MMAP;
+        } else {
+            fprintf(stderr, "[CONFIG] Respaldo de caché desconocido '%s'. Se usa 'memoria'.\n", respaldo);
+        }
+    }
+
+    config->precarga = PRECARGA_PAGINAS;
+    const char *precarga = getenv("SERVIDOR_PRECARGA");
+    static const char *nombres_precarga[] = {"ninguna", "paginas", "todo"};
+    if (precarga) {
+        int encontrada = 0;
+        for (int i = PRECARGA_NINGUNA; i <= PRECARGA_TODO; i++) {
+            if (strcmp(precarga, nombres_precarga[i]) == 0) {
+                config->precarga = i;
+                encontrada = 1;
+            }
+        }
+        if (!encontrada) {
+            fprintf(stderr, "[CONFIG] Precarga desconocida '%s'. Se usa 'paginas'.\n", precarga);
+        }
+    }
+    config->hilos_precarga = leer_entero_entorno("SERVIDOR_HILOS_PRECARGA", nucleos > 0 ? (int)nucleos : 1);
+    if (config->hilos_precarga > MAX_REACTORES) {
+        config->hilos_precarga = MAX_REACTORES;
+    }
+    const char *vigilar = getenv("SERVIDOR_VIGILAR");
+    config->vigilar_contenido = !(vigilar && strcmp(vigilar, "no") == 0);
+
+    config->cache_control_paginas = leer_cache_control("SERVIDOR_CACHE_CONTROL_PAGINAS", CACHE_CONTROL_PAGINAS_DEFECTO);
+    config->cache_control_imagenes = leer_cache_control("SERVIDOR_CACHE_CONTROL_IMAGENES", CACHE_CONTROL_IMAGENES_DEFECTO);
+
+    // Límites del analizador de peticiones. El cuerpo, si lo hay, tiene que caber en el
+    // buffer de lectura junto con los encabezados.
+    config->limites_http.max_uri = leer_entero_entorno("SERVIDOR_LIMITE_URI", LIMITE_URI_DEFECTO);
+    config->limites_http.max_encabezados = leer_entero_entorno("SERVIDOR_LIMITE_ENCABEZADOS", LIMITE_ENCABEZADOS_DEFECTO);
+    if (config->limites_http.max_encabezados > MAX_ENCABEZADOS_HTTP) {
+        config->limites_http.max_encabezados = MAX_ENCABEZADOS_HTTP;
+    }
+    config->limites_http.max_cuerpo = leer_entero_entorno("SERVIDOR_LIMITE_CUERPO", LIMITE_CUERPO_DEFECTO);
+    if (config->limites_http.max_cuerpo > TAMANO_BUFFER - 1) {
+        config->limites_http.max_cuerpo = TAMANO_BUFFER - 1;
+    }
+
+    config->log_anillo = siguiente_potencia_de_2(leer_entero_entorno("SERVIDOR_LOG_ANILLO", ANILLO_REGISTRO_DEFECTO));
+    config->log_intervalo_ms = leer_entero_entorno("SERVIDOR_LOG_INTERVALO_MS", INTERVALO_REGISTRO_DEFECTO);
+    config->log_lote = leer_entero_entorno("SERVIDOR_LOG_LOTE", LOTE_REGISTRO_DEFECTO);
+    if (config->log_lote > MAX_LOTE_REGISTRO) {
+        config->log_lote = MAX_LOTE_REGISTRO;
+    }
+
+    config->log_politica = REGISTRO_DESCARTAR;
+    const char *politica_log = getenv("SERVIDOR_LOG_POLITICA");
+    if (politica_log) {
+        if (strcmp(politica_log, "descartar") == 0) {
+            config->log_politica = REGISTRO_DESCARTAR;
+        } else if (strcmp(politica_log, "bloquear") == 0) {
+            config->log_politica = REGISTRO_BLOQUEAR;
+        } else {
+            fprintf(stderr, "[CONFIG] Política de registro desconocida '%s'. Se usa 'descartar'.\n", politica_log);
+        }
+    }
+
+    config->nivel_log = NIVEL_INFO;
+    const char *nivel = getenv("SERVIDOR_NIVEL_LOG");
+    static const char *nombres_nivel[] = {"error", "aviso", "info", "depuracion"};
+    if (nivel) {
+        int encontrado = 0;
+        for (int i = NIVEL_ERROR; i <= NIVEL_DEPURACION; i++) {
+            if (strcmp(nivel, nombres_nivel[i]) == 0) {
+                config->nivel_log = i;
+                encontrado = 1;
+            }
+        }
+        if (!encontrado) {
+            fprintf(stderr, "[CONFIG] Nivel de log desconocido '%s'. Se usa 'info'.\n", nivel);
+        }
+    }
+    nivel_diagnostico = config->nivel_log;
+
+    config->politica = POLITICA_BLOQUEAR;
+    const char *politica = getenv("SERVIDOR_CONTRAPRESION");
+    if (politica) {
+        if (strcmp(politica, "bloquear") == 0) {
+            config->politica = POLITICA_BLOQUEAR;
+        } else if (strcmp(politica, "rechazar") == 0) {
+            config->politica = POLITICA_RECHAZAR;
+        } else if (strcmp(politica, "desbordar") == 0) {
+            config->politica = POLITICA_DESBORDAR;
+        } else {
+            fprintf(stderr, "[CONFIG] Política de contrapresión desconocida '%s'. Se usa 'bloquear'.\n", politica);
+        }
+    }
+
+    static const char *nombres_politica[] = {"bloquear", "rechazar", "desbordar"};
+    if (config->procesos > 0) {
+        DIAG_INFO("[CONFIG] Procesos: maestro y %d trabajadores%s, backlog: %d\n", config->procesos,
+                  config->fijar_cpu ? " fijados a núcleos" : "", config->backlog);
+    } else {
+        DIAG_INFO("[CONFIG] Procesos: uno solo, backlog: %d\n", config->backlog);
+    }
+    if (config->motor == MOTOR_EPOLL) {
+        DIAG_INFO("[CONFIG] Motor: epoll, reactores: %d\n", config->num_reactores);
+    } else if (config->motor == MOTOR_URING) {
+        DIAG_INFO("[CONFIG] Motor: io_uring, anillos: %d\n", config->num_reactores);
+    } else {
+        DIAG_INFO("[CONFIG] Motor: hilos, trabajadores: %d, cola: %d, contrapresión: %s\n",
+                  config->num_trabajadores, config->tamano_cola, nombres_politica[config->politica]);
+    }
+    DIAG_INFO("[CONFIG] Keep-alive: timeout %d s, máximo %d peticiones por conexión; drenaje al apagar: %d s\n",
+              config->timeout_inactivo, config->max_peticiones_conexion, config->plazo_drenaje);
+    if (config->conexiones_por_ip > 0 || config->peticiones_por_ip > 0) {
+        char conexiones[16] = "sin límite", peticiones[48] = "sin límite";
+        if (config->conexiones_por_ip > 0) {
+            snprintf(conexiones, sizeof(conexiones), "%d", config->conexiones_por_ip);
+        }
+        if (config->peticiones_por_ip > 0) {
+            snprintf(peticiones, sizeof(peticiones), "%d/s (ráfaga %d)", config->peticiones_por_ip, config->rafaga_por_ip);
+        }
+        DIAG_INFO("[CONFIG] Límites por IP: %s conexiones, %s peticiones, al superarlos: %s\n", conexiones, peticiones,
+                  config->rechazo_por_ip == RECHAZO_CERRAR ? "cerrar" : "responder 503/429");
+    } else {
+        DIAG_INFO("[CONFIG] Límites por IP: ninguno\n");
+    }
+    DIAG_INFO("[CONFIG] Caché de páginas: %zu KB, cuerpos en %s, desde disco a partir de %zu KB\n",
+              config->cache_bytes / 1024, config->respaldo == RESPALDO_MMAP ? "mmap" : "memoria",
+              config->umbral_transmision / 1024);
+    DIAG_INFO("[CONFIG] Precarga: %s (%d hilos), vigilancia de cambios con inotify: %s\n",
+              nombres_precarga[config->precarga], config->hilos_precarga, config->vigilar_contenido ? "sí" : "no");
+    DIAG_INFO("[CONFIG] Cache-Control: páginas '%s', imágenes '%s'\n",
+              config->cache_control_paginas, config->cache_control_imagenes);
+    DIAG_INFO("[CONFIG] Compresión al cargar: %s\n",
+              config->compresion & COMPRIMIR_BROTLI ? "gzip y brotli" :
+              config->compresion & COMPRIMIR_GZIP ? "gzip" : "ninguna");
+    DIAG_INFO("[CONFIG] Límites HTTP: URI %zu bytes, %d encabezados, cuerpo %zu bytes\n",
+              config->limites_http.max_uri, config->limites_http.max_encabezados, config->limites_http.max_cuerpo);
+    DIAG_INFO("[CONFIG] Registro: anillos de %d líneas, volcado cada %d ms o cada %d líneas, anillo lleno: %s\n",
+              config->log_anillo, config->log_intervalo_ms, config->log_lote,
+              config->log_politica == REGISTRO_BLOQUEAR ? "bloquear" : "descartar");
+    DIAG_INFO("[CONFIG] Nivel de diagnóstico: %s\n", nombres_nivel[config->nivel_log]);
+}
@@ -3,50 +3,62 @@
 void *hilo_despachador(void *arg) {
     ServidorArgs *servidor_args = (ServidorArgs *)arg;
     int servidor_fd = servidor_args->servidor_fd;
-    BufferPaginas *buffer_paginas = servidor_args->buffer_paginas;
+    ColaConexiones *cola = servidor_args->cola;
 
     //El hilo despachador se inicia.
-    printf("[DESPACHADOR %p] Hilo despachador iniciado, esperando conexiones...\n", (void*)pthread_self());
+    DIAG_INFO("[DESPACHADOR %p] Hilo despachador iniciado, esperando conexiones...\n", (void*)pthread_self());
 
+    // El socket de escucha es no bloqueante: se espera con poll() y un timeout para ver
+    // el apagado sin que otro hilo tenga que cerrarlo (en un relevo lo comparte con el
+    // proceso nuevo, que también puede llevarse la conexión antes que este).
+    struct pollfd pfd = {.fd = servidor_fd, .events = POLLIN};
     while (servidor_corriendo) {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
         struct sockaddr_in direccion_cliente;
         socklen_t longitud_cliente = sizeof(direccion_cliente);
-        int cliente_fd = accept(servidor_fd, (struct sockaddr *)&direccion_cliente, &longitud_cliente);
+        int cliente_fd = accept4(servidor_fd, (struct sockaddr *)&direccion_cliente, &longitud_cliente, SOCK_CLOEXEC);
 
         if (cliente_fd < 0) {
-            if (!servidor_corriendo || errno == EINVAL) {
-                // EINVAL se recibe si el socket ya se ha cerrado.
-                // El hilo despachador termina porque el servidor se ha detenido.
-                printf("[DESPACHADOR %p] El socket del servidor ha sido cerrado. Terminando el hilo despachador.\n", (void*)pthread_self());
-                break;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            contar_metrica(METRICA_ERRORES_ACCEPT, 1);
+            if (errno == EMFILE || errno == ENFILE) {
+                // La conexión sigue en la cola de listen y poll() volvería enseguida: se
+                // deja de aceptar un momento para que las conexiones en curso suelten descriptores.
+                DIAG_AVISO("[DESPACHADOR] Sin descriptores libres; se pausa accept() %d ms.\n", PAUSA_ACCEPT_MS);
+                poll(NULL, 0, PAUSA_ACCEPT_MS);
+                continue;
             }
             perror("[DESPACHADOR] Error al aceptar conexion");
             continue;
         }
         
-        printf("[DESPACHADOR %p] Conexión aceptada. Se creará un hilo trabajador para atenderla.\n", (void*)pthread_self());
-
-        pthread_t trabajador;
-        TrabajadorArgs *args_trabajador = malloc(sizeof(TrabajadorArgs));
-        if (!args_trabajador) {
-            perror("[DESPACHADOR] Error reservando memoria para hilo trabajador");
+        // Una IP que ya tiene todas sus conexiones no ocupa un hilo del pool ni un hueco de la cola.
+        int entrada_cliente = admitir_conexion(direccion_cliente.sin_addr.s_addr);
+        if (entrada_cliente == CLIENTE_RECHAZADO) {
+            DIAG_DEPURACION("[DESPACHADOR %p] Conexión rechazada por el límite de su IP.\n", (void*)pthread_self());
+            if (config_global.rechazo_por_ip == RECHAZO_RESPONDER) {
+                send(cliente_fd, respuesta_503, strlen(respuesta_503), MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
             close(cliente_fd);
             continue;
         }
         
-        args_trabajador->cliente_fd = cliente_fd;
-        args_trabajador->buffer_paginas = buffer_paginas;
+        DIAG_DEPURACION("[DESPACHADOR %p] Conexión aceptada. Se encola para el pool de trabajadores.\n", (void*)pthread_self());
 
-        printf("[DESPACHADOR %p] Creando hilo trabajador para atender la petición.\n", (void*)pthread_self());
-        if (pthread_create(&trabajador, NULL, hilo_trabajador, args_trabajador) != 0) {
-            perror("[DESPACHADOR] Error al crear hilo trabajador");
+        if (encolar_conexion(cola, cliente_fd, entrada_cliente) != 0) {
+            // Cola llena: se rechaza sin bloquear al despachador con un cliente lento.
+            DIAG_AVISO("[DESPACHADOR %p] Cola llena. Conexión rechazada con 503.\n", (void*)pthread_self());
+            send(cliente_fd, respuesta_503, strlen(respuesta_503), MSG_DONTWAIT | MSG_NOSIGNAL);
             close(cliente_fd);
-            free(args_trabajador);
-        } else {
-            pthread_detach(trabajador);
+            soltar_conexion(entrada_cliente);
         }
     }
     
-    printf("[DESPACHADOR %p] Hilo despachador finalizado.\n", (void*)pthread_self());
+    close(servidor_fd);
+    DIAG_INFO("[DESPACHADOR %p] Hilo despachador finalizado; ya no se aceptan conexiones.\n", (void*)pthread_self());
     return NULL;
 }
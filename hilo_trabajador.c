@@ -4,8 +4,10 @@ void *hilo_trabajador(void *arg) {
     TrabajadorArgs *args = (TrabajadorArgs *)arg;
     int cliente_fd = args->cliente_fd;
     BufferPaginas *buffer_global = args->buffer_paginas;
+    ConexionEnServicio *en_servicio = args->en_servicio;
     char buffer_peticion[TAMANO_BUFFER];
-    
+    PeticionHttp peticion;
+
     struct sockaddr_in direccion_cliente;
     socklen_t longitud_cliente = sizeof(direccion_cliente);
     getpeername(cliente_fd, (struct sockaddr *)&direccion_cliente, &longitud_cliente);
@@ -13,70 +15,83 @@ void *hilo_trabajador(void *arg) {
     inet_ntop(AF_INET, &direccion_cliente.sin_addr, ip_cliente, INET_ADDRSTRLEN);
     int puerto_cliente = ntohs(direccion_cliente.sin_port);
 
-    printf("[TRABAJADOR %p] Hilo iniciado para atender a %s:%d\n", (void*)pthread_self(), ip_cliente, puerto_cliente);
-
-    ssize_t bytes_recibidos = recv(cliente_fd, buffer_peticion, sizeof(buffer_peticion) - 1, 0);
-    if (bytes_recibidos > 0) {
-        buffer_peticion[bytes_recibidos] = '\0';
-        char *linea_peticion = strtok(buffer_peticion, "\n");
-        char metodo[10], ruta[256];
-        sscanf(linea_peticion, "%s %s", metodo, ruta);
-
-        printf("[TRABAJADOR %p] Petición para '%s' recibida desde %s:%d\n", (void*)pthread_self(), ruta, ip_cliente, puerto_cliente);
-
-        size_t tam_contenido = 0;
-        char *contenido = obtener_pagina(buffer_global, ruta, &tam_contenido);
+    DIAG_DEPURACION("[TRABAJADOR %p] Hilo iniciado para atender a %s:%d\n", (void*)pthread_self(), ip_cliente, puerto_cliente);
 
-        if (contenido) {
-            const char *extension = strrchr(ruta, '.');
-            char *content_type = "text/html";
+    // Un cliente inactivo más allá del timeout libera al hilo del pool.
+    struct timeval timeout = {config_global.timeout_inactivo, 0};
+    setsockopt(cliente_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-            if (extension) {
-                if (strcmp(extension, ".css") == 0)
-                    content_type = "text/css";
-                else if (strcmp(extension, ".js") == 0)
-                    content_type = "application/javascript";
-                else if (strcmp(extension, ".png") == 0)
-                    content_type = "image/png";
-                else if (strcmp(extension, ".jpg") == 0 || strcmp(extension, ".jpeg") == 0)
-                    content_type = "image/jpeg";
-                else if (strcmp(extension, ".gif") == 0)
-                    content_type = "image/gif";
+    // Se atienden peticiones en la misma conexión mientras el cliente pida keep-alive.
+    // Las peticiones encadenadas (pipelining) que llegan juntas se atienden en orden
+    // desde el mismo buffer antes de volver a leer del socket.
+    size_t leidos = 0;
+    int atendidas = 0;
+    if (en_servicio) {
+        pthread_mutex_lock(&en_servicio->mutex);
+        en_servicio->cliente_fd = cliente_fd;
+        pthread_mutex_unlock(&en_servicio->mutex);
+    }
+    iniciar_peticion_http(&peticion);
+    for (;;) {
+        int estado = analizar_peticion(&peticion, buffer_peticion, leidos, &config_global.limites_http);
+        if (estado == ANALISIS_INCOMPLETO) {
+            // Tras una respuesta y sin nada pendiente, la conexión solo espera otra petición
+            // keep-alive: al apagar se puede cortar sin perder trabajo.
+            int ociosa = en_servicio && leidos == 0 && atendidas > 0;
+            if (ociosa) {
+                atomic_store(&en_servicio->ociosa, 1);
             }
-
-            char encabezado[512];
-            snprintf(encabezado, sizeof(encabezado),
-                     "HTTP/1.1 200 OK\r\n"
-                     "Content-Type: %s\r\n"
-                     "Content-Length: %zu\r\n"
-                     "Connection: close\r\n\r\n",
-                     content_type, tam_contenido);
-
-            send(cliente_fd, encabezado, strlen(encabezado), 0);
-            send(cliente_fd, contenido, tam_contenido, 0);
-            // El contenido de las imágenes se carga directamente desde el disco por lo que su memoria se libera aquí.
-            if (extension && (strcmp(extension, ".png") == 0 || strcmp(extension, ".jpg") == 0 || strcmp(extension, ".jpeg") == 0 || strcmp(extension, ".gif") == 0)) {
-                free(contenido);
+            ssize_t bytes_recibidos = recv(cliente_fd, buffer_peticion + leidos, sizeof(buffer_peticion) - 1 - leidos, 0);
+            if (ociosa) {
+                atomic_store(&en_servicio->ociosa, 0);
             }
-            printf("[TRABAJADOR %p] Recurso '%s' servido con éxito. Estado OK.\n", (void*)pthread_self(), ruta);
+            if (bytes_recibidos <= 0) {
+                break;
+            }
+            leidos += bytes_recibidos;
+            continue;
+        }
 
-            //  registrar solo páginas
-            if (extension && (strcmp(extension, ".html") == 0)) {
-                registrar_conexion(ip_cliente, puerto_cliente, ruta);
+        atendidas++;
+        int permitir_mantener = servidor_corriendo && atendidas < config_global.max_peticiones_conexion;
+        Respuesta respuesta;
+        if (estado < 0) {
+            responder_peticion_invalida(&respuesta, -estado);
+        } else if (!admitir_peticion(args->entrada_cliente)) {
+            if (config_global.rechazo_por_ip == RECHAZO_CERRAR) {
+                break;
             }
+            responder_peticion_invalida(&respuesta, 429);
+        } else {
+            procesar_peticion(buffer_global, &peticion, ip_cliente, puerto_cliente, permitir_mantener, &respuesta);
+        }
 
-            // Se imprime el estado del buffer después de servir la página
-            imprimir_buffer(buffer_global);
+        size_t enviados = 0;
+        uint64_t inicio_envio_ns = tiempo_monotonico_ns();
+        int resultado = enviar_respuesta(cliente_fd, &respuesta, &enviados);
+        if (resultado > 0) {
+            registrar_latencia(FASE_ENVIO, tiempo_monotonico_ns() - inicio_envio_ns);
+        }
+        liberar_respuesta(&respuesta);
 
-        } else {
-            printf("[TRABAJADOR %p] Recurso '%s' NO encontrado. Sirviendo error 404.\n", (void*)pthread_self(), ruta);
-            char *error_404 = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\n\r\n<h1>404 Not Found</h1>";
-            send(cliente_fd, error_404, strlen(error_404), 0);
+        if (resultado <= 0 || !respuesta.mantener_conexion) {
+            break;
         }
+        memmove(buffer_peticion, buffer_peticion + peticion.longitud, leidos - peticion.longitud);
+        leidos -= peticion.longitud;
+        iniciar_peticion_http(&peticion);
     }
 
-    close(cliente_fd);
-    free(args);
-    printf("[TRABAJADOR %p] Hilo finalizado. Conexión con %s:%d cerrada.\n", (void*)pthread_self(), ip_cliente, puerto_cliente);
+    // El apagado no corta el descriptor una vez cerrado, cuando el número ya puede ser de otro.
+    if (en_servicio) {
+        pthread_mutex_lock(&en_servicio->mutex);
+        en_servicio->cliente_fd = -1;
+        close(cliente_fd);
+        pthread_mutex_unlock(&en_servicio->mutex);
+    } else {
+        close(cliente_fd);
+    }
+    soltar_conexion(args->entrada_cliente);
+    DIAG_DEPURACION("[TRABAJADOR %p] Conexión con %s:%d cerrada tras %d peticiones.\n", (void*)pthread_self(), ip_cliente, puerto_cliente, atendidas);
     return NULL;
 }
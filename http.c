@@ -0,0 +1,710 @@
+#include "servidor_web.h"
+
+// Calidad (0-1000) que un valor de Accept-Encoding da a 'codificacion'. Una entrada
+// explícita manda sobre el comodín '*'; devuelve 0 si no la acepta.
+static int calidad_codificacion(VistaCadena aceptadas, const char *codificacion) {
+    size_t tam_codificacion = strlen(codificacion);
+    int explicita = -1, comodin = 0;
+    const char *p = aceptadas.datos;
+    const char *fin = aceptadas.datos + aceptadas.longitud;
+    while (p < fin) {
+        while (p < fin && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *nombre = p;
+        while (p < fin && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t tam = p - nombre;
+        int calidad = 1000;
+        while (p < fin && *p != ',') {
+            if (*p == ';') {
+                p++;
+                while (p < fin && (*p == ' ' || *p == '\t')) {
+                    p++;
+                }
+                if (fin - p >= 3 && (*p == 'q' || *p == 'Q') && p[1] == '=') {
+                    // qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+                    p += 2;
+                    calidad = 0;
+                    int digitos = 0;
+                    if (*p == '1') {
+                        calidad = 1000;
+                    }
+                    p++;
+                    if (p < fin && *p == '.') {
+                        for (p++; p < fin && *p >= '0' && *p <= '9'; p++) {
+                            if (digitos < 3 && calidad < 1000) {
+                                calidad += (*p - '0') * (digitos == 0 ? 100 : digitos == 1 ? 10 : 1);
+                            }
+                            digitos++;
+                        }
+                    }
+                }
+            } else {
+                p++;
+            }
+        }
+        if (tam == tam_codificacion && strncasecmp(nombre, codificacion, tam) == 0) {
+            explicita = calidad;
+        } else if (tam == 1 && *nombre == '*') {
+            comodin = calidad;
+        }
+    }
+    return explicita >= 0 ? explicita : comodin;
+}
+
+// Elige la variante precomprimida de mayor calidad según Accept-Encoding (brotli en
+// caso de empate), o la identidad si el cliente no acepta ninguna.
+static VariantePagina *elegir_variante(Pagina *pagina, const PeticionHttp *peticion) {
+    const VistaCadena *aceptadas = buscar_encabezado(peticion, "Accept-Encoding");
+    if (!aceptadas) {
+        return &pagina->identidad;
+    }
+    VariantePagina *elegida = &pagina->identidad;
+    int mejor = 0;
+    for (int c = 0; c < NUM_CODIFICACIONES; c++) {
+        if (pagina->variantes[c].contenido) {
+            int calidad = calidad_codificacion(*aceptadas, nombres_codificacion[c]);
+            if (calidad > 0 && calidad >= mejor) {
+                mejor = calidad;
+                elegida = &pagina->variantes[c];
+            }
+        }
+    }
+    return elegida;
+}
+
+// Comparación débil de If-None-Match: alguna etiqueta de la lista, sin el prefijo W/,
+// es igual al ETag de la representación, o la lista es '*'.
+static int coincide_etag(VistaCadena lista, const char *etag) {
+    if (etag[0] == 'W' && etag[1] == '/') {
+        etag += 2;
+    }
+    size_t tam_etag = strlen(etag);
+    const char *p = lista.datos;
+    const char *fin = lista.datos + lista.longitud;
+    while (p < fin) {
+        while (p < fin && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        if (p == fin) {
+            break;
+        }
+        if (*p == '*') {
+            return 1;
+        }
+        if (fin - p >= 2 && p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        const char *inicio = p;
+        if (p < fin && *p == '"') {
+            const char *cierre = memchr(p + 1, '"', fin - p - 1);
+            if (!cierre) {
+                return 0;
+            }
+            p = cierre + 1;
+        } else {
+            while (p < fin && *p != ',') {
+                p++;
+            }
+        }
+        if ((size_t)(p - inicio) == tam_etag && memcmp(inicio, etag, tam_etag) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Lee una fecha HTTP (IMF-fixdate). Devuelve 1 y el instante si es válida.
+static int leer_fecha_http(VistaCadena valor, time_t *instante) {
+    if (valor.longitud >= 64) {
+        return 0;
+    }
+    // strptime() necesita una cadena terminada; la fecha es corta y se copia.
+    char texto[64];
+    memcpy(texto, valor.datos, valor.longitud);
+    texto[valor.longitud] = '\0';
+    struct tm fecha = {0};
+    const char *fin = strptime(texto, "%a, %d %b %Y %H:%M:%S GMT", &fecha);
+    if (!fin || *fin != '\0') {
+        return 0;
+    }
+    *instante = timegm(&fecha);
+    return 1;
+}
+
+// Evalúa If-None-Match y, solo si no viene, If-Modified-Since (RFC 7232, sección 6).
+// Devuelve 1 si la representación no cambió y basta con responder 304.
+static int no_modificada(const Pagina *pagina, const VariantePagina *variante, const PeticionHttp *peticion) {
+    const VistaCadena *lista = buscar_encabezado(peticion, "If-None-Match");
+    if (lista) {
+        return coincide_etag(*lista, variante->etag);
+    }
+    const VistaCadena *desde = buscar_encabezado(peticion, "If-Modified-Since");
+    time_t instante;
+    return desde && leer_fecha_http(*desde, &instante) && pagina->info.st_mtime <= instante;
+}
+
+// Líneas Connection que cierran el encabezado precalculado de una página.
+static const char linea_mantener[] = "Connection: keep-alive\r\n\r\n";
+static const char linea_cerrar[] = "Connection: close\r\n\r\n";
+
+// Usa como encabezado los 'tam' bytes ya formateados en resp->encabezado.
+static void usar_encabezado_generado(Respuesta *resp, size_t tam) {
+    resp->partes[0].iov_base = resp->encabezado;
+    resp->partes[0].iov_len = tam;
+    resp->num_partes = 1;
+    resp->tam_encabezado = tam;
+}
+
+// Cuerpos generados (/metrics, partes de un multipart) del hilo. Todos los motores preparan, envían y liberan
+// cada respuesta en el mismo hilo, así que la losa no necesita sincronización.
+static __thread Losa losa_cuerpos;
+static __thread int losa_cuerpos_iniciada = 0;
+
+static char *tomar_cuerpo_generado(void) {
+    if (!losa_cuerpos_iniciada) {
+        iniciar_losa(&losa_cuerpos, TAMANO_CUERPO_GENERADO, 4);
+        losa_cuerpos_iniciada = 1;
+    }
+    return tomar_de_losa(&losa_cuerpos);
+}
+
+// Prepara la respuesta de /metrics con el informe en formato de texto de Prometheus.
+static void responder_metricas(Respuesta *resp, const char *valor_conexion) {
+    resp->cuerpo_generado = tomar_cuerpo_generado();
+    resp->tam_cuerpo = resp->cuerpo_generado ? generar_metricas(resp->cuerpo_generado, TAMANO_CUERPO_GENERADO) : 0;
+    resp->cuerpo = resp->cuerpo_generado;
+    resp->codigo = 200;
+    usar_encabezado_generado(resp, snprintf(resp->encabezado, sizeof(resp->encabezado),
+                                            "HTTP/1.1 200 OK\r\n"
+                                            "Content-Type: text/plain; version=0.0.4\r\n"
+                                            "Content-Length: %zu\r\n"
+                                            "Connection: %s\r\n\r\n",
+                                            resp->tam_cuerpo, valor_conexion));
+}
+
+// Rango de bytes de una representación, con el último byte incluido
+typedef struct {
+    size_t inicio;
+    size_t fin;
+} RangoBytes;
+
+// Lee una posición de un rango; un número que no cabe en size_t se satura.
+// Devuelve 1 si había al menos una cifra.
+static int leer_posicion(const char **p, const char *fin, size_t *numero) {
+    const char *inicio = *p;
+    size_t n = 0;
+    for (; *p < fin && **p >= '0' && **p <= '9'; (*p)++) {
+        n = n > (SIZE_MAX - 9) / 10 ? SIZE_MAX : n * 10 + (**p - '0');
+    }
+    *numero = n;
+    return *p > inicio;
+}
+
+// Interpreta Range ("bytes=a-b, c-, -n") sobre una representación de 'tam' bytes.
+// Devuelve cuántos rangos son satisfacibles (0: ninguno, hay que responder 416), o -1
+// si el encabezado no es válido o pide más de MAX_RANGOS y se ignora (RFC 9110 14.2).
+static int analizar_rangos(VistaCadena valor, size_t tam, RangoBytes *rangos) {
+    const char *p = valor.datos;
+    const char *fin = valor.datos + valor.longitud;
+    if (valor.longitud < 6 || strncasecmp(p, "bytes=", 6) != 0) {
+        return -1;
+    }
+    p += 6;
+    int elementos = 0, num_rangos = 0;
+    while (p < fin) {
+        while (p < fin && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        if (p == fin) {
+            break;
+        }
+        size_t primero, ultimo;
+        int hay_primero = leer_posicion(&p, fin, &primero);
+        if (p == fin || *p != '-') {
+            return -1;
+        }
+        p++;
+        int hay_ultimo = leer_posicion(&p, fin, &ultimo);
+        while (p < fin && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if ((p < fin && *p != ',') || (!hay_primero && !hay_ultimo) ||
+            (hay_primero && hay_ultimo && ultimo < primero) || ++elementos > MAX_RANGOS) {
+            return -1;
+        }
+        if (hay_primero) {
+            if (primero >= tam) {
+                continue; // empieza después del final: no satisfacible
+            }
+            rangos[num_rangos].inicio = primero;
+            rangos[num_rangos].fin = hay_ultimo && ultimo < tam ? ultimo : tam - 1;
+        } else {
+            if (ultimo == 0 || tam == 0) {
+                continue; // sufijo vacío
+            }
+            rangos[num_rangos].inicio = ultimo >= tam ? 0 : tam - ultimo;
+            rangos[num_rangos].fin = tam - 1;
+        }
+        num_rangos++;
+    }
+    return elementos ? num_rangos : -1;
+}
+
+// If-Range (RFC 9110 13.1.5): el rango solo vale si el validador es el de la
+// representación actual. Un ETag débil nunca coincide; una fecha, solo si es exacta.
+static int rango_vigente(const Pagina *pagina, const PeticionHttp *peticion) {
+    const VistaCadena *valor = buscar_encabezado(peticion, "If-Range");
+    if (!valor) {
+        return 1;
+    }
+    if (valor->longitud > 0 && valor->datos[0] == '"') {
+        return valor->longitud == strlen(pagina->identidad.etag) &&
+               memcmp(valor->datos, pagina->identidad.etag, valor->longitud) == 0;
+    }
+    time_t instante;
+    return leer_fecha_http(*valor, &instante) && instante == pagina->info.st_mtime;
+}
+
+// Compone un cuerpo multipart/byteranges en tramos. Las cabeceras de cada parte y el
+// cierre se generan en un cuerpo de la losa del hilo, tras la tabla de tramos; los bytes
+// de cada rango salen de la página en memoria o de su descriptor, como los de un solo
+// rango. Devuelve el tamaño del cuerpo, o 0 si las cabeceras no caben; entonces se
+// responde el archivo entero.
+static size_t generar_multiparte(Respuesta *resp, const Pagina *pagina, const RangoBytes *rangos, int num_rangos,
+                                 const char *separador) {
+    resp->cuerpo_generado = tomar_cuerpo_generado();
+    if (!resp->cuerpo_generado) {
+        return 0;
+    }
+    TramoCuerpo *tramos = (TramoCuerpo *)resp->cuerpo_generado;
+    char *texto = resp->cuerpo_generado + MAX_TRAMOS_CUERPO * sizeof(TramoCuerpo);
+    const char *fin = resp->cuerpo_generado + TAMANO_CUERPO_GENERADO;
+    const VariantePagina *identidad = &pagina->identidad;
+    int num_tramos = 0;
+    size_t tam = 0;
+    for (int i = 0; i <= num_rangos; i++) {
+        size_t libre = fin - texto;
+        int n = i < num_rangos ?
+            snprintf(texto, libre, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                     separador, pagina->tipo, rangos[i].inicio, rangos[i].fin, identidad->tamano) :
+            snprintf(texto, libre, "\r\n--%s--\r\n", separador);
+        if (n < 0 || (size_t)n >= libre) {
+            return 0;
+        }
+        tramos[num_tramos++] = (TramoCuerpo){texto, 0, n};
+        texto += n;
+        tam += n;
+        if (i < num_rangos) {
+            size_t tam_rango = rangos[i].fin - rangos[i].inicio + 1;
+            if (identidad->contenido) {
+                tramos[num_tramos++] = (TramoCuerpo){identidad->contenido + rangos[i].inicio, 0, tam_rango};
+            } else {
+                tramos[num_tramos++] = (TramoCuerpo){NULL, rangos[i].inicio, tam_rango};
+            }
+            tam += tam_rango;
+        }
+    }
+    resp->tramos = tramos;
+    resp->num_tramos = num_tramos;
+    if (!identidad->contenido) {
+        resp->archivo_fd = pagina->fd;
+    }
+    return tam;
+}
+
+// Prepara un 206 (o un 416) si un GET trae Range aplicable a la identidad de la página.
+// Un solo rango se envía sin copiarlo: desde la página en memoria o con sendfile() a
+// partir de su desplazamiento. Varios rangos van en un cuerpo multipart/byteranges por
+// tramos, también sin copiar los datos. Devuelve 0 si hay que responder con la
+// representación entera.
+static int responder_rango(Respuesta *resp, Pagina *pagina, const PeticionHttp *peticion,
+                           const char *linea_conexion, size_t tam_linea_conexion) {
+    const VistaCadena *valor = buscar_encabezado(peticion, "Range");
+    if (!valor || !rango_vigente(pagina, peticion)) {
+        return 0;
+    }
+    VariantePagina *identidad = &pagina->identidad;
+    RangoBytes rangos[MAX_RANGOS];
+    int num_rangos = analizar_rangos(*valor, identidad->tamano, rangos);
+    if (num_rangos < 0) {
+        return 0;
+    }
+
+    size_t tam_inicio;
+    resp->cuerpo = NULL;
+    if (num_rangos == 0) {
+        resp->codigo = 416;
+        resp->tam_cuerpo = 0;
+        tam_inicio = snprintf(resp->encabezado, sizeof(resp->encabezado),
+                              "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                              "Content-Range: bytes */%zu\r\n"
+                              "Content-Length: 0\r\n",
+                              identidad->tamano);
+        resp->partes[0].iov_base = resp->encabezado;
+        resp->partes[0].iov_len = tam_inicio;
+        resp->partes[1].iov_base = (void *)linea_conexion;
+        resp->partes[1].iov_len = tam_linea_conexion;
+        resp->num_partes = 2;
+        return 1;
+    }
+    if (num_rangos == 1) {
+        resp->tam_cuerpo = rangos[0].fin - rangos[0].inicio + 1;
+        if (identidad->contenido) {
+            resp->cuerpo = identidad->contenido + rangos[0].inicio;
+        } else {
+            resp->archivo_fd = pagina->fd;
+            resp->desplazamiento = rangos[0].inicio;
+        }
+        tam_inicio = snprintf(resp->encabezado, sizeof(resp->encabezado),
+                              "HTTP/1.1 206 Partial Content\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %zu\r\n"
+                              "Content-Range: bytes %zu-%zu/%zu\r\n",
+                              pagina->tipo, resp->tam_cuerpo, rangos[0].inicio, rangos[0].fin, identidad->tamano);
+    } else {
+        char separador[24];
+        snprintf(separador, sizeof(separador), "%016llx", (unsigned long long)tiempo_monotonico_ns());
+        resp->tam_cuerpo = generar_multiparte(resp, pagina, rangos, num_rangos, separador);
+        if (resp->tam_cuerpo == 0) {
+            if (resp->cuerpo_generado) {
+                devolver_a_losa(&losa_cuerpos, resp->cuerpo_generado);
+                resp->cuerpo_generado = NULL;
+            }
+            return 0;
+        }
+        tam_inicio = snprintf(resp->encabezado, sizeof(resp->encabezado),
+                              "HTTP/1.1 206 Partial Content\r\n"
+                              "Content-Type: multipart/byteranges; boundary=%s\r\n"
+                              "Content-Length: %zu\r\n",
+                              separador, resp->tam_cuerpo);
+    }
+    // Tras la línea de estado y los campos del rango van los validadores de la identidad.
+    resp->codigo = 206;
+    resp->partes[0].iov_base = resp->encabezado;
+    resp->partes[0].iov_len = tam_inicio;
+    resp->partes[1].iov_base = identidad->encabezado + identidad->inicio_validadores;
+    resp->partes[1].iov_len = identidad->tam_encabezado - identidad->inicio_validadores;
+    resp->partes[2].iov_base = (void *)linea_conexion;
+    resp->partes[2].iov_len = tam_linea_conexion;
+    resp->num_partes = 3;
+    contar_metrica(METRICA_RESPUESTAS_PARCIALES, 1);
+    return 1;
+}
+
+// Una respuesta a HEAD lleva el encabezado de la de GET, Content-Length incluido, pero
+// ningún byte del cuerpo. El cuerpo generado, si lo hay, se sigue liberando con la respuesta.
+static void quitar_cuerpo(Respuesta *resp) {
+    resp->cuerpo = NULL;
+    resp->tam_cuerpo = 0;
+    resp->archivo_fd = -1;
+    resp->tramos = NULL;
+}
+
+// Interpreta una petición completa y prepara la respuesta (encabezado + cuerpo).
+// Lo usan los tres motores: el pool de hilos (envío bloqueante), los reactores epoll y
+// los anillos io_uring. Solo se sirven GET y HEAD; otro método recibe un 501.
+// Si 'permitir_mantener' es 0 la respuesta cierra la conexión aunque el cliente pida keep-alive.
+void procesar_peticion(BufferPaginas *buffer, const PeticionHttp *peticion, const char *ip, int puerto,
+                       int permitir_mantener, Respuesta *resp) {
+    VistaCadena metodo = peticion->metodo;
+    int es_get = metodo.longitud == 3 && memcmp(metodo.datos, "GET", 3) == 0;
+    int es_head = metodo.longitud == 4 && memcmp(metodo.datos, "HEAD", 4) == 0;
+    if (!es_get && !es_head) {
+        responder_peticion_invalida(resp, 501);
+        return;
+    }
+
+    uint64_t inicio_ns = tiempo_monotonico_ns();
+    contar_metrica(METRICA_PETICIONES, 1);
+
+    // La caché y el registro esperan la ruta terminada en '\0'; es lo único que se copia.
+    char ruta[256] = "";
+    if (peticion->ruta.longitud < sizeof(ruta)) {
+        memcpy(ruta, peticion->ruta.datos, peticion->ruta.longitud);
+        ruta[peticion->ruta.longitud] = '\0';
+    }
+
+    // HTTP/1.1 mantiene la conexión por defecto; HTTP/1.0 solo si el cliente lo pide.
+    int mantener = peticion->version_menor >= 1;
+    const VistaCadena *conexion = buscar_encabezado(peticion, "Connection");
+    if (conexion) {
+        if (contiene_token(*conexion, "close")) {
+            mantener = 0;
+        } else if (contiene_token(*conexion, "keep-alive")) {
+            mantener = 1;
+        }
+    }
+    resp->mantener_conexion = mantener && permitir_mantener;
+    const char *valor_conexion = resp->mantener_conexion ? "keep-alive" : "close";
+
+    DIAG_DEPURACION("[HTTP %p] Petición para '%s' recibida desde %s:%d\n", (void*)pthread_self(), ruta, ip, puerto);
+
+    resp->pagina = NULL;
+    resp->cuerpo_generado = NULL;
+    resp->archivo_fd = -1;
+    resp->desplazamiento = 0;
+    resp->tramos = NULL;
+    const char *extension = strrchr(ruta, '.');
+    uint64_t parseo_ns = tiempo_monotonico_ns();
+    registrar_latencia(FASE_PARSEO, parseo_ns - inicio_ns);
+
+    if (strcmp(ruta, "/metrics") == 0) {
+        responder_metricas(resp, valor_conexion);
+        if (es_head) {
+            quitar_cuerpo(resp);
+        }
+        return;
+    }
+
+    // La respuesta retiene la página hasta terminar de enviarla, aunque la caché la expulse antes.
+    Pagina *pagina = ruta[0] ? obtener_pagina(buffer, ruta) : NULL;
+    registrar_latencia(FASE_BUSQUEDA, tiempo_monotonico_ns() - parseo_ns);
+
+    if (pagina) {
+        // El encabezado se formateó al cargar la página; solo se le añade la línea Connection.
+        // Si el cliente acepta una variante precomprimida se envía esa en lugar de la identidad.
+        VariantePagina *variante = elegir_variante(pagina, peticion);
+        const char *linea_conexion = resp->mantener_conexion ? linea_mantener : linea_cerrar;
+        size_t tam_linea_conexion = resp->mantener_conexion ? sizeof(linea_mantener) - 1 : sizeof(linea_cerrar) - 1;
+        resp->pagina = pagina;
+        if (no_modificada(pagina, variante, peticion)) {
+            // Un 304 repite los validadores del encabezado precalculado, sin cuerpo.
+            static const char linea_304[] = "HTTP/1.1 304 Not Modified\r\n";
+            resp->codigo = 304;
+            resp->partes[0].iov_base = (void *)linea_304;
+            resp->partes[0].iov_len = sizeof(linea_304) - 1;
+            resp->partes[1].iov_base = variante->encabezado + variante->inicio_validadores;
+            resp->partes[1].iov_len = variante->tam_encabezado - variante->inicio_validadores;
+            resp->partes[2].iov_base = (void *)linea_conexion;
+            resp->partes[2].iov_len = tam_linea_conexion;
+            resp->num_partes = 3;
+            resp->cuerpo = NULL;
+            resp->tam_cuerpo = 0;
+            contar_metrica(METRICA_RESPUESTAS_304, 1);
+        } else if (es_get && responder_rango(resp, pagina, peticion, linea_conexion, tam_linea_conexion)) {
+            DIAG_DEPURACION("[HTTP %p] Rango de '%s' preparado. Estado %d.\n", (void*)pthread_self(), ruta, resp->codigo);
+        } else {
+            resp->codigo = 200;
+            resp->partes[0].iov_base = variante->encabezado;
+            resp->partes[0].iov_len = variante->tam_encabezado;
+            resp->partes[1].iov_base = (void *)linea_conexion;
+            resp->partes[1].iov_len = tam_linea_conexion;
+            resp->num_partes = 2;
+            resp->cuerpo = variante->contenido;
+            resp->archivo_fd = variante == &pagina->identidad ? pagina->fd : -1;
+            resp->tam_cuerpo = variante->tamano;
+            if (variante != &pagina->identidad) {
+                contar_metrica(METRICA_RESPUESTAS_COMPRIMIDAS, 1);
+            }
+        }
+        resp->tam_encabezado = 0;
+        for (int i = 0; i < resp->num_partes; i++) {
+            resp->tam_encabezado += resp->partes[i].iov_len;
+        }
+        DIAG_DEPURACION("[HTTP %p] Recurso '%s' preparado. Estado %d.\n", (void*)pthread_self(), ruta, resp->codigo);
+
+        //  registrar solo páginas
+        if (extension && (strcmp(extension, ".html") == 0)) {
+            registrar_conexion(ip, puerto, ruta);
+        }
+    } else {
+        DIAG_DEPURACION("[HTTP %p] Recurso '%s' NO encontrado. Sirviendo error 404.\n", (void*)pthread_self(), ruta);
+        contar_metrica(METRICA_RESPUESTAS_404, 1);
+        static const char cuerpo_404[] = "<h1>404 Not Found</h1>";
+        resp->codigo = 404;
+        usar_encabezado_generado(resp, snprintf(resp->encabezado, sizeof(resp->encabezado),
+                                                "HTTP/1.1 404 Not Found\r\n"
+                                                "Content-Type: text/html\r\n"
+                                                "Content-Length: %zu\r\n"
+                                                "Connection: %s\r\n\r\n",
+                                                sizeof(cuerpo_404) - 1, valor_conexion));
+        resp->cuerpo = cuerpo_404;
+        resp->tam_cuerpo = sizeof(cuerpo_404) - 1;
+    }
+    if (es_head) {
+        quitar_cuerpo(resp);
+    }
+}
+
+// Respuestas de error del analizador y del límite de peticiones por IP, precalculadas.
+// Todas cierran la conexión: tras una petición rechazada no se sabe dónde empieza la
+// siguiente, y a un cliente que se pasa de ritmo no se le guarda la conexión.
+#define RESPUESTA_ERROR_CON(codigo, texto, encabezados) \
+    {codigo, "HTTP/1.1 " #codigo " " texto "\r\n" \
+             "Content-Type: text/html\r\n" \
+             encabezados \
+             "Content-Length: " , "<h1>" #codigo " " texto "</h1>"}
+#define RESPUESTA_ERROR(codigo, texto) RESPUESTA_ERROR_CON(codigo, texto, "")
+
+static const struct {
+    int codigo;
+    const char *inicio;
+    const char *cuerpo;
+} respuestas_error[] = {
+    RESPUESTA_ERROR(400, "Bad Request"),
+    RESPUESTA_ERROR(413, "Content Too Large"),
+    RESPUESTA_ERROR(414, "URI Too Long"),
+    RESPUESTA_ERROR_CON(429, "Too Many Requests", "Retry-After: 1\r\n"),
+    RESPUESTA_ERROR(431, "Request Header Fields Too Large"),
+    RESPUESTA_ERROR(501, "Not Implemented"),
+    RESPUESTA_ERROR(505, "HTTP Version Not Supported"),
+};
+
+// Respuesta a una conexión rechazada nada más aceptarla (cola llena o límite por IP): se
+// envía de una vez, sin esperar a que el cliente pueda recibirla, y se cierra.
+const char respuesta_503[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: text/html\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n\r\n"
+    "<h1>503 Service Unavailable</h1>";
+
+// Prepara la respuesta de error 'codigo' para una petición que el analizador rechazó,
+// con un método que no se sirve o que superó el ritmo de su IP (400 si el código no es
+// uno de los previstos); la conexión se cierra.
+void responder_peticion_invalida(Respuesta *resp, int codigo) {
+    contar_metrica(METRICA_PETICIONES, 1);
+    size_t i = 0;
+    for (size_t j = 0; j < sizeof(respuestas_error) / sizeof(respuestas_error[0]); j++) {
+        if (respuestas_error[j].codigo == codigo) {
+            i = j;
+        }
+    }
+    resp->codigo = respuestas_error[i].codigo;
+    resp->mantener_conexion = 0;
+    resp->cuerpo = respuestas_error[i].cuerpo;
+    resp->tam_cuerpo = strlen(resp->cuerpo);
+    usar_encabezado_generado(resp, snprintf(resp->encabezado, sizeof(resp->encabezado),
+                                            "%s%zu\r\nConnection: close\r\n\r\n",
+                                            respuestas_error[i].inicio, resp->tam_cuerpo));
+    resp->pagina = NULL;
+    resp->cuerpo_generado = NULL;
+    resp->archivo_fd = -1;
+    resp->tramos = NULL;
+}
+
+// Tramo 'i' del cuerpo; un cuerpo simple es un solo tramo, en memoria o en el archivo.
+static TramoCuerpo tramo_cuerpo(const Respuesta *resp, int i) {
+    if (resp->tramos) {
+        return resp->tramos[i];
+    }
+    return (TramoCuerpo){resp->archivo_fd < 0 ? resp->cuerpo : NULL, resp->desplazamiento, resp->tam_cuerpo};
+}
+
+static int num_tramos_cuerpo(const Respuesta *resp) {
+    return resp->tramos ? resp->num_tramos : 1;
+}
+
+// Prepara en 'iov' lo que queda por enviar a partir de 'enviados': el resto de las partes
+// del encabezado y los tramos del cuerpo en memoria que siguen, hasta el primero que
+// sale del archivo. Devuelve cuántos iovec usa, como mucho MAX_IOV_RESPUESTA.
+int partes_pendientes(const Respuesta *resp, size_t enviados, struct iovec *iov) {
+    int num_iov = 0;
+    size_t desde = enviados;
+    for (int i = 0; i < resp->num_partes; i++) {
+        if (desde < resp->partes[i].iov_len) {
+            iov[num_iov].iov_base = (char *)resp->partes[i].iov_base + desde;
+            iov[num_iov].iov_len = resp->partes[i].iov_len - desde;
+            num_iov++;
+            desde = 0;
+        } else {
+            desde -= resp->partes[i].iov_len;
+        }
+    }
+    for (int i = 0; i < num_tramos_cuerpo(resp) && num_iov < MAX_IOV_RESPUESTA; i++) {
+        TramoCuerpo tramo = tramo_cuerpo(resp, i);
+        if (desde >= tramo.tam) {
+            desde -= tramo.tam;
+            continue;
+        }
+        if (!tramo.datos) {
+            break;
+        }
+        iov[num_iov].iov_base = (char *)tramo.datos + desde;
+        iov[num_iov].iov_len = tramo.tam - desde;
+        num_iov++;
+        desde = 0;
+    }
+    return num_iov;
+}
+
+// Si lo que toca enviar a partir de 'enviados' sale del archivo, devuelve 1 con la
+// posición en el archivo y los bytes que quedan de ese tramo; si no, 0.
+int tramo_de_archivo(const Respuesta *resp, size_t enviados, off_t *posicion, size_t *tam) {
+    if (resp->archivo_fd < 0 || enviados < resp->tam_encabezado) {
+        return 0;
+    }
+    size_t desde = enviados - resp->tam_encabezado;
+    for (int i = 0; i < num_tramos_cuerpo(resp); i++) {
+        TramoCuerpo tramo = tramo_cuerpo(resp, i);
+        if (desde < tramo.tam) {
+            if (tramo.datos) {
+                return 0;
+            }
+            *posicion = tramo.desplazamiento + desde;
+            *tam = tramo.tam - desde;
+            return 1;
+        }
+        desde -= tramo.tam;
+    }
+    return 0;
+}
+
+// Envía lo que quede de la respuesta a partir de '*enviados'. Las partes del encabezado
+// y el cuerpo en memoria salen juntos en un solo sendmsg(); lo que está en el archivo se
+// envía con sendfile() tras un sendmsg() marcado con MSG_MORE, para que ambos viajen en
+// el mismo segmento. Sirve para sockets bloqueantes y no bloqueantes: devuelve 1 si terminó,
+// 0 si el socket no admite más datos por ahora y -1 si hubo un error.
+int enviar_respuesta(int cliente_fd, Respuesta *resp, size_t *enviados) {
+    size_t total = resp->tam_encabezado + resp->tam_cuerpo;
+
+    while (*enviados < total) {
+        ssize_t n;
+        off_t posicion;
+        size_t tam;
+        if (tramo_de_archivo(resp, *enviados, &posicion, &tam)) {
+            n = sendfile(cliente_fd, resp->archivo_fd, &posicion, tam);
+        } else {
+            struct iovec iov[MAX_IOV_RESPUESTA];
+            struct msghdr mensaje = {0};
+            mensaje.msg_iov = iov;
+            mensaje.msg_iovlen = partes_pendientes(resp, *enviados, iov);
+            size_t tam_mensaje = 0;
+            for (size_t i = 0; i < mensaje.msg_iovlen; i++) {
+                tam_mensaje += iov[i].iov_len;
+            }
+            n = sendmsg(cliente_fd, &mensaje, MSG_NOSIGNAL | (*enviados + tam_mensaje < total ? MSG_MORE : 0));
+        }
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1; // el archivo se acortó mientras se enviaba
+        }
+        *enviados += n;
+        contar_metrica(METRICA_BYTES_ENVIADOS, n);
+    }
+    return 1;
+}
+
+// Suelta lo que la respuesta haya retenido para esta petición.
+void liberar_respuesta(Respuesta *resp) {
+    if (resp->pagina) {
+        soltar_pagina(resp->pagina);
+        resp->pagina = NULL;
+    }
+    if (resp->cuerpo_generado) {
+        devolver_a_losa(&losa_cuerpos, resp->cuerpo_generado);
+        resp->cuerpo_generado = NULL;
+    }
+}
@@ -0,0 +1,239 @@
+#include "servidor_web.h"
+
+// Límites por IP de cliente (SERVIDOR_CONEXIONES_POR_IP, SERVIDOR_PETICIONES_POR_IP).
+// Cada IP tiene una entrada en una tabla de tamaño fijo con sus conexiones abiertas y un
+// cubo de fichas que se rellena al consultarlo, según el tiempo pasado desde la última
+// vez: comprobar un límite es un hash, un cerrojo y unas cuentas, sin temporizadores.
+// La tabla es asociativa por conjuntos: una IP solo puede ocupar las VIAS_TABLA_CLIENTES
+// entradas de su conjunto, y cada conjunto lo protege uno de FRANJAS_TABLA_CLIENTES
+// cerrojos. Si todas las entradas del conjunto tienen conexiones abiertas, la IP nueva
+// se admite sin límites: rociar direcciones no hace crecer la memoria ni echa de la
+// tabla a los clientes que ya están conectados.
+// En el modo de procesos la tabla vive en memoria compartida y los límites son del
+// servidor entero, no de cada trabajador. Sus cerrojos son robustos: si un trabajador
+// muere con uno tomado, el siguiente que lo pide lo recupera. Cada trabajador lleva
+// además la cuenta de las conexiones que abrió por entrada, para que el maestro las
+// descuente si muere sin cerrarlas.
+
+#define CONJUNTOS_TABLA_CLIENTES (TAMANO_TABLA_CLIENTES / VIAS_TABLA_CLIENTES)
+
+typedef struct {
+    uint32_t ip;          // en orden de red; 0 si la entrada está libre
+    int conexiones;       // conexiones abiertas desde esta IP
+    double fichas;        // peticiones que puede hacer ya, hasta 'rafaga'
+    uint64_t repuesto_ns; // última vez que se rellenó el cubo
+} ClienteLimitado;
+
+// Cada cerrojo en su línea de caché para que los hilos no se estorben al tomar franjas distintas
+typedef struct {
+    _Alignas(64) pthread_mutex_t cerrojo;
+} FranjaClientes;
+
+typedef struct {
+    FranjaClientes franjas[FRANJAS_TABLA_CLIENTES];
+    ClienteLimitado clientes[TAMANO_TABLA_CLIENTES];
+} TablaClientes;
+
+static TablaClientes tabla_propia;
+static TablaClientes *tabla = &tabla_propia; // en el modo de procesos, la compartida
+static int *conexiones_trabajadores; // [trabajador][entrada], compartida; NULL con un solo proceso
+static uint32_t semilla;             // para que no se pueda elegir qué IPs caen en un conjunto
+static int limitar;                  // hay algún límite configurado
+static int conexiones_por_ip;
+static double fichas_por_ns;         // 0 si no se limitan las peticiones
+static double rafaga;
+
+// Prepara la tabla. En el modo de procesos la llama el maestro antes de lanzar a los
+// trabajadores, que la heredan con la misma semilla.
+void iniciar_limites_cliente(const ConfigServidor *config) {
+    limitar = config->conexiones_por_ip > 0 || config->peticiones_por_ip > 0;
+    conexiones_por_ip = config->conexiones_por_ip;
+    fichas_por_ns = config->peticiones_por_ip / 1e9;
+    rafaga = config->rafaga_por_ip;
+    semilla = (uint32_t)(tiempo_monotonico_ns() ^ ((uint64_t)getpid() << 16));
+    if (!limitar) {
+        return;
+    }
+
+    pthread_mutexattr_t atributos;
+    pthread_mutexattr_init(&atributos);
+    if (config->procesos > 0) {
+        TablaClientes *compartida = reservar_compartido(sizeof(TablaClientes));
+        int *cuentas = reservar_compartido((size_t)config->procesos * TAMANO_TABLA_CLIENTES * sizeof(int));
+        if (compartida && cuentas) {
+            tabla = compartida;
+            conexiones_trabajadores = cuentas;
+            pthread_mutexattr_setpshared(&atributos, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&atributos, PTHREAD_MUTEX_ROBUST);
+        } else {
+            DIAG_AVISO("[LIMITES] Sin memoria compartida; los límites por IP serán de cada trabajador.\n");
+        }
+    }
+    for (int i = 0; i < FRANJAS_TABLA_CLIENTES; i++) {
+        pthread_mutex_init(&tabla->franjas[i].cerrojo, &atributos);
+    }
+    pthread_mutexattr_destroy(&atributos);
+}
+
+// Conexiones abiertas por este trabajador en cada entrada, o NULL fuera del modo de procesos.
+static int *conexiones_propias(void) {
+    int trabajador = numero_trabajador();
+    return conexiones_trabajadores && trabajador >= 0 ?
+           conexiones_trabajadores + (size_t)trabajador * TAMANO_TABLA_CLIENTES : NULL;
+}
+
+// Toma el cerrojo de una franja. Si quien lo tenía era un trabajador que murió, la
+// entrada que tocaba puede quedar con una cuenta a medias, pero sigue siendo usable.
+static void tomar_franja(FranjaClientes *franja) {
+    if (pthread_mutex_lock(&franja->cerrojo) == EOWNERDEAD) {
+        pthread_mutex_consistent(&franja->cerrojo);
+    }
+}
+
+// Conjunto de la tabla que corresponde a una IP (hash multiplicativo de Fibonacci).
+static size_t conjunto_de(uint32_t ip) {
+    return (uint32_t)((ip ^ semilla) * 2654435769u) >> (32 - __builtin_ctz(CONJUNTOS_TABLA_CLIENTES));
+}
+
+static FranjaClientes *franja_de(size_t conjunto) {
+    return &tabla->franjas[conjunto % FRANJAS_TABLA_CLIENTES];
+}
+
+// Añade al cubo las fichas ganadas desde el último relleno, sin pasar de la ráfaga.
+static void rellenar(ClienteLimitado *cliente, uint64_t ahora) {
+    if (ahora > cliente->repuesto_ns) {
+        cliente->fichas += (ahora - cliente->repuesto_ns) * fichas_por_ns;
+        if (cliente->fichas > rafaga) {
+            cliente->fichas = rafaga;
+        }
+        cliente->repuesto_ns = ahora;
+    }
+}
+
+// Busca la entrada de 'ip' en su conjunto o le asigna una: libre, o si no la que lleva
+// más tiempo sin usarse entre las que no tienen conexiones (su cubo es el que más se ha
+// rellenado, así que es la que menos se pierde al reciclarla). Devuelve -1 si todas
+// tienen conexiones abiertas. Se llama con el cerrojo de la franja tomado.
+static int buscar_entrada(size_t conjunto, uint32_t ip, uint64_t ahora) {
+    int inicio = (int)(conjunto * VIAS_TABLA_CLIENTES);
+    int libre = -1;
+    int reciclable = -1;
+    for (int i = inicio; i < inicio + VIAS_TABLA_CLIENTES; i++) {
+        ClienteLimitado *cliente = &tabla->clientes[i];
+        if (cliente->ip == ip) {
+            return i;
+        }
+        if (cliente->ip == 0) {
+            if (libre < 0) {
+                libre = i;
+            }
+        } else if (cliente->conexiones == 0 &&
+                   (reciclable < 0 || cliente->repuesto_ns < tabla->clientes[reciclable].repuesto_ns)) {
+            reciclable = i;
+        }
+    }
+    int elegida = libre >= 0 ? libre : reciclable;
+    if (elegida >= 0) {
+        tabla->clientes[elegida].ip = ip;
+        tabla->clientes[elegida].conexiones = 0;
+        tabla->clientes[elegida].fichas = rafaga;
+        tabla->clientes[elegida].repuesto_ns = ahora;
+    }
+    return elegida;
+}
+
+// Registra una conexión aceptada de 'ip' (en orden de red). Devuelve su entrada en la
+// tabla, que se pasa después a admitir_peticion() y soltar_conexion(); CLIENTE_SIN_ENTRADA
+// si se admite sin límites, o CLIENTE_RECHAZADO si la IP ya tiene todas las conexiones
+// que se le permiten o ha agotado su cubo de peticiones.
+int admitir_conexion(uint32_t ip) {
+    if (!limitar) {
+        return CLIENTE_SIN_ENTRADA;
+    }
+    uint64_t ahora = tiempo_monotonico_ns();
+    size_t conjunto = conjunto_de(ip);
+    FranjaClientes *franja = franja_de(conjunto);
+    tomar_franja(franja);
+    int entrada = buscar_entrada(conjunto, ip, ahora);
+    int rechazada = 0;
+    if (entrada >= 0) {
+        ClienteLimitado *cliente = &tabla->clientes[entrada];
+        rellenar(cliente, ahora);
+        rechazada = (conexiones_por_ip > 0 && cliente->conexiones >= conexiones_por_ip) ||
+                    (fichas_por_ns > 0 && cliente->fichas < 1);
+        if (!rechazada) {
+            cliente->conexiones++;
+            int *propias = conexiones_propias();
+            if (propias) {
+                propias[entrada]++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&franja->cerrojo);
+
+    if (entrada < 0) {
+        contar_metrica(METRICA_CLIENTES_SIN_ENTRADA, 1);
+        return CLIENTE_SIN_ENTRADA;
+    }
+    if (rechazada) {
+        contar_metrica(METRICA_RECHAZOS_CONEXION_IP, 1);
+        return CLIENTE_RECHAZADO;
+    }
+    return entrada;
+}
+
+// Descuenta una conexión cerrada de su entrada. No hace nada sin entrada.
+void soltar_conexion(int entrada) {
+    if (entrada < 0) {
+        return;
+    }
+    FranjaClientes *franja = franja_de(entrada / VIAS_TABLA_CLIENTES);
+    tomar_franja(franja);
+    tabla->clientes[entrada].conexiones--;
+    int *propias = conexiones_propias();
+    if (propias) {
+        propias[entrada]--;
+    }
+    pthread_mutex_unlock(&franja->cerrojo);
+}
+
+// En el maestro, cuando termina el trabajador 'trabajador': descuenta de la tabla las
+// conexiones que dejó abiertas, que ya nadie va a soltar.
+void olvidar_conexiones_trabajador(int trabajador) {
+    if (!conexiones_trabajadores) {
+        return;
+    }
+    int *propias = conexiones_trabajadores + (size_t)trabajador * TAMANO_TABLA_CLIENTES;
+    for (int entrada = 0; entrada < TAMANO_TABLA_CLIENTES; entrada++) {
+        if (propias[entrada] == 0) {
+            continue;
+        }
+        FranjaClientes *franja = franja_de(entrada / VIAS_TABLA_CLIENTES);
+        tomar_franja(franja);
+        tabla->clientes[entrada].conexiones -= propias[entrada];
+        propias[entrada] = 0;
+        pthread_mutex_unlock(&franja->cerrojo);
+    }
+}
+
+// Gasta una ficha del cubo de la conexión. Devuelve 1 si la petición se puede atender
+// y 0 si el cliente superó su ritmo.
+int admitir_peticion(int entrada) {
+    if (entrada < 0 || fichas_por_ns == 0) {
+        return 1;
+    }
+    FranjaClientes *franja = franja_de(entrada / VIAS_TABLA_CLIENTES);
+    tomar_franja(franja);
+    ClienteLimitado *cliente = &tabla->clientes[entrada];
+    rellenar(cliente, tiempo_monotonico_ns());
+    int admitida = cliente->fichas >= 1;
+    if (admitida) {
+        cliente->fichas -= 1;
+    }
+    pthread_mutex_unlock(&franja->cerrojo);
+
+    if (!admitida) {
+        contar_metrica(METRICA_RECHAZOS_PETICION_IP, 1);
+    }
+    return admitida;
+}
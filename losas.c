@@ -0,0 +1,60 @@
+#include "servidor_web.h"
+
+// Losas: reservas de objetos de tamaño fijo para el camino de servicio (conexiones,
+// peticiones en curso, cuerpos generados). Una losa no es segura entre hilos: la usa
+// solo su hilo dueño, o quien tenga el mutex que la protege. Crece por tramos de
+// varios objetos que no se devuelven a malloc, así que en régimen estable tomar y
+// devolver un objeto es sacarlo y meterlo en una lista libre, sin memoria dinámica.
+
+#define CABECERA_TRAMO 64 // enlace al tramo anterior, relleno hasta una línea de caché
+
+typedef struct NodoLibre {
+    struct NodoLibre *siguiente;
+} NodoLibre;
+
+// Prepara una losa vacía; los objetos se redondean a líneas de caché completas.
+void iniciar_losa(Losa *losa, size_t tam_objeto, size_t objetos_por_tramo) {
+    losa->tam_objeto = (tam_objeto + 63) & ~(size_t)63;
+    losa->objetos_por_tramo = objetos_por_tramo;
+    losa->libres = NULL;
+    losa->tramos = NULL;
+    losa->en_uso = 0;
+    losa->capacidad = 0;
+}
+
+// Añade un tramo de objetos libres. Es la única reserva de memoria dinámica de la losa.
+static int crecer_losa(Losa *losa) {
+    char *tramo = aligned_alloc(64, CABECERA_TRAMO + losa->tam_objeto * losa->objetos_por_tramo);
+    if (!tramo) {
+        return -1;
+    }
+    contar_metrica(METRICA_RESERVAS_MONTICULO, 1);
+    *(void **)tramo = losa->tramos;
+    losa->tramos = tramo;
+    for (size_t i = losa->objetos_por_tramo; i-- > 0;) {
+        NodoLibre *nodo = (NodoLibre *)(tramo + CABECERA_TRAMO + i * losa->tam_objeto);
+        nodo->siguiente = losa->libres;
+        losa->libres = nodo;
+    }
+    losa->capacidad += losa->objetos_por_tramo;
+    return 0;
+}
+
+// Devuelve un objeto sin inicializar, o NULL si no hay memoria.
+void *tomar_de_losa(Losa *losa) {
+    if (!losa->libres && crecer_losa(losa) != 0) {
+        return NULL;
+    }
+    NodoLibre *nodo = losa->libres;
+    losa->libres = nodo->siguiente;
+    losa->en_uso++;
+    contar_metrica(METRICA_RESERVAS_LOSA, 1);
+    return nodo;
+}
+
+void devolver_a_losa(Losa *losa, void *objeto) {
+    NodoLibre *nodo = objeto;
+    nodo->siguiente = losa->libres;
+    losa->libres = nodo;
+    losa->en_uso--;
+}
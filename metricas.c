@@ -0,0 +1,249 @@
+#include "servidor_web.h"
+
+// Métricas del servidor. Cada hilo escribe en su propio bloque de contadores e
+// histogramas (alineado a línea de caché, sin compartir escrituras con otros hilos);
+// la URL /metrics los suma todos en el momento de la consulta.
+
+static MetricasHilo *bloques[MAX_HILOS_METRICAS];
+static _Atomic int num_bloques = 0;
+static pthread_mutex_t mutex_bloques = PTHREAD_MUTEX_INITIALIZER;
+static __thread MetricasHilo *metricas_hilo = NULL;
+
+// Bloque para los hilos que no consiguen uno propio; al ser compartido se actualiza
+// con operaciones atómicas completas.
+static MetricasHilo metricas_compartidas;
+
+// Profundidad de la cola del pool de hilos; NULL con los otros motores.
+static _Atomic int *profundidad_cola = NULL;
+
+static const char *nombres_fase[NUM_FASES] = {"parseo", "busqueda", "envio", "cola"};
+
+// Suma de todos los bloques en el momento de la consulta
+typedef struct {
+    uint64_t contadores[NUM_CONTADORES];
+    uint64_t cubetas[NUM_FASES][NUM_CUBETAS_LATENCIA];
+    uint64_t suma_ns[NUM_FASES];
+} TotalMetricas;
+
+// Devuelve el bloque del hilo actual, creándolo la primera vez. Devuelve NULL si se
+// usa el bloque compartido.
+static MetricasHilo *metricas_local(void) {
+    if (metricas_hilo) {
+        return metricas_hilo == &metricas_compartidas ? NULL : metricas_hilo;
+    }
+    MetricasHilo *bloque = aligned_alloc(64, sizeof(MetricasHilo));
+    if (bloque) {
+        memset(bloque, 0, sizeof(MetricasHilo));
+        pthread_mutex_lock(&mutex_bloques);
+        int indice = atomic_load(&num_bloques);
+        if (indice < MAX_HILOS_METRICAS) {
+            bloques[indice] = bloque;
+            atomic_store_explicit(&num_bloques, indice + 1, memory_order_release);
+        } else {
+            free(bloque);
+            bloque = NULL;
+        }
+        pthread_mutex_unlock(&mutex_bloques);
+    }
+    metricas_hilo = bloque ? bloque : &metricas_compartidas;
+    return bloque;
+}
+
+// Suma 'n' a un contador. Con un solo escritor por bloque basta una lectura y una
+// escritura relajadas, sin instrucciones con prefijo lock.
+static inline void sumar(_Atomic uint64_t *contador, uint64_t n, int propio) {
+    if (propio) {
+        atomic_store_explicit(contador, atomic_load_explicit(contador, memory_order_relaxed) + n,
+                              memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(contador, n, memory_order_relaxed);
+    }
+}
+
+// El pool de hilos publica su cola para que /metrics informe de cuántas conexiones
+// aceptadas esperan un hilo, en el anillo o en la lista de espera.
+void publicar_profundidad_cola(_Atomic int *profundidad) {
+    profundidad_cola = profundidad;
+}
+
+void contar_metrica(ContadorMetrica contador, uint64_t n) {
+    MetricasHilo *bloque = metricas_local();
+    sumar(bloque ? &bloque->contadores[contador] : &metricas_compartidas.contadores[contador], n, bloque != NULL);
+}
+
+// Tiempo monotónico en nanosegundos, para medir latencias y esperas en la cola.
+uint64_t tiempo_monotonico_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Índice de cubeta log-lineal (estilo HDR): los valores menores que 16 tienen cubeta
+// propia y cada potencia de 2 posterior se divide en 8 subcubetas, con un error
+// relativo máximo del 12,5 %.
+static int cubeta_latencia(uint64_t ns) {
+    if (ns < 16) {
+        return (int)ns;
+    }
+    int magnitud = 63 - __builtin_clzll(ns);
+    int indice = 16 + (magnitud - 4) * 8 + (int)((ns >> (magnitud - 3)) & 7);
+    return indice < NUM_CUBETAS_LATENCIA ? indice : NUM_CUBETAS_LATENCIA - 1;
+}
+
+// Límite superior (exclusivo) en nanosegundos de una cubeta.
+static uint64_t limite_cubeta(int indice) {
+    if (indice < 16) {
+        return (uint64_t)indice + 1;
+    }
+    int magnitud = 4 + (indice - 16) / 8;
+    uint64_t sub = (indice - 16) % 8;
+    return ((8 + sub + 1) << (magnitud - 3));
+}
+
+void registrar_latencia(FaseLatencia fase, uint64_t ns) {
+    MetricasHilo *bloque = metricas_local();
+    int propio = bloque != NULL;
+    if (!bloque) {
+        bloque = &metricas_compartidas;
+    }
+    sumar(&bloque->cubetas[fase][cubeta_latencia(ns)], 1, propio);
+    sumar(&bloque->suma_ns[fase], ns, propio);
+}
+
+// Suma los bloques de todos los hilos. Las lecturas son relajadas: cada contador es
+// coherente por sí mismo aunque el conjunto no sea una instantánea exacta.
+static void sumar_bloques(TotalMetricas *total) {
+    memset(total, 0, sizeof(*total));
+    int n = atomic_load_explicit(&num_bloques, memory_order_acquire);
+    for (int b = -1; b < n; b++) {
+        MetricasHilo *bloque = b < 0 ? &metricas_compartidas : bloques[b];
+        for (int c = 0; c < NUM_CONTADORES; c++) {
+            total->contadores[c] += atomic_load_explicit(&bloque->contadores[c], memory_order_relaxed);
+        }
+        for (int f = 0; f < NUM_FASES; f++) {
+            total->suma_ns[f] += atomic_load_explicit(&bloque->suma_ns[f], memory_order_relaxed);
+            for (int i = 0; i < NUM_CUBETAS_LATENCIA; i++) {
+                total->cubetas[f][i] += atomic_load_explicit(&bloque->cubetas[f][i], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// Añade texto al informe; si no cabe, el informe queda truncado.
+static void agregar(char *destino, size_t tam, size_t *usado, const char *formato, ...) {
+    if (*usado >= tam) {
+        return;
+    }
+    va_list argumentos;
+    va_start(argumentos, formato);
+    int n = vsnprintf(destino + *usado, tam - *usado, formato, argumentos);
+    va_end(argumentos);
+    if (n > 0) {
+        *usado += (size_t)n;
+        if (*usado > tam) {
+            *usado = tam;
+        }
+    }
+}
+
+// Valor del percentil 'p' (0-1) de un histograma, como límite superior de su cubeta.
+static uint64_t percentil(const uint64_t *cubetas, uint64_t total, double p) {
+    uint64_t objetivo = (uint64_t)(p * total);
+    if (objetivo >= total) {
+        objetivo = total - 1;
+    }
+    uint64_t acumulado = 0;
+    for (int i = 0; i < NUM_CUBETAS_LATENCIA; i++) {
+        acumulado += cubetas[i];
+        if (acumulado > objetivo) {
+            return limite_cubeta(i);
+        }
+    }
+    return limite_cubeta(NUM_CUBETAS_LATENCIA - 1);
+}
+
+// Escribe todas las métricas en formato de texto de Prometheus. Devuelve los bytes escritos.
+size_t generar_metricas(char *destino, size_t tam) {
+    static const struct {
+        const char *nombre;
+        const char *ayuda;
+    } contadores[NUM_CONTADORES] = {
+        {"servidor_peticiones_total", "Peticiones HTTP atendidas."},
+        {"servidor_bytes_enviados_total", "Bytes de respuesta enviados."},
+        {"servidor_cache_aciertos_total", "Búsquedas resueltas desde la caché de páginas."},
+        {"servidor_cache_fallos_total", "Búsquedas que no estaban en la caché de páginas."},
+        {"servidor_cache_expulsiones_total", "Páginas expulsadas de la caché."},
+        {"servidor_respuestas_404_total", "Respuestas 404 Not Found."},
+        {"servidor_respuestas_comprimidas_total", "Respuestas servidas con una variante gzip o brotli."},
+        {"servidor_respuestas_304_total", "Respuestas 304 Not Modified a peticiones condicionales."},
+        {"servidor_respuestas_parciales_total", "Respuestas 206 Partial Content a peticiones con Range."},
+        {"servidor_errores_accept_total", "Errores de accept() distintos de EAGAIN."},
+        {"servidor_reservas_monticulo_total", "Reservas de memoria dinámica al atender: tramos de losa y cargas de archivos en la caché."},
+        {"servidor_reservas_losa_total", "Objetos tomados de las losas de conexiones, peticiones y cuerpos."},
+        {"servidor_rechazos_conexion_ip_total", "Conexiones rechazadas al aceptarlas por superar el límite de su IP."},
+        {"servidor_rechazos_peticion_ip_total", "Peticiones rechazadas por superar el ritmo permitido a su IP."},
+        {"servidor_clientes_sin_entrada_total", "Conexiones admitidas sin límites por tener lleno su conjunto de la tabla de clientes."},
+    };
+    static const double cuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    // La suma se hace en un bloque propio del hilo para no reservar memoria por consulta.
+    static __thread TotalMetricas total_hilo;
+    TotalMetricas *total = &total_hilo;
+    sumar_bloques(total);
+
+    size_t usado = 0;
+    for (int c = 0; c < NUM_CONTADORES; c++) {
+        agregar(destino, tam, &usado, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", contadores[c].nombre,
+                contadores[c].ayuda, contadores[c].nombre, contadores[c].nombre,
+                (unsigned long long)total->contadores[c]);
+    }
+    agregar(destino, tam, &usado, "# HELP servidor_registros_descartados_total Líneas de log descartadas por anillos llenos.\n"
+            "# TYPE servidor_registros_descartados_total counter\nservidor_registros_descartados_total %lu\n",
+            registros_descartados());
+    agregar(destino, tam, &usado, "# HELP servidor_cola_profundidad Conexiones aceptadas esperando un hilo del pool.\n"
+            "# TYPE servidor_cola_profundidad gauge\nservidor_cola_profundidad %d\n",
+            profundidad_cola ? atomic_load_explicit(profundidad_cola, memory_order_relaxed) : 0);
+
+    // El histograma se exporta con límites en potencias de 2 desde ~1 µs hasta ~17 s;
+    // los cuantiles se calculan con la resolución completa.
+    agregar(destino, tam, &usado, "# HELP servidor_latencia_segundos Latencia por fase de la petición.\n"
+            "# TYPE servidor_latencia_segundos histogram\n");
+    for (int f = 0; f < NUM_FASES; f++) {
+        const uint64_t *cubetas = total->cubetas[f];
+        uint64_t acumulado = 0;
+        int i = 0;
+        for (int magnitud = 10; magnitud <= 34; magnitud++) {
+            uint64_t limite = 1ULL << magnitud;
+            while (i < NUM_CUBETAS_LATENCIA && limite_cubeta(i) <= limite) {
+                acumulado += cubetas[i++];
+            }
+            agregar(destino, tam, &usado, "servidor_latencia_segundos_bucket{fase=\"%s\",le=\"%.9g\"} %llu\n",
+                    nombres_fase[f], limite / 1e9, (unsigned long long)acumulado);
+        }
+        while (i < NUM_CUBETAS_LATENCIA) {
+            acumulado += cubetas[i++];
+        }
+        agregar(destino, tam, &usado, "servidor_latencia_segundos_bucket{fase=\"%s\",le=\"+Inf\"} %llu\n",
+                nombres_fase[f], (unsigned long long)acumulado);
+        agregar(destino, tam, &usado, "servidor_latencia_segundos_sum{fase=\"%s\"} %.9f\n",
+                nombres_fase[f], total->suma_ns[f] / 1e9);
+        agregar(destino, tam, &usado, "servidor_latencia_segundos_count{fase=\"%s\"} %llu\n",
+                nombres_fase[f], (unsigned long long)acumulado);
+    }
+
+    agregar(destino, tam, &usado, "# HELP servidor_latencia_cuantil_segundos Cuantiles de latencia por fase.\n"
+            "# TYPE servidor_latencia_cuantil_segundos gauge\n");
+    for (int f = 0; f < NUM_FASES; f++) {
+        uint64_t cuenta = 0;
+        for (int i = 0; i < NUM_CUBETAS_LATENCIA; i++) {
+            cuenta += total->cubetas[f][i];
+        }
+        for (size_t q = 0; q < sizeof(cuantiles) / sizeof(cuantiles[0]); q++) {
+            uint64_t valor = cuenta ? percentil(total->cubetas[f], cuenta, cuantiles[q]) : 0;
+            agregar(destino, tam, &usado, "servidor_latencia_cuantil_segundos{fase=\"%s\",quantile=\"%g\"} %.9g\n",
+                    nombres_fase[f], cuantiles[q], valor / 1e9);
+        }
+    }
+
+    return usado;
+}
@@ -0,0 +1,384 @@
+#include "servidor_web.h"
+
+// Motor de eventos: un reactor por núcleo, cada uno con su propio socket de escucha
+// (SO_REUSEPORT) y su propia instancia epoll en modo edge-triggered. Las conexiones
+// avanzan por una máquina de estados: leer petición -> búsqueda -> escribir respuesta.
+
+#define MAX_EVENTOS 256
+
+// Inicia el estado de una petición en curso. Solo existe mientras hay una petición
+// a medio leer o una respuesta a medio escribir, para que una conexión ociosa
+// ocupe únicamente su estructura Conexion. Ambas salen de las losas del reactor.
+static PeticionEnCurso *obtener_peticion(Reactor *reactor, Conexion *conexion) {
+    if (!conexion->peticion) {
+        conexion->peticion = tomar_de_losa(&reactor->peticiones);
+        if (conexion->peticion) {
+            conexion->peticion->leidos = 0;
+            conexion->peticion->enviados = 0;
+            iniciar_peticion_http(&conexion->peticion->http);
+        }
+    }
+    return conexion->peticion;
+}
+
+// Quita la conexión de la lista por actividad del reactor.
+static void desenlazar_conexion(Reactor *reactor, Conexion *conexion) {
+    if (!conexion->anterior && reactor->menos_reciente != conexion) {
+        return; // todavía no está en la lista
+    }
+    if (conexion->anterior) {
+        conexion->anterior->siguiente = conexion->siguiente;
+    } else {
+        reactor->menos_reciente = conexion->siguiente;
+    }
+    if (conexion->siguiente) {
+        conexion->siguiente->anterior = conexion->anterior;
+    } else {
+        reactor->mas_reciente = conexion->anterior;
+    }
+    conexion->anterior = NULL;
+    conexion->siguiente = NULL;
+}
+
+// Marca actividad en la conexión moviéndola al final de la lista: la cabeza es
+// siempre la más inactiva, así que revisar los timeouts es O(conexiones vencidas).
+static void registrar_actividad(Reactor *reactor, Conexion *conexion) {
+    if (reactor->mas_reciente != conexion) {
+        desenlazar_conexion(reactor, conexion);
+        conexion->anterior = reactor->mas_reciente;
+        if (reactor->mas_reciente) {
+            reactor->mas_reciente->siguiente = conexion;
+        } else {
+            reactor->menos_reciente = conexion;
+        }
+        reactor->mas_reciente = conexion;
+    }
+    conexion->ultima_actividad = reactor->ahora;
+}
+
+static void cerrar_conexion(Reactor *reactor, Conexion *conexion) {
+    desenlazar_conexion(reactor, conexion);
+    if (conexion->peticion) {
+        if (conexion->estado == CONEXION_ESCRIBIENDO) {
+            liberar_respuesta(&conexion->peticion->respuesta);
+        }
+        devolver_a_losa(&reactor->peticiones, conexion->peticion);
+    }
+    close(conexion->fd);
+    soltar_conexion(conexion->entrada_cliente);
+    reactor->conexiones_activas--;
+    devolver_a_losa(&reactor->conexiones, conexion);
+}
+
+// Acepta todas las conexiones pendientes (edge-triggered: hasta EAGAIN). Si se acaban
+// los descriptores, las pendientes se quedan en la cola de listen sin generar otro
+// flanco: el reactor vuelve a llamar aquí pasada la pausa (ver hilo_reactor).
+static void aceptar_conexiones(Reactor *reactor) {
+    reactor->aceptar_desde_ns = 0;
+    for (;;) {
+        struct sockaddr_in direccion_cliente;
+        socklen_t longitud_cliente = sizeof(direccion_cliente);
+        int cliente_fd = accept4(reactor->escucha_fd, (struct sockaddr *)&direccion_cliente,
+                                 &longitud_cliente, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cliente_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (servidor_corriendo) {
+                contar_metrica(METRICA_ERRORES_ACCEPT, 1);
+                if (errno == EMFILE || errno == ENFILE) {
+                    DIAG_AVISO("[REACTOR %d] Sin descriptores libres; se pausa accept() %d ms.\n", reactor->id,
+                               PAUSA_ACCEPT_MS);
+                    reactor->aceptar_desde_ns = tiempo_monotonico_ns() + PAUSA_ACCEPT_MS * 1000000ull;
+                } else {
+                    perror("[REACTOR] Error al aceptar conexion");
+                }
+            }
+            return;
+        }
+
+        int entrada_cliente = admitir_conexion(direccion_cliente.sin_addr.s_addr);
+        if (entrada_cliente == CLIENTE_RECHAZADO) {
+            if (config_global.rechazo_por_ip == RECHAZO_RESPONDER) {
+                send(cliente_fd, respuesta_503, strlen(respuesta_503), MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
+            close(cliente_fd);
+            continue;
+        }
+
+        Conexion *conexion = tomar_de_losa(&reactor->conexiones);
+        if (!conexion) {
+            close(cliente_fd);
+            soltar_conexion(entrada_cliente);
+            continue;
+        }
+        conexion->fd = cliente_fd;
+        conexion->entrada_cliente = entrada_cliente;
+        conexion->estado = CONEXION_LEYENDO;
+        conexion->peticion = NULL;
+        conexion->peticiones_atendidas = 0;
+        conexion->anterior = NULL;
+        conexion->siguiente = NULL;
+        inet_ntop(AF_INET, &direccion_cliente.sin_addr, conexion->ip, INET_ADDRSTRLEN);
+        conexion->puerto = ntohs(direccion_cliente.sin_port);
+
+        // Se registra una sola vez para lectura y escritura; con EPOLLET no hace falta
+        // volver a llamar a epoll_ctl al cambiar de fase.
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conexion;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, cliente_fd, &ev) < 0) {
+            perror("[REACTOR] Error registrando conexión en epoll");
+            close(cliente_fd);
+            soltar_conexion(entrada_cliente);
+            devolver_a_losa(&reactor->conexiones, conexion);
+            continue;
+        }
+        reactor->conexiones_activas++;
+        registrar_actividad(reactor, conexion);
+    }
+}
+
+// Busca la siguiente petición: primero entre los datos ya leídos (peticiones encadenadas)
+// y luego leyendo del socket hasta EAGAIN. El análisis retoma donde se quedó en cada
+// lectura. Devuelve 1 si hay una petición completa, 0 si faltan datos, -1 si el cliente
+// cerró o hubo un error, o el código HTTP en negativo (-400, -413...) si hay que rechazarla.
+static int leer_peticion(Reactor *reactor, Conexion *conexion) {
+    PeticionEnCurso *peticion = obtener_peticion(reactor, conexion);
+    if (!peticion) {
+        return -1;
+    }
+
+    for (;;) {
+        int estado = analizar_peticion(&peticion->http, peticion->lectura, peticion->leidos, &config_global.limites_http);
+        if (estado == ANALISIS_COMPLETO) {
+            peticion->longitud = peticion->http.longitud;
+            return 1;
+        }
+        if (estado < 0) {
+            return estado;
+        }
+
+        size_t libre = sizeof(peticion->lectura) - 1 - peticion->leidos;
+        ssize_t n = recv(conexion->fd, peticion->lectura + peticion->leidos, libre, 0);
+        if (n > 0) {
+            peticion->leidos += n;
+        } else if (n == 0) {
+            return -1;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Avanza la máquina de estados de una conexión tras un evento. Con keep-alive la
+// conexión vuelve a la fase de lectura tras cada respuesta y se atienden en orden
+// todas las peticiones encadenadas que ya estén en el buffer.
+static void atender_evento(Reactor *reactor, Conexion *conexion, uint32_t eventos) {
+    if (eventos & EPOLLERR) {
+        cerrar_conexion(reactor, conexion);
+        return;
+    }
+    if (conexion->estado == CONEXION_LEYENDO && !(eventos & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+        return;
+    }
+    registrar_actividad(reactor, conexion);
+
+    for (;;) {
+        if (conexion->estado == CONEXION_LEYENDO) {
+            int resultado = leer_peticion(reactor, conexion);
+            if (resultado == -1) {
+                cerrar_conexion(reactor, conexion);
+                return;
+            }
+            if (resultado == 0) {
+                // Sin datos pendientes la conexión ociosa no retiene el buffer de lectura.
+                if (conexion->peticion->leidos == 0) {
+                    devolver_a_losa(&reactor->peticiones, conexion->peticion);
+                    conexion->peticion = NULL;
+                }
+                return;
+            }
+
+            // Fase de búsqueda: se resuelve el recurso y se prepara la respuesta.
+            PeticionEnCurso *peticion = conexion->peticion;
+            conexion->peticiones_atendidas++;
+            int permitir_mantener = servidor_corriendo &&
+                                    conexion->peticiones_atendidas < config_global.max_peticiones_conexion;
+            if (resultado < 0) {
+                responder_peticion_invalida(&peticion->respuesta, -resultado);
+            } else if (!admitir_peticion(conexion->entrada_cliente)) {
+                if (config_global.rechazo_por_ip == RECHAZO_CERRAR) {
+                    cerrar_conexion(reactor, conexion);
+                    return;
+                }
+                responder_peticion_invalida(&peticion->respuesta, 429);
+            } else {
+                procesar_peticion(reactor->buffer_paginas, &peticion->http, conexion->ip, conexion->puerto,
+                                  permitir_mantener, &peticion->respuesta);
+            }
+            peticion->enviados = 0;
+            peticion->inicio_envio_ns = tiempo_monotonico_ns();
+            conexion->estado = CONEXION_ESCRIBIENDO;
+        }
+
+        // Fase de escritura: se intenta de inmediato y se continúa con cada EPOLLOUT.
+        int resultado = enviar_respuesta(conexion->fd, &conexion->peticion->respuesta, &conexion->peticion->enviados);
+        if (resultado < 0) {
+            cerrar_conexion(reactor, conexion);
+            return;
+        }
+        if (resultado == 0) {
+            return;
+        }
+
+        PeticionEnCurso *peticion = conexion->peticion;
+        registrar_latencia(FASE_ENVIO, tiempo_monotonico_ns() - peticion->inicio_envio_ns);
+        liberar_respuesta(&peticion->respuesta);
+        if (!peticion->respuesta.mantener_conexion) {
+            cerrar_conexion(reactor, conexion);
+            return;
+        }
+        memmove(peticion->lectura, peticion->lectura + peticion->longitud, peticion->leidos - peticion->longitud);
+        peticion->leidos -= peticion->longitud;
+        iniciar_peticion_http(&peticion->http);
+        conexion->estado = CONEXION_LEYENDO;
+    }
+}
+
+// Cierra las conexiones que llevan más de 'timeout_inactivo' segundos sin actividad.
+static void cerrar_inactivas(Reactor *reactor) {
+    while (reactor->menos_reciente &&
+           reactor->ahora - reactor->menos_reciente->ultima_actividad >= config_global.timeout_inactivo) {
+        cerrar_conexion(reactor, reactor->menos_reciente);
+    }
+}
+
+// Al apagar: deja de aceptar y cierra su socket de escucha (en un relevo sigue abierto
+// en el proceso nuevo, que atiende lo que quede en la cola de listen), y cierra las
+// conexiones keep-alive que ya respondieron y esperan sin petición a medias. Las demás
+// terminan su petición en curso, sin keep-alive, hasta el límite de drenaje.
+static void empezar_drenaje(Reactor *reactor) {
+    reactor->ahora = time(NULL);
+    reactor->limite_drenaje = reactor->ahora + config_global.plazo_drenaje;
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, reactor->escucha_fd, NULL);
+    close(reactor->escucha_fd);
+    Conexion *conexion = reactor->menos_reciente;
+    while (conexion) {
+        Conexion *siguiente = conexion->siguiente;
+        if (conexion->estado == CONEXION_LEYENDO && !conexion->peticion && conexion->peticiones_atendidas > 0) {
+            cerrar_conexion(reactor, conexion);
+        }
+        conexion = siguiente;
+    }
+    DIAG_INFO("[REACTOR %d] Drenando %d conexiones.\n", reactor->id, reactor->conexiones_activas);
+}
+
+static void *hilo_reactor(void *arg) {
+    Reactor *reactor = (Reactor *)arg;
+    struct epoll_event eventos[MAX_EVENTOS];
+
+    DIAG_INFO("[REACTOR %d] Reactor iniciado sobre el socket %d.\n", reactor->id, reactor->escucha_fd);
+
+    for (;;) {
+        if (!servidor_corriendo && !reactor->limite_drenaje) {
+            empezar_drenaje(reactor);
+        }
+        if (reactor->limite_drenaje &&
+            (reactor->conexiones_activas == 0 || reactor->ahora >= reactor->limite_drenaje)) {
+            break;
+        }
+        int espera_ms = reactor->limite_drenaje ? 100 : reactor->aceptar_desde_ns ? PAUSA_ACCEPT_MS : 1000;
+        int n = epoll_wait(reactor->epoll_fd, eventos, MAX_EVENTOS, espera_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[REACTOR] Error en epoll_wait");
+            break;
+        }
+        reactor->ahora = time(NULL);
+        for (int i = 0; i < n; i++) {
+            if (eventos[i].data.ptr == NULL) {
+                if (!reactor->aceptar_desde_ns) {
+                    aceptar_conexiones(reactor);
+                }
+            } else {
+                atender_evento(reactor, (Conexion *)eventos[i].data.ptr, eventos[i].events);
+            }
+        }
+        cerrar_inactivas(reactor);
+        if (reactor->aceptar_desde_ns && !reactor->limite_drenaje &&
+            tiempo_monotonico_ns() >= reactor->aceptar_desde_ns) {
+            aceptar_conexiones(reactor);
+        }
+    }
+
+    // Las que sigan abiertas al vencer el plazo se cortan; sus respuestas sueltan las
+    // páginas, así que después ya se puede liberar la caché.
+    int cortadas = reactor->conexiones_activas;
+    while (reactor->menos_reciente) {
+        cerrar_conexion(reactor, reactor->menos_reciente);
+    }
+    close(reactor->epoll_fd);
+    DIAG_INFO("[REACTOR %d] Reactor finalizado; %d conexiones cortadas al vencer el plazo.\n", reactor->id, cortadas);
+    return NULL;
+}
+
+static pthread_t hilos_reactores[MAX_REACTORES];
+static int num_hilos_reactores;
+
+// Espera a que todos los reactores terminen de drenar. Cada uno respeta el límite de
+// drenaje, así que siempre terminan; devuelve 0.
+int detener_reactores(void) {
+    for (int i = 0; i < num_hilos_reactores; i++) {
+        pthread_join(hilos_reactores[i], NULL);
+    }
+    num_hilos_reactores = 0;
+    return 0;
+}
+
+// Arranca un reactor por socket de escucha. Los sockets deben ser no bloqueantes.
+int iniciar_reactores(int *sockets_escucha, int num_reactores, BufferPaginas *buffer) {
+    Reactor *reactores = calloc(num_reactores, sizeof(Reactor));
+    if (!reactores) {
+        perror("[REACTOR] Error reservando memoria para los reactores");
+        return -1;
+    }
+
+    for (int i = 0; i < num_reactores; i++) {
+        Reactor *reactor = &reactores[i];
+        reactor->id = i;
+        reactor->escucha_fd = sockets_escucha[i];
+        reactor->buffer_paginas = buffer;
+        reactor->ahora = time(NULL);
+        iniciar_losa(&reactor->conexiones, sizeof(Conexion), CONEXIONES_POR_TRAMO);
+        iniciar_losa(&reactor->peticiones, sizeof(PeticionEnCurso), PETICIONES_POR_TRAMO);
+        reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactor->epoll_fd < 0) {
+            perror("[REACTOR] Error en epoll_create1");
+            return -1;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL; // NULL identifica al socket de escucha
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->escucha_fd, &ev) < 0) {
+            perror("[REACTOR] Error registrando el socket de escucha");
+            return -1;
+        }
+
+        if (pthread_create(&hilos_reactores[num_hilos_reactores], NULL, hilo_reactor, reactor) != 0) {
+            perror("[REACTOR] Error al crear hilo reactor");
+            return -1;
+        }
+        num_hilos_reactores++;
+    }
+    DIAG_INFO("[REACTOR] %d reactores epoll en ejecución.\n", num_reactores);
+    return 0;
+}
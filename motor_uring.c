@@ -0,0 +1,951 @@
+#include "servidor_web.h"
+
+// Motor io_uring: un anillo por núcleo, cada uno con su hilo y su propio socket de
+// escucha (SO_REUSEPORT). Las operaciones de las conexiones se preparan en la cola de
+// envío (SQ) y el hilo entrega el lote y recoge los completados con una sola llamada a
+// io_uring_enter() por vuelta; accept, recv, send y las lecturas de archivo no cuestan
+// una llamada al sistema cada una:
+//   - los sockets aceptados van directos a la tabla de descriptores fijos del anillo
+//     (IORING_FILE_INDEX_ALLOC): no ocupan descriptor del proceso y la dirección del
+//     cliente llega con el accept, sin getpeername();
+//   - la recepción toma búferes de un anillo de búferes prestado al kernel, así que una
+//     conexión ociosa no retiene memoria de lectura;
+//   - un cuerpo en archivo se lee en un bloque registrado (IORING_OP_READ_FIXED)
+//     encadenado con su envío (IOSQE_IO_LINK): cada entrega lee y envía hasta
+//     TAMANO_BLOQUE_ANILLO bytes, con el encabezado delante en el primer bloque;
+//   - un cuerpo en caché sale de la página en memoria con un sendmsg() encolado.
+// En lugar de un accept multishot hay ACEPTACIONES_EN_VUELO accept pendientes: un
+// multishot escribe la dirección de todos los clientes en el mismo sitio y, con varias
+// conexiones en un lote, el registro vería la del último.
+
+#define ENTRADAS_SQ 256
+#define ENTRADAS_CQ 4096
+#define GRUPO_BUFERES 0
+
+// Operación de cada entrada, en los bits bajos de user_data; el resto es la conexión
+// (de una losa, alineada a 64 bytes) o el índice de la aceptación.
+enum {
+    OP_ACEPTAR,
+    OP_RECIBIR,
+    OP_ENVIAR,
+    OP_LEER_ARCHIVO, // solo se completa si falla (IOSQE_CQE_SKIP_SUCCESS)
+    OP_CORTAR,
+    OP_CERRAR,
+    OP_CANCELAR
+};
+#define MASCARA_OP 7
+
+static uint64_t dato_conexion(ConexionAnillo *conexion, int operacion) {
+    return (uint64_t)(uintptr_t)conexion | operacion;
+}
+
+// Publica las entradas preparadas y las entrega al kernel. Con 'espera_ms' > 0 espera
+// además al menos un completado, o a que pase el plazo. Es la llamada al sistema de
+// cada vuelta del anillo.
+static int entregar(AnilloServidor *anillo, int espera_ms) {
+    atomic_store_explicit(anillo->sq_cola, anillo->sq_preparadas, memory_order_release);
+    unsigned pendientes = anillo->sq_preparadas - atomic_load_explicit(anillo->sq_cabeza, memory_order_acquire);
+    if (espera_ms == 0) {
+        return pendientes ? (int)syscall(__NR_io_uring_enter, anillo->anillo_fd, pendientes, 0, 0, NULL, 0) : 0;
+    }
+    struct __kernel_timespec plazo = {espera_ms / 1000, (espera_ms % 1000) * 1000000LL};
+    struct io_uring_getevents_arg argumento = {0};
+    argumento.ts = (uint64_t)(uintptr_t)&plazo;
+    return (int)syscall(__NR_io_uring_enter, anillo->anillo_fd, pendientes, 1,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argumento, sizeof(argumento));
+}
+
+// Se asegura de que quepan 'n' entradas en la SQ, entregando lo preparado si está
+// llena. Devuelve 0 si caben.
+static int reservar_entradas(AnilloServidor *anillo, unsigned n) {
+    if (anillo->sq_preparadas - atomic_load_explicit(anillo->sq_cabeza, memory_order_acquire) + n <= anillo->sq_entradas) {
+        return 0;
+    }
+    entregar(anillo, 0);
+    if (anillo->sq_preparadas - atomic_load_explicit(anillo->sq_cabeza, memory_order_acquire) + n <= anillo->sq_entradas) {
+        return 0;
+    }
+    DIAG_ERROR("[ANILLO %d] La cola de envío sigue llena tras entregarla.\n", anillo->id);
+    return -1;
+}
+
+// Siguiente entrada libre de la SQ, a cero. Antes hay que reservarla.
+static struct io_uring_sqe *siguiente_entrada(AnilloServidor *anillo) {
+    struct io_uring_sqe *sqe = &anillo->sqes[anillo->sq_preparadas & anillo->sq_mascara];
+    anillo->sq_preparadas++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Devuelve un búfer de recepción al anillo de búferes del kernel.
+static void devolver_bufer(AnilloServidor *anillo, unsigned id) {
+    _Atomic uint16_t *cola = (_Atomic uint16_t *)&anillo->buferes->tail;
+    uint16_t posicion = atomic_load_explicit(cola, memory_order_relaxed);
+    struct io_uring_buf *bufer = &anillo->buferes->bufs[posicion & (BUFERES_RECEPCION - 1)];
+    bufer->addr = (uint64_t)(uintptr_t)(anillo->memoria_buferes + (size_t)id * TAMANO_BUFFER);
+    bufer->len = TAMANO_BUFFER;
+    bufer->bid = id;
+    atomic_store_explicit(cola, posicion + 1, memory_order_release);
+}
+
+// Lista de conexiones por actividad, como en los reactores epoll: la cabeza es siempre
+// la más inactiva.
+static void desenlazar_conexion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (!conexion->anterior && anillo->menos_reciente != conexion) {
+        return;
+    }
+    if (conexion->anterior) {
+        conexion->anterior->siguiente = conexion->siguiente;
+    } else {
+        anillo->menos_reciente = conexion->siguiente;
+    }
+    if (conexion->siguiente) {
+        conexion->siguiente->anterior = conexion->anterior;
+    } else {
+        anillo->mas_reciente = conexion->anterior;
+    }
+    conexion->anterior = NULL;
+    conexion->siguiente = NULL;
+}
+
+static void registrar_actividad(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (conexion->cortada || conexion->cerrando) {
+        return;
+    }
+    if (anillo->mas_reciente != conexion) {
+        desenlazar_conexion(anillo, conexion);
+        conexion->anterior = anillo->mas_reciente;
+        if (anillo->mas_reciente) {
+            anillo->mas_reciente->siguiente = conexion;
+        } else {
+            anillo->menos_reciente = conexion;
+        }
+        anillo->mas_reciente = conexion;
+    }
+    conexion->ultima_actividad = anillo->ahora;
+}
+
+static PeticionEnCurso *obtener_peticion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (!conexion->peticion) {
+        conexion->peticion = tomar_de_losa(&anillo->peticiones);
+        if (conexion->peticion) {
+            conexion->peticion->leidos = 0;
+            conexion->peticion->enviados = 0;
+            iniciar_peticion_http(&conexion->peticion->http);
+        }
+    }
+    return conexion->peticion;
+}
+
+static void pedir_envio_bloque(AnilloServidor *anillo, ConexionAnillo *conexion);
+static void cerrar_conexion(AnilloServidor *anillo, ConexionAnillo *conexion);
+
+// Los bloques para leer archivos se reparten por orden de llegada: quien no encuentra
+// uno libre espera en la cola del anillo sin operaciones en vuelo.
+static void soltar_bloque(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    int bloque = conexion->bloque;
+    conexion->bloque = -1;
+    ConexionAnillo *siguiente = anillo->primera_espera;
+    if (!siguiente) {
+        anillo->bloques_libres[anillo->num_bloques_libres++] = bloque;
+        return;
+    }
+    anillo->primera_espera = siguiente->siguiente_espera;
+    if (!anillo->primera_espera) {
+        anillo->ultima_espera = NULL;
+    }
+    siguiente->bloque = bloque;
+    pedir_envio_bloque(anillo, siguiente);
+}
+
+static void quitar_de_espera(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    ConexionAnillo *anterior = NULL;
+    for (ConexionAnillo *c = anillo->primera_espera; c; anterior = c, c = c->siguiente_espera) {
+        if (c == conexion) {
+            if (anterior) {
+                anterior->siguiente_espera = c->siguiente_espera;
+            } else {
+                anillo->primera_espera = c->siguiente_espera;
+            }
+            if (anillo->ultima_espera == c) {
+                anillo->ultima_espera = anterior;
+            }
+            return;
+        }
+    }
+}
+
+// Encola el close de una conexión sin operaciones en vuelo. Si no cabe en la SQ la
+// conexión espera en 'cierres_pendientes' y se reintenta en la siguiente vuelta; mientras
+// tanto sigue contando como activa, así que el drenaje también la espera.
+static void pedir_cierre(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (reservar_entradas(anillo, 1) != 0) {
+        conexion->siguiente_espera = anillo->cierres_pendientes;
+        anillo->cierres_pendientes = conexion;
+        return;
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = conexion->ranura + 1;
+    sqe->user_data = dato_conexion(conexion, OP_CERRAR);
+    conexion->operaciones++;
+}
+
+static void cerrar_ranura(AnilloServidor *anillo, int ranura);
+
+static void reintentar_cierres(AnilloServidor *anillo) {
+    int num_ranuras = anillo->num_ranuras_por_cerrar;
+    anillo->num_ranuras_por_cerrar = 0;
+    for (int i = 0; i < num_ranuras; i++) {
+        cerrar_ranura(anillo, anillo->ranuras_por_cerrar[i]);
+    }
+    ConexionAnillo *conexion = anillo->cierres_pendientes;
+    anillo->cierres_pendientes = NULL;
+    while (conexion) {
+        ConexionAnillo *siguiente = conexion->siguiente_espera;
+        pedir_cierre(anillo, conexion);
+        conexion = siguiente;
+    }
+}
+
+// Cierra la conexión en cuanto no tenga operaciones en vuelo: hasta entonces el kernel
+// puede estar leyendo su respuesta o escribiendo en su bloque. El close también va por
+// el anillo, y la conexión vuelve a la losa cuando se completa.
+static void cerrar_conexion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    desenlazar_conexion(anillo, conexion);
+    conexion->cerrando = 1;
+    if (conexion->operaciones > 0) {
+        return;
+    }
+    if (conexion->peticion) {
+        if (conexion->estado == CONEXION_ESCRIBIENDO) {
+            liberar_respuesta(&conexion->peticion->respuesta);
+        }
+        devolver_a_losa(&anillo->peticiones, conexion->peticion);
+        conexion->peticion = NULL;
+    }
+    if (conexion->bloque >= 0) {
+        soltar_bloque(anillo, conexion);
+    }
+    pedir_cierre(anillo, conexion);
+}
+
+// Corta una conexión inactiva, o todas al vencer el drenaje: shutdown() hace volver el
+// recv o el send que tenga en vuelo y el cierre sigue su camino normal.
+static void cortar_conexion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    desenlazar_conexion(anillo, conexion);
+    if (conexion->cortada || conexion->cerrando) {
+        return;
+    }
+    conexion->cortada = 1;
+    if (conexion->operaciones == 0) {
+        quitar_de_espera(anillo, conexion);
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    if (reservar_entradas(anillo, 1) != 0) {
+        return;
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = conexion->ranura;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->len = SHUT_RDWR;
+    sqe->user_data = dato_conexion(conexion, OP_CORTAR);
+    conexion->operaciones++;
+}
+
+// Pide un recv al búfer que elija el kernel, limitado a lo que cabe en la petición.
+static void pedir_recepcion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    size_t libre = TAMANO_BUFFER - 1 - (conexion->peticion ? conexion->peticion->leidos : 0);
+    if (libre == 0 || reservar_entradas(anillo, 1) != 0) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conexion->ranura;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->buf_group = GRUPO_BUFERES;
+    sqe->len = libre;
+    sqe->user_data = dato_conexion(conexion, OP_RECIBIR);
+    conexion->operaciones++;
+}
+
+// Encola un sendmsg() con lo que falta de una respuesta en memoria. Con MSG_WAITALL el
+// kernel reintenta los envíos parciales y solo completa al terminar o fallar.
+static void pedir_envio_memoria(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (reservar_entradas(anillo, 1) != 0) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    PeticionEnCurso *peticion = conexion->peticion;
+    memset(&conexion->mensaje, 0, sizeof(conexion->mensaje));
+    conexion->mensaje.msg_iov = conexion->iov;
+    conexion->mensaje.msg_iovlen = partes_pendientes(&peticion->respuesta, peticion->enviados, conexion->iov);
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conexion->ranura;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)&conexion->mensaje;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = dato_conexion(conexion, OP_ENVIAR);
+    conexion->operaciones++;
+}
+
+// Encola el siguiente bloque de una respuesta desde archivo: lo que falte del
+// encabezado se copia al principio del bloque, la lectura del archivo lo completa y el
+// envío va encadenado a la lectura. Si la lectura falla o se queda corta (el archivo
+// se acortó) el envío se cancela y la conexión se cierra.
+static void pedir_envio_bloque(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    PeticionEnCurso *peticion = conexion->peticion;
+    Respuesta *resp = &peticion->respuesta;
+    char *bloque = anillo->bloques + (size_t)conexion->bloque * TAMANO_BLOQUE_ANILLO;
+    // Lo que haya en memoria antes del siguiente tramo del archivo se copia delante
+    size_t tam = 0;
+    struct iovec iov[MAX_IOV_RESPUESTA];
+    int num_iov = partes_pendientes(resp, peticion->enviados, iov);
+    for (int i = 0; i < num_iov && tam < TAMANO_BLOQUE_ANILLO; i++) {
+        size_t copiar = iov[i].iov_len < TAMANO_BLOQUE_ANILLO - tam ? iov[i].iov_len : TAMANO_BLOQUE_ANILLO - tam;
+        memcpy(bloque + tam, iov[i].iov_base, copiar);
+        tam += copiar;
+    }
+    off_t posicion = 0;
+    size_t leer = 0;
+    if (tam < TAMANO_BLOQUE_ANILLO && tramo_de_archivo(resp, peticion->enviados + tam, &posicion, &leer) &&
+        leer > TAMANO_BLOQUE_ANILLO - tam) {
+        leer = TAMANO_BLOQUE_ANILLO - tam;
+    }
+    size_t total = resp->tam_encabezado + resp->tam_cuerpo;
+    if (reservar_entradas(anillo, leer > 0 ? 2 : 1) != 0) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    if (leer > 0) {
+        struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+        sqe->opcode = anillo->bloques_registrados ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = resp->archivo_fd;
+        sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->addr = (uint64_t)(uintptr_t)(bloque + tam);
+        sqe->len = leer;
+        sqe->off = posicion;
+        sqe->buf_index = anillo->bloques_registrados ? conexion->bloque : 0;
+        sqe->user_data = dato_conexion(NULL, OP_LEER_ARCHIVO);
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conexion->ranura;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)bloque;
+    sqe->len = tam + leer;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (peticion->enviados + tam + leer < total ? MSG_MORE : 0);
+    sqe->user_data = dato_conexion(conexion, OP_ENVIAR);
+    conexion->en_bloque = tam + leer;
+    conexion->enviados_bloque = 0;
+    conexion->operaciones++;
+}
+
+// Reenvía lo que quedó sin enviar del bloque actual.
+static void pedir_resto_bloque(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (reservar_entradas(anillo, 1) != 0) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conexion->ranura;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)(anillo->bloques + (size_t)conexion->bloque * TAMANO_BLOQUE_ANILLO +
+                                      conexion->enviados_bloque);
+    sqe->len = conexion->en_bloque - conexion->enviados_bloque;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = dato_conexion(conexion, OP_ENVIAR);
+    conexion->operaciones++;
+}
+
+static void continuar_envio(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    if (conexion->peticion->respuesta.archivo_fd < 0) {
+        pedir_envio_memoria(anillo, conexion);
+    } else if (conexion->bloque >= 0) {
+        pedir_envio_bloque(anillo, conexion);
+    } else if (anillo->num_bloques_libres > 0) {
+        conexion->bloque = anillo->bloques_libres[--anillo->num_bloques_libres];
+        pedir_envio_bloque(anillo, conexion);
+    } else {
+        conexion->siguiente_espera = NULL;
+        if (anillo->ultima_espera) {
+            anillo->ultima_espera->siguiente_espera = conexion;
+        } else {
+            anillo->primera_espera = conexion;
+        }
+        anillo->ultima_espera = conexion;
+    }
+}
+
+// Atiende la siguiente petición que haya en el buffer de la conexión (las encadenadas
+// se responden en orden) o, si aún no está completa, pide otro recv.
+static void atender_peticion(AnilloServidor *anillo, ConexionAnillo *conexion) {
+    PeticionEnCurso *peticion = conexion->peticion;
+    int estado = analizar_peticion(&peticion->http, peticion->lectura, peticion->leidos, &config_global.limites_http);
+    if (estado == ANALISIS_INCOMPLETO) {
+        // Sin datos pendientes la conexión ociosa no retiene el buffer de lectura.
+        if (peticion->leidos == 0) {
+            devolver_a_losa(&anillo->peticiones, peticion);
+            conexion->peticion = NULL;
+        }
+        pedir_recepcion(anillo, conexion);
+        return;
+    }
+
+    conexion->peticiones_atendidas++;
+    int permitir_mantener = servidor_corriendo &&
+                            conexion->peticiones_atendidas < config_global.max_peticiones_conexion;
+    if (estado < 0) {
+        responder_peticion_invalida(&peticion->respuesta, -estado);
+    } else if (!admitir_peticion(conexion->entrada_cliente)) {
+        if (config_global.rechazo_por_ip == RECHAZO_CERRAR) {
+            cerrar_conexion(anillo, conexion);
+            return;
+        }
+        responder_peticion_invalida(&peticion->respuesta, 429);
+    } else {
+        peticion->longitud = peticion->http.longitud;
+        procesar_peticion(anillo->buffer_paginas, &peticion->http, conexion->ip, conexion->puerto,
+                          permitir_mantener, &peticion->respuesta);
+    }
+    peticion->enviados = 0;
+    peticion->inicio_envio_ns = tiempo_monotonico_ns();
+    conexion->estado = CONEXION_ESCRIBIENDO;
+    continuar_envio(anillo, conexion);
+}
+
+static void recibido(AnilloServidor *anillo, ConexionAnillo *conexion, int resultado, unsigned flags) {
+    if (resultado == -ENOBUFS && !conexion->cortada) {
+        // Todos los búferes estaban prestados; al volver a pedirlo ya se habrán devuelto.
+        pedir_recepcion(anillo, conexion);
+        return;
+    }
+    unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+    PeticionEnCurso *peticion = resultado > 0 && !conexion->cortada ? obtener_peticion(anillo, conexion) : NULL;
+    if (peticion) {
+        memcpy(peticion->lectura + peticion->leidos, anillo->memoria_buferes + (size_t)id * TAMANO_BUFFER, resultado);
+        peticion->leidos += resultado;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+        devolver_bufer(anillo, id);
+    }
+    if (!peticion) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    registrar_actividad(anillo, conexion);
+    atender_peticion(anillo, conexion);
+}
+
+static void enviado(AnilloServidor *anillo, ConexionAnillo *conexion, int resultado) {
+    if (resultado <= 0 || conexion->cortada) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    contar_metrica(METRICA_BYTES_ENVIADOS, resultado);
+    registrar_actividad(anillo, conexion);
+    PeticionEnCurso *peticion = conexion->peticion;
+    Respuesta *resp = &peticion->respuesta;
+    peticion->enviados += resultado;
+    if (conexion->bloque >= 0) {
+        conexion->enviados_bloque += resultado;
+        if (conexion->enviados_bloque < conexion->en_bloque) {
+            pedir_resto_bloque(anillo, conexion);
+            return;
+        }
+    }
+    if (peticion->enviados < resp->tam_encabezado + resp->tam_cuerpo) {
+        continuar_envio(anillo, conexion);
+        return;
+    }
+
+    registrar_latencia(FASE_ENVIO, tiempo_monotonico_ns() - peticion->inicio_envio_ns);
+    liberar_respuesta(resp);
+    conexion->estado = CONEXION_LEYENDO;
+    if (conexion->bloque >= 0) {
+        soltar_bloque(anillo, conexion);
+    }
+    if (!resp->mantener_conexion) {
+        cerrar_conexion(anillo, conexion);
+        return;
+    }
+    memmove(peticion->lectura, peticion->lectura + peticion->longitud, peticion->leidos - peticion->longitud);
+    peticion->leidos -= peticion->longitud;
+    iniciar_peticion_http(&peticion->http);
+    atender_peticion(anillo, conexion);
+}
+
+static void pedir_aceptacion(AnilloServidor *anillo, int indice) {
+    if (reservar_entradas(anillo, 1) != 0) {
+        return;
+    }
+    AceptacionAnillo *aceptacion = &anillo->aceptaciones[indice];
+    aceptacion->longitud = sizeof(aceptacion->direccion);
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = anillo->escucha_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&aceptacion->direccion;
+    sqe->addr2 = (uint64_t)(uintptr_t)&aceptacion->longitud;
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = ((uint64_t)indice << 3) | OP_ACEPTAR;
+    aceptacion->en_vuelo = 1;
+    anillo->aceptaciones_en_vuelo++;
+}
+
+// Mantiene los accept en vuelo mientras quede sitio en la tabla de descriptores fijos.
+static void armar_aceptaciones(AnilloServidor *anillo) {
+    for (int i = 0; i < ACEPTACIONES_EN_VUELO && !anillo->limite_drenaje; i++) {
+        if (!anillo->aceptaciones[i].en_vuelo &&
+            anillo->conexiones_activas + anillo->aceptaciones_en_vuelo < MAX_CONEXIONES_ANILLO) {
+            pedir_aceptacion(anillo, i);
+        }
+    }
+}
+
+// Cierra el descriptor fijo de un socket que no llegó a ser una conexión. Si el close no
+// cabe en la SQ la ranura espera en 'ranuras_por_cerrar' y se reintenta en la siguiente
+// vuelta, como el de las conexiones; cada ranura está como mucho una vez en la lista.
+static void cerrar_ranura(AnilloServidor *anillo, int ranura) {
+    if (reservar_entradas(anillo, 1) != 0) {
+        anillo->ranuras_por_cerrar[anillo->num_ranuras_por_cerrar++] = ranura;
+        return;
+    }
+    struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = ranura + 1;
+    sqe->user_data = dato_conexion(NULL, OP_CERRAR);
+}
+
+// Cierra un socket aceptado que no llega a ser una conexión; con 'responder' antes se le
+// envía el 503, sin esperar, encadenado al close para que se cierre aunque falle. Si no
+// caben las dos entradas se cierra sin responder.
+static void rechazar_aceptado(AnilloServidor *anillo, int ranura, int responder) {
+    if (reservar_entradas(anillo, responder ? 2 : 1) != 0) {
+        cerrar_ranura(anillo, ranura);
+        return;
+    }
+    struct io_uring_sqe *sqe;
+    if (responder) {
+        sqe = siguiente_entrada(anillo);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = ranura;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->addr = (uint64_t)(uintptr_t)respuesta_503;
+        sqe->len = strlen(respuesta_503);
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+        sqe->user_data = dato_conexion(NULL, OP_ENVIAR);
+    }
+    sqe = siguiente_entrada(anillo);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = ranura + 1;
+    sqe->user_data = dato_conexion(NULL, OP_CERRAR);
+}
+
+static void aceptado(AnilloServidor *anillo, int indice, int resultado) {
+    AceptacionAnillo *aceptacion = &anillo->aceptaciones[indice];
+    aceptacion->en_vuelo = 0;
+    anillo->aceptaciones_en_vuelo--;
+    if (resultado < 0) {
+        if (resultado != -ECANCELED && resultado != -ECONNABORTED && servidor_corriendo) {
+            DIAG_ERROR("[ANILLO %d] Error al aceptar conexion: %s\n", anillo->id, strerror(-resultado));
+            contar_metrica(METRICA_ERRORES_ACCEPT, 1);
+        }
+        return;
+    }
+
+    int entrada_cliente = admitir_conexion(aceptacion->direccion.sin_addr.s_addr);
+    if (entrada_cliente == CLIENTE_RECHAZADO) {
+        rechazar_aceptado(anillo, resultado, config_global.rechazo_por_ip == RECHAZO_RESPONDER);
+        return;
+    }
+    ConexionAnillo *conexion = tomar_de_losa(&anillo->conexiones);
+    if (!conexion) {
+        rechazar_aceptado(anillo, resultado, 0);
+        soltar_conexion(entrada_cliente);
+        return;
+    }
+    memset(conexion, 0, sizeof(*conexion));
+    conexion->ranura = resultado;
+    conexion->entrada_cliente = entrada_cliente;
+    conexion->estado = CONEXION_LEYENDO;
+    conexion->bloque = -1;
+    inet_ntop(AF_INET, &aceptacion->direccion.sin_addr, conexion->ip, INET_ADDRSTRLEN);
+    conexion->puerto = ntohs(aceptacion->direccion.sin_port);
+    anillo->conexiones_activas++;
+    registrar_actividad(anillo, conexion);
+    pedir_recepcion(anillo, conexion);
+}
+
+static void completar(AnilloServidor *anillo, uint64_t dato, int resultado, unsigned flags) {
+    int operacion = dato & MASCARA_OP;
+    if (operacion == OP_ACEPTAR) {
+        aceptado(anillo, (int)(dato >> 3), resultado);
+        return;
+    }
+    if (operacion == OP_LEER_ARCHIVO) {
+        // Su envío encadenado vuelve cancelado y cierra la conexión.
+        DIAG_AVISO("[ANILLO %d] Lectura de archivo fallida o incompleta (%d).\n", anillo->id, resultado);
+        return;
+    }
+    ConexionAnillo *conexion = (ConexionAnillo *)(uintptr_t)(dato & ~(uint64_t)MASCARA_OP);
+    if (operacion == OP_CANCELAR || !conexion) {
+        return;
+    }
+    conexion->operaciones--;
+    if (operacion == OP_CERRAR) {
+        soltar_conexion(conexion->entrada_cliente);
+        anillo->conexiones_activas--;
+        devolver_a_losa(&anillo->conexiones, conexion);
+        return;
+    }
+    if (conexion->cerrando) {
+        if (flags & IORING_CQE_F_BUFFER) {
+            devolver_bufer(anillo, flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        if (conexion->operaciones == 0) {
+            cerrar_conexion(anillo, conexion);
+        }
+        return;
+    }
+    if (operacion == OP_RECIBIR) {
+        recibido(anillo, conexion, resultado, flags);
+    } else if (operacion == OP_ENVIAR) {
+        enviado(anillo, conexion, resultado);
+    }
+}
+
+// Recorre la CQ. Cada completado se copia y se libera su hueco antes de atenderlo.
+static void recoger_completados(AnilloServidor *anillo) {
+    unsigned cabeza = atomic_load_explicit(anillo->cq_cabeza, memory_order_relaxed);
+    unsigned cola = atomic_load_explicit(anillo->cq_cola, memory_order_acquire);
+    while (cabeza != cola) {
+        struct io_uring_cqe *cqe = &anillo->cqes[cabeza & anillo->cq_mascara];
+        uint64_t dato = cqe->user_data;
+        int resultado = cqe->res;
+        unsigned flags = cqe->flags;
+        atomic_store_explicit(anillo->cq_cabeza, ++cabeza, memory_order_release);
+        completar(anillo, dato, resultado, flags);
+        if (cabeza == cola) {
+            cola = atomic_load_explicit(anillo->cq_cola, memory_order_acquire);
+        }
+    }
+}
+
+static void cerrar_inactivas(AnilloServidor *anillo) {
+    while (anillo->menos_reciente &&
+           anillo->ahora - anillo->menos_reciente->ultima_actividad >= config_global.timeout_inactivo) {
+        cortar_conexion(anillo, anillo->menos_reciente);
+    }
+}
+
+// Al apagar: cancela los accept en vuelo, cierra el socket de escucha (en un relevo
+// sigue abierto en el proceso nuevo) y corta las conexiones keep-alive que esperan sin
+// petición a medias. Las demás terminan su petición, sin keep-alive, hasta el límite.
+static void empezar_drenaje(AnilloServidor *anillo) {
+    anillo->ahora = time(NULL);
+    anillo->limite_drenaje = anillo->ahora + config_global.plazo_drenaje;
+    for (int i = 0; i < ACEPTACIONES_EN_VUELO; i++) {
+        if (anillo->aceptaciones[i].en_vuelo && reservar_entradas(anillo, 1) == 0) {
+            struct io_uring_sqe *sqe = siguiente_entrada(anillo);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = ((uint64_t)i << 3) | OP_ACEPTAR;
+            sqe->user_data = OP_CANCELAR;
+        }
+    }
+    close(anillo->escucha_fd);
+    ConexionAnillo *conexion = anillo->menos_reciente;
+    while (conexion) {
+        ConexionAnillo *siguiente = conexion->siguiente;
+        if (conexion->estado == CONEXION_LEYENDO && !conexion->peticion && conexion->peticiones_atendidas > 0) {
+            cortar_conexion(anillo, conexion);
+        }
+        conexion = siguiente;
+    }
+    DIAG_INFO("[ANILLO %d] Drenando %d conexiones.\n", anillo->id, anillo->conexiones_activas);
+}
+
+static void liberar_anillo(AnilloServidor *anillo) {
+    if (anillo->anillo_fd >= 0) {
+        close(anillo->anillo_fd);
+    }
+    if (anillo->mapa_colas) {
+        munmap(anillo->mapa_colas, anillo->tam_mapa_colas);
+    }
+    if (anillo->sqes) {
+        munmap(anillo->sqes, anillo->tam_mapa_sqes);
+    }
+    if (anillo->buferes) {
+        munmap(anillo->buferes, BUFERES_RECEPCION * sizeof(struct io_uring_buf));
+    }
+    if (anillo->memoria_buferes) {
+        munmap(anillo->memoria_buferes, (size_t)BUFERES_RECEPCION * TAMANO_BUFFER);
+    }
+    if (anillo->bloques) {
+        munmap(anillo->bloques, (size_t)BLOQUES_ANILLO * TAMANO_BLOQUE_ANILLO);
+    }
+}
+
+// Cada hilo avisa aquí de que intentó habilitar su anillo; iniciar_anillos() los espera.
+static sem_t anillos_arrancados;
+
+static void *hilo_anillo(void *arg) {
+    AnilloServidor *anillo = (AnilloServidor *)arg;
+    // El anillo se creó deshabilitado: al habilitarlo desde este hilo, este queda como
+    // su único emisor (IORING_SETUP_SINGLE_ISSUER). Si no se puede, el hilo sale sin
+    // tocar el socket de escucha y iniciar_anillos() pasa todos los sockets a otro motor.
+    anillo->habilitado = syscall(__NR_io_uring_register, anillo->anillo_fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) == 0;
+    if (!anillo->habilitado) {
+        perror("[ANILLO] Error habilitando el anillo");
+        liberar_anillo(anillo);
+    }
+    sem_post(&anillos_arrancados);
+    if (!anillo->habilitado) {
+        return NULL;
+    }
+    DIAG_INFO("[ANILLO %d] Anillo iniciado sobre el socket %d.\n", anillo->id, anillo->escucha_fd);
+
+    int cortadas = -1;
+    for (;;) {
+        if (atomic_load_explicit(&anillo->abandonar, memory_order_relaxed)) {
+            break;
+        }
+        if (!servidor_corriendo && !anillo->limite_drenaje) {
+            empezar_drenaje(anillo);
+        }
+        if (anillo->limite_drenaje) {
+            if (anillo->conexiones_activas == 0 && anillo->aceptaciones_en_vuelo == 0) {
+                break;
+            }
+            if (anillo->ahora >= anillo->limite_drenaje) {
+                if (cortadas >= 0) {
+                    break; // ni el segundo de margen bastó
+                }
+                // Vencido el plazo se cortan las que queden y se da un segundo para que
+                // vuelvan sus operaciones y se cierren.
+                cortadas = anillo->conexiones_activas;
+                while (anillo->menos_reciente) {
+                    cortar_conexion(anillo, anillo->menos_reciente);
+                }
+                anillo->limite_drenaje = anillo->ahora + 1;
+            }
+        }
+        armar_aceptaciones(anillo);
+        reintentar_cierres(anillo);
+        if (entregar(anillo, anillo->limite_drenaje ? 100 : 1000) < 0 &&
+            errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("[ANILLO] Error en io_uring_enter");
+            break;
+        }
+        anillo->ahora = time(NULL);
+        recoger_completados(anillo);
+        cerrar_inactivas(anillo);
+    }
+
+    int sin_cerrar = anillo->conexiones_activas;
+    liberar_anillo(anillo);
+    DIAG_INFO("[ANILLO %d] Anillo finalizado; %d conexiones cortadas al vencer el plazo%s.\n", anillo->id,
+              cortadas > 0 ? cortadas : 0, sin_cerrar ? " (alguna sin cerrar)" : "");
+    return NULL;
+}
+
+// Crea el anillo deshabilitado, mapea sus colas y registra la tabla de descriptores
+// fijos, los bloques para leer archivos y el anillo de búferes de recepción.
+static int preparar_anillo(AnilloServidor *anillo) {
+    struct io_uring_params parametros;
+    memset(&parametros, 0, sizeof(parametros));
+    parametros.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_R_DISABLED |
+                       IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    parametros.cq_entries = ENTRADAS_CQ;
+    int fd = (int)syscall(__NR_io_uring_setup, ENTRADAS_SQ, &parametros);
+    if (fd < 0 && errno == EINVAL) {
+        // Núcleos anteriores a 6.1: los completados se procesan sin esperar al hilo.
+        memset(&parametros, 0, sizeof(parametros));
+        parametros.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_R_DISABLED;
+        parametros.cq_entries = ENTRADAS_CQ;
+        fd = (int)syscall(__NR_io_uring_setup, ENTRADAS_SQ, &parametros);
+    }
+    if (fd < 0) {
+        perror("[ANILLO] Error en io_uring_setup");
+        return -1;
+    }
+    anillo->anillo_fd = fd;
+    unsigned necesarias = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    if ((parametros.features & necesarias) != necesarias) {
+        fprintf(stderr, "[ANILLO] El núcleo no ofrece las funciones de io_uring necesarias.\n");
+        return -1;
+    }
+
+    size_t tam_sq = parametros.sq_off.array + parametros.sq_entries * sizeof(unsigned);
+    size_t tam_cq = parametros.cq_off.cqes + parametros.cq_entries * sizeof(struct io_uring_cqe);
+    anillo->tam_mapa_colas = tam_sq > tam_cq ? tam_sq : tam_cq;
+    char *colas = mmap(NULL, anillo->tam_mapa_colas, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+    if (colas == MAP_FAILED) {
+        perror("[ANILLO] Error mapeando las colas");
+        return -1;
+    }
+    anillo->mapa_colas = colas;
+    anillo->tam_mapa_sqes = parametros.sq_entries * sizeof(struct io_uring_sqe);
+    struct io_uring_sqe *sqes = mmap(NULL, anillo->tam_mapa_sqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        perror("[ANILLO] Error mapeando las entradas de envío");
+        return -1;
+    }
+    anillo->sqes = sqes;
+    anillo->sq_cabeza = (_Atomic unsigned *)(colas + parametros.sq_off.head);
+    anillo->sq_cola = (_Atomic unsigned *)(colas + parametros.sq_off.tail);
+    anillo->sq_mascara = *(unsigned *)(colas + parametros.sq_off.ring_mask);
+    anillo->sq_entradas = parametros.sq_entries;
+    anillo->sq_preparadas = atomic_load(anillo->sq_cola);
+    unsigned *indices = (unsigned *)(colas + parametros.sq_off.array);
+    for (unsigned i = 0; i < parametros.sq_entries; i++) {
+        indices[i] = i; // la entrada i de la SQ es siempre el hueco i
+    }
+    anillo->cq_cabeza = (_Atomic unsigned *)(colas + parametros.cq_off.head);
+    anillo->cq_cola = (_Atomic unsigned *)(colas + parametros.cq_off.tail);
+    anillo->cq_mascara = *(unsigned *)(colas + parametros.cq_off.ring_mask);
+    anillo->cqes = (struct io_uring_cqe *)(colas + parametros.cq_off.cqes);
+
+    // Tabla de descriptores fijos vacía: cada accept ocupa la primera ranura libre.
+    struct io_uring_rsrc_register tabla;
+    memset(&tabla, 0, sizeof(tabla));
+    tabla.nr = MAX_CONEXIONES_ANILLO;
+    tabla.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES2, &tabla, sizeof(tabla)) < 0) {
+        perror("[ANILLO] Error registrando la tabla de descriptores fijos");
+        return -1;
+    }
+
+    // Los bloques registrados quedan fijados en memoria; si el límite de memoria
+    // bloqueada no lo permite, se leen igual pero sin registrar.
+    size_t tam_bloques = (size_t)BLOQUES_ANILLO * TAMANO_BLOQUE_ANILLO;
+    anillo->bloques = mmap(NULL, tam_bloques, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (anillo->bloques == MAP_FAILED) {
+        anillo->bloques = NULL;
+        perror("[ANILLO] Error reservando los bloques");
+        return -1;
+    }
+    struct iovec bloques[BLOQUES_ANILLO];
+    for (int i = 0; i < BLOQUES_ANILLO; i++) {
+        bloques[i].iov_base = anillo->bloques + (size_t)i * TAMANO_BLOQUE_ANILLO;
+        bloques[i].iov_len = TAMANO_BLOQUE_ANILLO;
+        anillo->bloques_libres[i] = BLOQUES_ANILLO - 1 - i;
+    }
+    anillo->num_bloques_libres = BLOQUES_ANILLO;
+    anillo->bloques_registrados =
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, bloques, BLOQUES_ANILLO) == 0;
+    if (!anillo->bloques_registrados) {
+        DIAG_AVISO("[ANILLO %d] Bloques sin registrar (%s); se leen sin búferes fijos.\n", anillo->id, strerror(errno));
+    }
+
+    size_t tam_buferes = (size_t)BUFERES_RECEPCION * TAMANO_BUFFER;
+    anillo->memoria_buferes = mmap(NULL, tam_buferes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    anillo->buferes = mmap(NULL, BUFERES_RECEPCION * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (anillo->memoria_buferes == MAP_FAILED || anillo->buferes == MAP_FAILED) {
+        anillo->memoria_buferes = anillo->memoria_buferes == MAP_FAILED ? NULL : anillo->memoria_buferes;
+        anillo->buferes = anillo->buferes == MAP_FAILED ? NULL : anillo->buferes;
+        perror("[ANILLO] Error reservando los búferes de recepción");
+        return -1;
+    }
+    struct io_uring_buf_reg registro;
+    memset(&registro, 0, sizeof(registro));
+    registro.ring_addr = (uint64_t)(uintptr_t)anillo->buferes;
+    registro.ring_entries = BUFERES_RECEPCION;
+    registro.bgid = GRUPO_BUFERES;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &registro, 1) < 0) {
+        perror("[ANILLO] Error registrando el anillo de búferes");
+        return -1;
+    }
+    for (unsigned i = 0; i < BUFERES_RECEPCION; i++) {
+        devolver_bufer(anillo, i);
+    }
+    return 0;
+}
+
+static pthread_t hilos_anillos[MAX_REACTORES];
+static int num_hilos_anillos;
+static AnilloServidor *anillos;
+
+// Espera a que todos los anillos terminen de drenar; devuelve 0.
+int detener_anillos(void) {
+    for (int i = 0; i < num_hilos_anillos; i++) {
+        pthread_join(hilos_anillos[i], NULL);
+    }
+    num_hilos_anillos = 0;
+    free(anillos);
+    anillos = NULL;
+    return 0;
+}
+
+// Arranca un anillo por socket de escucha. Todos se preparan antes de lanzar ningún
+// hilo: si el núcleo no permite io_uring se devuelve -1 sin haber tocado los sockets,
+// y el llamante puede atenderlos con otro motor. Si falla un hilo o no puede habilitar
+// su anillo, los anillos ya lanzados se paran sin cerrar sus sockets y también se
+// devuelve -1.
+int iniciar_anillos(int *sockets_escucha, int num_anillos, BufferPaginas *buffer) {
+    anillos = calloc(num_anillos, sizeof(AnilloServidor));
+    if (!anillos) {
+        perror("[ANILLO] Error reservando memoria para los anillos");
+        return -1;
+    }
+    for (int i = 0; i < num_anillos; i++) {
+        AnilloServidor *anillo = &anillos[i];
+        anillo->id = i;
+        anillo->anillo_fd = -1;
+        anillo->escucha_fd = sockets_escucha[i];
+        anillo->buffer_paginas = buffer;
+        anillo->ahora = time(NULL);
+        iniciar_losa(&anillo->conexiones, sizeof(ConexionAnillo), CONEXIONES_POR_TRAMO);
+        iniciar_losa(&anillo->peticiones, sizeof(PeticionEnCurso), PETICIONES_POR_TRAMO);
+        if (preparar_anillo(anillo) != 0) {
+            for (int j = 0; j <= i; j++) {
+                liberar_anillo(&anillos[j]);
+            }
+            free(anillos);
+            anillos = NULL;
+            return -1;
+        }
+    }
+
+    sem_init(&anillos_arrancados, 0, 0);
+    int fallo = 0;
+    for (int i = 0; i < num_anillos && !fallo; i++) {
+        if (pthread_create(&hilos_anillos[num_hilos_anillos], NULL, hilo_anillo, &anillos[i]) != 0) {
+            perror("[ANILLO] Error al crear hilo del anillo");
+            fallo = 1;
+        } else {
+            num_hilos_anillos++;
+        }
+    }
+    for (int i = 0; i < num_hilos_anillos; i++) {
+        while (sem_wait(&anillos_arrancados) != 0 && errno == EINTR) {
+        }
+    }
+    for (int i = 0; i < num_hilos_anillos; i++) {
+        fallo |= !anillos[i].habilitado;
+    }
+    sem_destroy(&anillos_arrancados);
+    if (fallo) {
+        // El socket de un anillo sin hilo no lo atendería nadie: se paran los demás
+        // para que el llamante pase todos los sockets a otro motor.
+        for (int j = 0; j < num_hilos_anillos; j++) {
+            atomic_store(&anillos[j].abandonar, 1);
+        }
+        for (int j = num_hilos_anillos; j < num_anillos; j++) {
+            liberar_anillo(&anillos[j]);
+        }
+        detener_anillos();
+        return -1;
+    }
+    DIAG_INFO("[ANILLO] %d anillos io_uring en ejecución (bloques %sregistrados).\n", num_anillos,
+              anillos[0].bloques_registrados ? "" : "no ");
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "servidor_web.h"
+
+// Analizador incremental de peticiones HTTP/1.x. Trabaja sobre el buffer de recepción
+// sin copiar nada: método, ruta, consulta, versión y encabezados son vistas (puntero y
+// longitud) dentro de ese buffer. Se llama tras cada recv() con todos los bytes
+// acumulados y retoma en la primera línea que aún no había terminado, así que cada
+// byte se examina una vez por línea completa. Una entrada mal formada se rechaza en
+// cuanto aparece, sin esperar al final de los encabezados.
+
+enum {
+    ANALISIS_LINEA_PETICION,
+    ANALISIS_ENCABEZADOS,
+    ANALISIS_CUERPO
+};
+
+// Caracteres válidos en un token (métodos y nombres de encabezado, RFC 9110 5.6.2).
+static int es_tchar(unsigned char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return 1;
+    }
+    switch (c) {
+    case '!': case '#': case '$': case '%': case '&': case '\'': case '*': case '+':
+    case '-': case '.': case '^': case '_': case '`': case '|': case '~':
+        return 1;
+    }
+    return 0;
+}
+
+// Controles que no pueden aparecer en ninguna parte de una línea (se admite el tabulador).
+static int es_control(unsigned char c) {
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+static int vista_igual(VistaCadena vista, const char *texto) {
+    size_t tam = strlen(texto);
+    return vista.longitud == tam && strncasecmp(vista.datos, texto, tam) == 0;
+}
+
+void iniciar_peticion_http(PeticionHttp *peticion) {
+    peticion->fase = ANALISIS_LINEA_PETICION;
+    peticion->analizados = 0;
+    peticion->revisados = 0;
+    peticion->tam_cuerpo = 0;
+    peticion->hay_longitud = 0;
+    peticion->longitud = 0;
+    peticion->num_encabezados = 0;
+    peticion->consulta.datos = NULL;
+    peticion->consulta.longitud = 0;
+}
+
+// Método SP destino SP HTTP/1.x. El destino se parte en ruta y consulta en el '?'.
+static int analizar_linea_peticion(PeticionHttp *peticion, const char *linea, size_t tam,
+                                   const LimitesHttp *limites) {
+    if (tam > limites->max_uri + 32) {
+        return -414; // el mismo tope que se aplica mientras la línea está incompleta
+    }
+    const char *fin = linea + tam;
+    const char *p = linea;
+    while (p < fin && es_tchar((unsigned char)*p)) {
+        p++;
+    }
+    if (p == linea || p == fin || *p != ' ') {
+        return -400;
+    }
+    peticion->metodo.datos = linea;
+    peticion->metodo.longitud = p - linea;
+
+    const char *destino = ++p;
+    while (p < fin && *p != ' ') {
+        if (es_control((unsigned char)*p) || *p == '\t') {
+            return -400;
+        }
+        p++;
+    }
+    if (p == destino || p == fin) {
+        return -400;
+    }
+    if ((size_t)(p - destino) > limites->max_uri) {
+        return -414;
+    }
+    const char *interrogacion = memchr(destino, '?', p - destino);
+    peticion->ruta.datos = destino;
+    peticion->ruta.longitud = (interrogacion ? interrogacion : p) - destino;
+    if (interrogacion) {
+        peticion->consulta.datos = interrogacion + 1;
+        peticion->consulta.longitud = p - interrogacion - 1;
+    }
+
+    const char *version = ++p;
+    if (fin - version != 8 || memcmp(version, "HTTP/", 5) != 0 || version[6] != '.' ||
+        version[5] < '0' || version[5] > '9' || version[7] < '0' || version[7] > '9') {
+        return -400;
+    }
+    if (version[5] != '1') {
+        return -505;
+    }
+    peticion->version.datos = version;
+    peticion->version.longitud = 8;
+    peticion->version_menor = version[7] - '0';
+    return 0;
+}
+
+// nombre ":" OWS valor OWS. Content-Length se valida aquí para rechazar pronto un
+// cuerpo demasiado grande o contradictorio.
+static int analizar_encabezado(PeticionHttp *peticion, const char *linea, size_t tam,
+                               const LimitesHttp *limites) {
+    const char *fin = linea + tam;
+    const char *p = linea;
+    while (p < fin && es_tchar((unsigned char)*p)) {
+        p++;
+    }
+    if (p == linea || p == fin || *p != ':') {
+        return -400; // incluye el plegado obsoleto (línea que empieza por espacio)
+    }
+    if (peticion->num_encabezados >= limites->max_encabezados) {
+        return -431;
+    }
+    EncabezadoHttp *encabezado = &peticion->encabezados[peticion->num_encabezados++];
+    encabezado->nombre.datos = linea;
+    encabezado->nombre.longitud = p - linea;
+
+    p++;
+    while (p < fin && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (fin > p && (fin[-1] == ' ' || fin[-1] == '\t')) {
+        fin--;
+    }
+    for (const char *c = p; c < fin; c++) {
+        if (es_control((unsigned char)*c)) {
+            return -400;
+        }
+    }
+    encabezado->valor.datos = p;
+    encabezado->valor.longitud = fin - p;
+
+    if (vista_igual(encabezado->nombre, "Content-Length")) {
+        if (p == fin) {
+            return -400;
+        }
+        size_t numero = 0;
+        for (const char *c = p; c < fin; c++) {
+            if (*c < '0' || *c > '9') {
+                return -400;
+            }
+            numero = numero * 10 + (*c - '0');
+            if (numero > limites->max_cuerpo) {
+                return -413;
+            }
+        }
+        if (peticion->hay_longitud && numero != peticion->tam_cuerpo) {
+            return -400;
+        }
+        peticion->hay_longitud = 1;
+        peticion->tam_cuerpo = numero;
+    } else if (vista_igual(encabezado->nombre, "Transfer-Encoding")) {
+        return -501; // los cuerpos por trozos no se admiten
+    }
+    return 0;
+}
+
+// Revisa la línea que todavía no tiene su '\n' desde donde se quedó la vez anterior: si
+// ya es inválida o demasiado larga no hace falta esperar al resto.
+static int revisar_linea_incompleta(const PeticionHttp *peticion, const char *linea, size_t tam, size_t desde,
+                                    const LimitesHttp *limites) {
+    for (size_t i = desde; i < tam; i++) {
+        if (es_control((unsigned char)linea[i]) && linea[i] != '\r') {
+            return -400;
+        }
+    }
+    if (peticion->fase == ANALISIS_LINEA_PETICION) {
+        if (tam > 0 && !es_tchar((unsigned char)linea[0]) && linea[0] != '\r') {
+            return -400;
+        }
+        return tam > limites->max_uri + 32 ? -414 : 0; // 32: método, espacios y versión
+    }
+    return 0;
+}
+
+// Analiza lo que haya llegado de la petición que empieza en 'datos'. Devuelve
+// ANALISIS_COMPLETO con 'longitud' (encabezados y cuerpo), ANALISIS_INCOMPLETO si faltan
+// bytes, o el código de estado HTTP con signo negativo con que hay que rechazarla.
+int analizar_peticion(PeticionHttp *peticion, const char *datos, size_t leidos, const LimitesHttp *limites) {
+    while (peticion->fase != ANALISIS_CUERPO) {
+        size_t inicio = peticion->analizados;
+        size_t desde = peticion->revisados > inicio ? peticion->revisados : inicio;
+        const char *salto = memchr(datos + desde, '\n', leidos - desde);
+        if (!salto) {
+            int error = revisar_linea_incompleta(peticion, datos + inicio, leidos - inicio, desde - inicio, limites);
+            if (error) {
+                return error;
+            }
+            peticion->revisados = leidos;
+            if (leidos >= TAMANO_BUFFER - 1) {
+                return peticion->fase == ANALISIS_LINEA_PETICION ? -414 : -431;
+            }
+            return ANALISIS_INCOMPLETO;
+        }
+        size_t tam = salto - (datos + inicio);
+        if (tam > 0 && datos[inicio + tam - 1] == '\r') {
+            tam--;
+        }
+        peticion->analizados = (salto - datos) + 1;
+
+        int error = 0;
+        if (peticion->fase == ANALISIS_LINEA_PETICION) {
+            if (tam == 0) {
+                continue; // se ignoran las líneas vacías antes de la petición (RFC 9112 2.2)
+            }
+            error = analizar_linea_peticion(peticion, datos + inicio, tam, limites);
+            peticion->fase = ANALISIS_ENCABEZADOS;
+        } else if (tam == 0) {
+            peticion->fase = ANALISIS_CUERPO;
+        } else {
+            error = analizar_encabezado(peticion, datos + inicio, tam, limites);
+        }
+        if (error) {
+            return error;
+        }
+    }
+
+    size_t total = peticion->analizados + peticion->tam_cuerpo;
+    if (total > TAMANO_BUFFER - 1) {
+        return -413;
+    }
+    if (total > leidos) {
+        return ANALISIS_INCOMPLETO;
+    }
+    peticion->longitud = total;
+    return ANALISIS_COMPLETO;
+}
+
+// Devuelve el valor del primer encabezado con ese nombre (sin distinguir mayúsculas),
+// o NULL si la petición no lo trae.
+const VistaCadena *buscar_encabezado(const PeticionHttp *peticion, const char *nombre) {
+    for (int i = 0; i < peticion->num_encabezados; i++) {
+        if (vista_igual(peticion->encabezados[i].nombre, nombre)) {
+            return &peticion->encabezados[i].valor;
+        }
+    }
+    return NULL;
+}
+
+// Indica si una lista separada por comas (p. ej. Connection) contiene 'token'.
+int contiene_token(VistaCadena lista, const char *token) {
+    const char *p = lista.datos;
+    const char *fin = lista.datos + lista.longitud;
+    while (p < fin) {
+        while (p < fin && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *inicio = p;
+        while (p < fin && *p != ',') {
+            p++;
+        }
+        const char *fin_token = p;
+        while (fin_token > inicio && (fin_token[-1] == ' ' || fin_token[-1] == '\t')) {
+            fin_token--;
+        }
+        VistaCadena elemento = {inicio, fin_token - inicio};
+        if (vista_igual(elemento, token)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include "servidor_web.h"
+
+// Inicializa la cola de conexiones. La capacidad debe ser potencia de 2.
+int inicializar_cola(ColaConexiones *cola, int capacidad, PoliticaContrapresion politica, int limite_espera) {
+    cola->huecos = malloc(sizeof(HuecoCola) * capacidad);
+    if (!cola->huecos) {
+        perror("[POOL] Error reservando memoria para la cola de conexiones");
+        return -1;
+    }
+    for (int i = 0; i < capacidad; i++) {
+        atomic_init(&cola->huecos[i].secuencia, (size_t)i);
+    }
+    cola->mascara = (size_t)capacidad - 1;
+    atomic_init(&cola->pos_encolar, 0);
+    atomic_init(&cola->pos_desencolar, 0);
+    atomic_init(&cola->profundidad, 0);
+    atomic_init(&cola->cerrada, 0);
+    sem_init(&cola->elementos, 0, 0);
+    sem_init(&cola->libres, 0, capacidad);
+    cola->politica = politica;
+    pthread_mutex_init(&cola->mutex_espera, NULL);
+    cola->espera_inicio = NULL;
+    cola->espera_fin = NULL;
+    cola->num_espera = 0;
+    cola->limite_espera = limite_espera;
+    iniciar_losa(&cola->nodos_espera, sizeof(NodoEspera), 64);
+    return 0;
+}
+
+// Inserta en la cola circular. Solo se llama tras reservar un hueco en 'libres'.
+static void insertar_en_anillo(ColaConexiones *cola, int cliente_fd, int entrada_cliente, uint64_t encolado_ns) {
+    size_t pos = atomic_load_explicit(&cola->pos_encolar, memory_order_relaxed);
+    HuecoCola *hueco;
+    for (;;) {
+        hueco = &cola->huecos[pos & cola->mascara];
+        size_t secuencia = atomic_load_explicit(&hueco->secuencia, memory_order_acquire);
+        intptr_t diferencia = (intptr_t)secuencia - (intptr_t)pos;
+        if (diferencia == 0) {
+            if (atomic_compare_exchange_weak_explicit(&cola->pos_encolar, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else {
+            pos = atomic_load_explicit(&cola->pos_encolar, memory_order_relaxed);
+        }
+    }
+    hueco->cliente_fd = cliente_fd;
+    hueco->entrada_cliente = entrada_cliente;
+    hueco->encolado_ns = encolado_ns;
+    atomic_store_explicit(&hueco->secuencia, pos + 1, memory_order_release);
+}
+
+// Extrae de la cola circular. Devuelve -1 si está vacía en este momento.
+static int extraer_de_anillo(ColaConexiones *cola, uint64_t *encolado_ns, int *entrada_cliente) {
+    size_t pos = atomic_load_explicit(&cola->pos_desencolar, memory_order_relaxed);
+    HuecoCola *hueco;
+    for (;;) {
+        hueco = &cola->huecos[pos & cola->mascara];
+        size_t secuencia = atomic_load_explicit(&hueco->secuencia, memory_order_acquire);
+        intptr_t diferencia = (intptr_t)secuencia - (intptr_t)(pos + 1);
+        if (diferencia == 0) {
+            if (atomic_compare_exchange_weak_explicit(&cola->pos_desencolar, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diferencia < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&cola->pos_desencolar, memory_order_relaxed);
+        }
+    }
+    int cliente_fd = hueco->cliente_fd;
+    *entrada_cliente = hueco->entrada_cliente;
+    *encolado_ns = hueco->encolado_ns;
+    atomic_store_explicit(&hueco->secuencia, pos + cola->mascara + 1, memory_order_release);
+    return cliente_fd;
+}
+
+// Añade una conexión a la lista de espera. Devuelve -1 si la lista está llena.
+static int desbordar_a_espera(ColaConexiones *cola, int cliente_fd, int entrada_cliente, uint64_t encolado_ns) {
+    pthread_mutex_lock(&cola->mutex_espera);
+    if (cola->num_espera >= cola->limite_espera) {
+        pthread_mutex_unlock(&cola->mutex_espera);
+        return -1;
+    }
+    NodoEspera *nodo = tomar_de_losa(&cola->nodos_espera);
+    if (!nodo) {
+        pthread_mutex_unlock(&cola->mutex_espera);
+        return -1;
+    }
+    nodo->cliente_fd = cliente_fd;
+    nodo->entrada_cliente = entrada_cliente;
+    nodo->encolado_ns = encolado_ns;
+    nodo->siguiente = NULL;
+    if (cola->espera_fin) {
+        cola->espera_fin->siguiente = nodo;
+    } else {
+        cola->espera_inicio = nodo;
+    }
+    cola->espera_fin = nodo;
+    cola->num_espera++;
+    pthread_mutex_unlock(&cola->mutex_espera);
+    return 0;
+}
+
+// Toma la conexión más antigua de la lista de espera, o -1 si está vacía.
+static int tomar_de_espera(ColaConexiones *cola, uint64_t *encolado_ns, int *entrada_cliente) {
+    pthread_mutex_lock(&cola->mutex_espera);
+    NodoEspera *nodo = cola->espera_inicio;
+    if (!nodo) {
+        pthread_mutex_unlock(&cola->mutex_espera);
+        return -1;
+    }
+    cola->espera_inicio = nodo->siguiente;
+    if (!cola->espera_inicio) {
+        cola->espera_fin = NULL;
+    }
+    cola->num_espera--;
+    int cliente_fd = nodo->cliente_fd;
+    *entrada_cliente = nodo->entrada_cliente;
+    *encolado_ns = nodo->encolado_ns;
+    devolver_a_losa(&cola->nodos_espera, nodo);
+    pthread_mutex_unlock(&cola->mutex_espera);
+    return cliente_fd;
+}
+
+// Encola una conexión aceptada, con su entrada en la tabla de límites por IP, aplicando
+// la política de contrapresión. Devuelve 0 si quedó encolada y -1 si se debe rechazar.
+int encolar_conexion(ColaConexiones *cola, int cliente_fd, int entrada_cliente) {
+    uint64_t ahora = tiempo_monotonico_ns();
+
+    switch (cola->politica) {
+    case POLITICA_BLOQUEAR:
+        // Las señales las recibe el hilo de signalfd, así que la espera no vuelve con EINTR
+        // al apagar: se espera a plazos cortos para ver servidor_corriendo y no retrasar
+        // el drenaje. Al apagar se rechaza como con la cola llena.
+        while (sem_trywait(&cola->libres) != 0) {
+            if (!servidor_corriendo) {
+                return -1;
+            }
+            struct timespec plazo;
+            clock_gettime(CLOCK_REALTIME, &plazo);
+            plazo.tv_nsec += 100000000;
+            if (plazo.tv_nsec >= 1000000000) {
+                plazo.tv_sec++;
+                plazo.tv_nsec -= 1000000000;
+            }
+            if (sem_timedwait(&cola->libres, &plazo) == 0) {
+                break;
+            }
+            if (errno != ETIMEDOUT && errno != EINTR) {
+                return -1;
+            }
+        }
+        insertar_en_anillo(cola, cliente_fd, entrada_cliente, ahora);
+        break;
+    case POLITICA_RECHAZAR:
+        if (sem_trywait(&cola->libres) != 0) {
+            return -1;
+        }
+        insertar_en_anillo(cola, cliente_fd, entrada_cliente, ahora);
+        break;
+    case POLITICA_DESBORDAR:
+        // Mientras haya conexiones esperando, las nuevas van detrás de ellas para respetar el orden.
+        if (__atomic_load_n(&cola->num_espera, __ATOMIC_RELAXED) == 0 && sem_trywait(&cola->libres) == 0) {
+            insertar_en_anillo(cola, cliente_fd, entrada_cliente, ahora);
+        } else if (desbordar_a_espera(cola, cliente_fd, entrada_cliente, ahora) != 0) {
+            return -1;
+        }
+        break;
+    }
+
+    atomic_fetch_add_explicit(&cola->profundidad, 1, memory_order_relaxed);
+    sem_post(&cola->elementos);
+    return 0;
+}
+
+// Bloquea hasta obtener una conexión. Devuelve el descriptor, su entrada en la tabla de
+// límites y el tiempo que esperó en la cola, o -1 si la cola está cerrada y vacía.
+int desencolar_conexion(ColaConexiones *cola, uint64_t *espera_ns, int *entrada_cliente) {
+    while (sem_wait(&cola->elementos) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    // 'elementos' garantiza que hay una conexión reservada para este hilo, en el anillo
+    // o en la lista de espera; se reintenta si otro hilo tomó la que estaba a la vista.
+    uint64_t encolado_ns = 0;
+    int cliente_fd;
+    for (;;) {
+        cliente_fd = extraer_de_anillo(cola, &encolado_ns, entrada_cliente);
+        if (cliente_fd >= 0) {
+            sem_post(&cola->libres);
+            break;
+        }
+        cliente_fd = tomar_de_espera(cola, &encolado_ns, entrada_cliente);
+        if (cliente_fd >= 0) {
+            break;
+        }
+        if (atomic_load_explicit(&cola->cerrada, memory_order_acquire)) {
+            return -1; // aviso de cierre: ya nadie encola, así que no hay nada en vuelo
+        }
+        sched_yield();
+    }
+
+    atomic_fetch_sub_explicit(&cola->profundidad, 1, memory_order_relaxed);
+    *espera_ns = tiempo_monotonico_ns() - encolado_ns;
+    return cliente_fd;
+}
+
+static PoolArgs *args_pool;
+static int num_hilos_pool;
+static _Atomic int hilos_pool_vivos;
+
+// Bucle de cada hilo del pool: toma conexiones de la cola y las atiende. Al apagar
+// sigue hasta vaciar la cola: las conexiones ya aceptadas también se atienden.
+static void *hilo_pool(void *arg) {
+    PoolArgs *pool_args = (PoolArgs *)arg;
+    ColaConexiones *cola = pool_args->cola;
+
+    DIAG_INFO("[POOL %d] Hilo del pool iniciado.\n", pool_args->id);
+
+    for (;;) {
+        uint64_t espera_ns;
+        int entrada_cliente;
+        int cliente_fd = desencolar_conexion(cola, &espera_ns, &entrada_cliente);
+        if (cliente_fd < 0) {
+            if (atomic_load_explicit(&cola->cerrada, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+
+        registrar_latencia(FASE_COLA, espera_ns);
+        DIAG_DEPURACION("[POOL %d] Conexión tomada de la cola tras esperar %.3f ms (profundidad: %d)\n",
+                        pool_args->id, espera_ns / 1e6, atomic_load_explicit(&cola->profundidad, memory_order_relaxed));
+
+        TrabajadorArgs args_trabajador;
+        args_trabajador.cliente_fd = cliente_fd;
+        args_trabajador.entrada_cliente = entrada_cliente;
+        args_trabajador.buffer_paginas = pool_args->buffer_paginas;
+        args_trabajador.en_servicio = &pool_args->en_servicio;
+        hilo_trabajador(&args_trabajador);
+    }
+    atomic_fetch_sub(&hilos_pool_vivos, 1);
+    return NULL;
+}
+
+// Arranca el pool de hilos trabajadores de tamaño fijo.
+int iniciar_pool(ColaConexiones *cola, BufferPaginas *buffer, int num_trabajadores) {
+    PoolArgs *args = malloc(sizeof(PoolArgs) * num_trabajadores);
+    if (!args) {
+        perror("[POOL] Error reservando memoria para el pool");
+        return -1;
+    }
+
+    args_pool = args;
+    publicar_profundidad_cola(&cola->profundidad);
+    for (int i = 0; i < num_trabajadores; i++) {
+        args[i].id = i;
+        args[i].cola = cola;
+        args[i].buffer_paginas = buffer;
+        pthread_mutex_init(&args[i].en_servicio.mutex, NULL);
+        args[i].en_servicio.cliente_fd = -1;
+        atomic_init(&args[i].en_servicio.ociosa, 0);
+
+        pthread_t hilo;
+        if (pthread_create(&hilo, NULL, hilo_pool, &args[i]) != 0) {
+            perror("[POOL] Error al crear hilo del pool");
+            return -1;
+        }
+        pthread_detach(hilo);
+        num_hilos_pool++;
+        atomic_fetch_add(&hilos_pool_vivos, 1);
+    }
+    DIAG_INFO("[POOL] %d hilos trabajadores en ejecución.\n", num_trabajadores);
+    return 0;
+}
+
+// Apaga el pool una vez que el despachador ya no encola. Los hilos vacían la cola y
+// salen; las conexiones keep-alive que esperan otra petición se cortan enseguida y, al
+// vencer el plazo, todas las demás. Devuelve 0 si todos los hilos terminaron.
+int detener_pool(ColaConexiones *cola, int plazo_segundos) {
+    atomic_store_explicit(&cola->cerrada, 1, memory_order_release);
+    for (int i = 0; i < num_hilos_pool; i++) {
+        sem_post(&cola->elementos); // un aviso por hilo para despertar a los que esperan
+    }
+
+    uint64_t limite_ns = tiempo_monotonico_ns() + (uint64_t)plazo_segundos * 1000000000ULL;
+    int vueltas_tras_plazo = 0;
+    while (atomic_load(&hilos_pool_vivos) > 0) {
+        int vencido = tiempo_monotonico_ns() >= limite_ns;
+        if (vencido && vueltas_tras_plazo++ == 20) {
+            return -1; // un segundo después de cortarlas sigue habiendo hilos ocupados
+        }
+        for (int i = 0; i < num_hilos_pool; i++) {
+            ConexionEnServicio *en_servicio = &args_pool[i].en_servicio;
+            // Con el mutex tomado el hilo no puede cerrar el descriptor, y su número no
+            // puede pasar a otra conexión, entre leerlo y cortarlo.
+            pthread_mutex_lock(&en_servicio->mutex);
+            int cliente_fd = en_servicio->cliente_fd;
+            if (cliente_fd >= 0 && (vencido || atomic_load(&en_servicio->ociosa))) {
+                // Despierta el recv()/send() bloqueado; el propio hilo cierra el descriptor.
+                shutdown(cliente_fd, vencido ? SHUT_RDWR : SHUT_RD);
+            }
+            pthread_mutex_unlock(&en_servicio->mutex);
+        }
+        usleep(50000);
+    }
+    DIAG_INFO("[POOL] Todos los hilos del pool han terminado.\n");
+    return 0;
+}
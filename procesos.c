@@ -0,0 +1,187 @@
+#include "servidor_web.h"
+
+// Modo de procesos (SERVIDOR_PROCESOS=N). El maestro crea un socket de escucha con
+// SO_REUSEPORT por trabajador, carga la caché en el segmento compartido y lanza N
+// trabajadores con fork(), cada uno fijado a un núcleo. Un trabajador es un servidor
+// completo (motor, registro, vigilancia, drenaje) que solo acepta en su socket.
+// El maestro no atiende conexiones: reparte las señales y relanza al trabajador que
+// termine, así que un fallo en uno no tumba a los demás. Los sockets siguen abiertos en
+// el maestro: lo que llegue al de un trabajador caído espera en su cola de listen hasta
+// que arranque el siguiente.
+
+typedef struct {
+    pid_t pid;       // 0 si no está en marcha
+    time_t arranque;
+} ProcesoTrabajador;
+
+static ProcesoTrabajador trabajadores[MAX_PROCESOS];
+static int num_trabajadores = 0;
+static int indice_trabajador = -1; // en un trabajador, su número; en el maestro, -1
+static int apagando = 0;
+static pid_t pid_maestro;
+static int senal_fd_maestro;
+static cpu_set_t nucleos_maestro;  // núcleos permitidos al maestro, que se reparten
+
+// Número del trabajador que ejecuta este proceso, o -1 si no es un trabajador.
+int numero_trabajador(void) {
+    return indice_trabajador;
+}
+
+// Fija el proceso al núcleo que le toca entre los permitidos al maestro.
+static void fijar_nucleo(int indice) {
+    int total = CPU_COUNT(&nucleos_maestro);
+    if (total == 0) {
+        return;
+    }
+    int elegido = indice % total;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &nucleos_maestro) && elegido-- == 0) {
+            cpu_set_t nucleo;
+            CPU_ZERO(&nucleo);
+            CPU_SET(cpu, &nucleo);
+            if (sched_setaffinity(0, sizeof(nucleo), &nucleo) != 0) {
+                perror("[PROCESOS] Error fijando el núcleo del trabajador");
+            }
+            return;
+        }
+    }
+}
+
+// Lanza el trabajador 'indice'. El hijo no vuelve: atiende hasta que lo paren y sale.
+static int lanzar_trabajador(int indice) {
+    fflush(stdout); // que el hijo no repita lo que quede en el buffer de stdio
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[PROCESOS] Error en fork");
+        return -1;
+    }
+    if (pid > 0) {
+        trabajadores[indice].pid = pid;
+        trabajadores[indice].arranque = time(NULL);
+        return 0;
+    }
+
+    // Si el maestro muere sin parar a los trabajadores, estos drenan y terminan.
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != pid_maestro) {
+        _exit(EXIT_FAILURE);
+    }
+    indice_trabajador = indice;
+    num_trabajadores = 0; // la tabla heredada es del maestro: un trabajador no tiene hijos
+    if (config_global.fijar_cpu) {
+        fijar_nucleo(indice);
+    }
+    int propio = sockets_escucha[indice];
+    for (int i = 0; i < num_sockets_escucha; i++) {
+        if (i != indice) {
+            close(sockets_escucha[i]);
+        }
+    }
+    sockets_escucha[0] = propio;
+    num_sockets_escucha = 1;
+    config_global.num_reactores = 1;
+    exit(atender_conexiones(senal_fd_maestro));
+}
+
+// Reenvía una señal a todos los trabajadores. Devuelve a cuántos, 0 fuera del maestro.
+int reenviar_a_trabajadores(int senal) {
+    int enviadas = 0;
+    for (int i = 0; i < num_trabajadores; i++) {
+        if (trabajadores[i].pid > 0 && kill(trabajadores[i].pid, senal) == 0) {
+            enviadas++;
+        }
+    }
+    return enviadas;
+}
+
+// Se llama al recoger un hijo. Si era un trabajador lo relanza, salvo durante el
+// apagado; si muere nada más arrancar se espera un segundo para no relanzarlo en
+// bucle. Devuelve 1 si 'pid' era un trabajador.
+int trabajador_terminado(pid_t pid, int estado) {
+    for (int i = 0; i < num_trabajadores; i++) {
+        if (trabajadores[i].pid != pid) {
+            continue;
+        }
+        trabajadores[i].pid = 0;
+        olvidar_conexiones_trabajador(i);
+        if (apagando) {
+            return 1;
+        }
+        if (WIFSIGNALED(estado)) {
+            DIAG_ERROR("[PROCESOS] El trabajador %d (pid %d) murió por la señal %d; se relanza.\n",
+                       i, (int)pid, WTERMSIG(estado));
+        } else {
+            DIAG_AVISO("[PROCESOS] El trabajador %d (pid %d) terminó con estado %d; se relanza.\n",
+                       i, (int)pid, WEXITSTATUS(estado));
+        }
+        if (time(NULL) - trabajadores[i].arranque < 1) {
+            sleep(1);
+        }
+        lanzar_trabajador(i);
+        return 1;
+    }
+    return 0;
+}
+
+// Pide a los trabajadores que drenen y los espera. Al que siga vivo pasado el plazo de
+// drenaje (con un margen) se le mata.
+static void detener_trabajadores(void) {
+    apagando = 1;
+    reenviar_a_trabajadores(SIGTERM);
+    time_t limite = time(NULL) + config_global.plazo_drenaje + 2;
+    int vivos = 0;
+    for (int i = 0; i < num_trabajadores; i++) {
+        vivos += trabajadores[i].pid > 0;
+    }
+    while (vivos > 0) {
+        int estado;
+        pid_t pid = waitpid(-1, &estado, WNOHANG);
+        if (pid > 0) {
+            vivos -= trabajador_terminado(pid, estado);
+            continue;
+        }
+        if (pid < 0 && errno == ECHILD) {
+            break;
+        }
+        if (time(NULL) >= limite) {
+            DIAG_AVISO("[PROCESOS] %d trabajadores siguen vivos tras el plazo de drenaje; se matan.\n", vivos);
+            reenviar_a_trabajadores(SIGKILL);
+            limite = time(NULL) + 3600;
+        }
+        usleep(50000);
+    }
+}
+
+// Proceso maestro: lanza un trabajador por socket de escucha, los vigila hasta la
+// señal de apagado y los para. La caché ya está cargada en el segmento compartido.
+int ejecutar_maestro(int senal_fd) {
+    pid_maestro = getpid();
+    senal_fd_maestro = senal_fd;
+    if (sched_getaffinity(0, sizeof(nucleos_maestro), &nucleos_maestro) != 0) {
+        CPU_ZERO(&nucleos_maestro);
+    }
+    cerrar_segmento();
+    num_trabajadores = num_sockets_escucha;
+    for (int i = 0; i < num_trabajadores; i++) {
+        if (lanzar_trabajador(i) != 0) {
+            detener_trabajadores();
+            return EXIT_FAILURE;
+        }
+    }
+    DIAG_INFO("[PROCESOS] Maestro %d con %d trabajadores%s.\n", (int)pid_maestro, num_trabajadores,
+              config_global.fijar_cpu ? " fijados a núcleos" : "");
+    avisar_relevo_listo();
+
+    // El maestro no crea hilos: atiende las señales en el propio hilo principal, así que
+    // cada fork() parte de un proceso con un solo hilo.
+    hilo_senales(&senal_fd);
+    DIAG_INFO("[PROCESOS] Parando a los trabajadores (plazo de drenaje: %d s)...\n", config_global.plazo_drenaje);
+    detener_trabajadores();
+    for (int i = 0; i < num_sockets_escucha; i++) {
+        close(sockets_escucha[i]);
+    }
+    liberar_buffer(&buffer_global);
+    liberar_segmento();
+    DIAG_INFO("[PROCESOS] Maestro apagado limpiamente.\n");
+    return 0;
+}
@@ -1,23 +1,288 @@
 #include "servidor_web.h"
 
-pthread_mutex_t mutex_log = PTHREAD_MUTEX_INITIALIZER;
+// Registro de conexiones asíncrono. Cada hilo escribe sus líneas en un anillo propio
+// (un productor, un consumidor, sin bloqueos) y un único hilo de volcado las recoge
+// por lotes y las escribe con writev() sobre el archivo de log, que se mantiene abierto.
+// Ninguna petición espera a que el disco termine de escribir.
+// Los mensajes de diagnóstico (macros DIAG_*) usan los mismos anillos, con la salida
+// estándar o la de errores como destino en lugar del archivo de log.
 
-//función para incluir la página solicitada en el log
+volatile int nivel_diagnostico = NIVEL_INFO;
+
+static AnilloRegistro *anillos[MAX_ANILLOS_REGISTRO];
+static _Atomic int num_anillos = 0;
+static pthread_mutex_t mutex_anillos = PTHREAD_MUTEX_INITIALIZER;
+static __thread AnilloRegistro *anillo_hilo = NULL;
+static __thread int anillo_agotado = 0;
+
+// Descartes de hilos que no pudieron registrar un anillo propio.
+static _Atomic unsigned long descartes_sin_anillo = 0;
+
+static int log_fd = -1;
+static volatile int registro_activo = 0;
+static pthread_t hilo_volcado;
+static int capacidad_anillo;
+static int intervalo_ms;
+static int lote_registro;
+static int politica_registro;
+static sem_t aviso_volcado; // despierta al hilo de volcado antes del intervalo
+
+// Devuelve el anillo del hilo actual, creándolo la primera vez.
+static AnilloRegistro *anillo_local(void) {
+    if (anillo_hilo || anillo_agotado) {
+        return anillo_hilo;
+    }
+    AnilloRegistro *anillo = aligned_alloc(64, sizeof(AnilloRegistro));
+    LineaRegistro *lineas = anillo ? malloc(sizeof(LineaRegistro) * capacidad_anillo) : NULL;
+    if (!lineas) {
+        free(anillo);
+        anillo_agotado = 1;
+        return NULL;
+    }
+    anillo->lineas = lineas;
+    anillo->mascara = capacidad_anillo - 1;
+    atomic_init(&anillo->cabeza, 0);
+    atomic_init(&anillo->cola, 0);
+    atomic_init(&anillo->descartados, 0);
+
+    pthread_mutex_lock(&mutex_anillos);
+    int indice = atomic_load(&num_anillos);
+    if (indice >= MAX_ANILLOS_REGISTRO) {
+        pthread_mutex_unlock(&mutex_anillos);
+        free(lineas);
+        free(anillo);
+        anillo_agotado = 1;
+        return NULL;
+    }
+    anillos[indice] = anillo;
+    atomic_store_explicit(&num_anillos, indice + 1, memory_order_release);
+    pthread_mutex_unlock(&mutex_anillos);
+
+    anillo_hilo = anillo;
+    return anillo;
+}
+
+// Reserva la siguiente línea libre del anillo del hilo, aplicando la política si está
+// lleno. Devuelve NULL si la línea se descarta.
+static LineaRegistro *reservar_linea(AnilloRegistro **anillo_out) {
+    AnilloRegistro *anillo = anillo_local();
+    if (!anillo) {
+        atomic_fetch_add_explicit(&descartes_sin_anillo, 1, memory_order_relaxed);
+        return NULL;
+    }
+    size_t cabeza = atomic_load_explicit(&anillo->cabeza, memory_order_relaxed);
+    while (cabeza - atomic_load_explicit(&anillo->cola, memory_order_acquire) > anillo->mascara) {
+        if (politica_registro == REGISTRO_DESCARTAR || !registro_activo) {
+            atomic_fetch_add_explicit(&anillo->descartados, 1, memory_order_relaxed);
+            return NULL;
+        }
+        // Política bloquear: se espera a que el hilo de volcado libere espacio.
+        usleep(100);
+    }
+    *anillo_out = anillo;
+    return &anillo->lineas[cabeza & anillo->mascara];
+}
+
+// Publica la línea reservada para el hilo de volcado. Si con ella el anillo junta un
+// lote completo se avisa al hilo de volcado sin esperar al intervalo.
+static void publicar_linea(AnilloRegistro *anillo) {
+    size_t cabeza = atomic_load_explicit(&anillo->cabeza, memory_order_relaxed) + 1;
+    atomic_store_explicit(&anillo->cabeza, cabeza, memory_order_release);
+    if (cabeza - atomic_load_explicit(&anillo->cola, memory_order_relaxed) == (size_t)lote_registro) {
+        sem_post(&aviso_volcado);
+    }
+}
+
+// Fija la longitud de una línea recién formateada; si no cabía se corta y se
+// mantiene el salto de línea final.
+static void ajustar_longitud(LineaRegistro *linea, int n) {
+    if (n < 0 || (size_t)n >= sizeof(linea->texto)) {
+        n = sizeof(linea->texto) - 1;
+        linea->texto[n - 1] = '\n';
+    }
+    linea->longitud = n;
+}
+
+//función para incluir la página solicitada en el log. Solo formatea la línea en el
+//anillo del hilo; la escritura en disco la hace el hilo de volcado.
 void registrar_conexion(const char *ip, int puerto, const char *pagina_solicitada) {
-    FILE *archivo = fopen(LOG_ARCHIVO, "a");
-    if (!archivo) {
-        perror("Error al abrir archivo de log");
+    AnilloRegistro *anillo;
+    LineaRegistro *linea = reservar_linea(&anillo);
+    if (!linea) {
+        return;
+    }
+    linea->instante = time(NULL);
+    linea->destino = DESTINO_ACCESOS;
+    ajustar_longitud(linea, snprintf(linea->texto, sizeof(linea->texto), "Conexión desde %s:%d, página solicitada: %s\n",
+                                     ip, puerto, pagina_solicitada));
+    publicar_linea(anillo);
+}
+
+// Mensaje de diagnóstico; se llama a través de las macros DIAG_*, que ya han
+// comprobado el nivel. Errores y avisos van a la salida de errores. Antes de arrancar
+// el hilo de volcado (o tras detenerlo) se escribe directamente.
+void registrar_diagnostico(int nivel, const char *formato, ...) {
+    int destino = nivel <= NIVEL_AVISO ? STDERR_FILENO : STDOUT_FILENO;
+    va_list argumentos;
+    va_start(argumentos, formato);
+    if (!registro_activo) {
+        vdprintf(destino, formato, argumentos);
+        va_end(argumentos);
         return;
     }
+    AnilloRegistro *anillo;
+    LineaRegistro *linea = reservar_linea(&anillo);
+    if (linea) {
+        linea->destino = destino;
+        ajustar_longitud(linea, vsnprintf(linea->texto, sizeof(linea->texto), formato, argumentos));
+        publicar_linea(anillo);
+    }
+    va_end(argumentos);
+}
+
+// Escribe todo el lote, reintentando si writev() escribe solo una parte.
+static void escribir_lote(int fd, struct iovec *iov, int num_iov) {
+    while (num_iov > 0) {
+        ssize_t n = writev(fd, iov, num_iov);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[REGISTRO] Error escribiendo el archivo de log");
+            return;
+        }
+        while (num_iov > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            num_iov--;
+        }
+        if (num_iov > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+// Vacía todos los anillos. Cada línea de acceso son dos iovec: la marca de tiempo,
+// formateada aquí con localtime_r (ctime no es seguro entre hilos), y el texto, que se
+// escribe directamente desde el anillo sin copiarlo. Las líneas consecutivas con el
+// mismo destino van en la misma llamada a writev().
+static void volcar_anillos(void) {
+    static struct iovec iov[MAX_LOTE_REGISTRO * 2];
+    static char marcas[MAX_LOTE_REGISTRO][40];
+    time_t ultimo_instante = (time_t)-1;
+    char marca[40] = "";
+    size_t tam_marca = 0;
+
+    int n = atomic_load_explicit(&num_anillos, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        AnilloRegistro *anillo = anillos[i];
+        for (;;) {
+            size_t cola = atomic_load_explicit(&anillo->cola, memory_order_relaxed);
+            size_t cabeza = atomic_load_explicit(&anillo->cabeza, memory_order_acquire);
+            if (cola == cabeza) {
+                break;
+            }
+            size_t pendientes = cabeza - cola;
+            if (pendientes > (size_t)lote_registro) {
+                pendientes = lote_registro;
+            }
+
+            int num_iov = 0;
+            int destino_lote = DESTINO_ACCESOS;
+            for (size_t j = 0; j < pendientes; j++) {
+                LineaRegistro *linea = &anillo->lineas[(cola + j) & anillo->mascara];
+                if (linea->destino != destino_lote) {
+                    escribir_lote(destino_lote == DESTINO_ACCESOS ? log_fd : destino_lote, iov, num_iov);
+                    num_iov = 0;
+                    destino_lote = linea->destino;
+                }
+                if (linea->destino == DESTINO_ACCESOS) {
+                    if (linea->instante != ultimo_instante) {
+                        struct tm tm_local;
+                        localtime_r(&linea->instante, &tm_local);
+                        tam_marca = strftime(marca, sizeof(marca), "[%a %b %e %H:%M:%S %Y] ", &tm_local);
+                        ultimo_instante = linea->instante;
+                    }
+                    memcpy(marcas[j], marca, tam_marca);
+                    iov[num_iov].iov_base = marcas[j];
+                    iov[num_iov].iov_len = tam_marca;
+                    num_iov++;
+                }
+                iov[num_iov].iov_base = linea->texto;
+                iov[num_iov].iov_len = linea->longitud;
+                num_iov++;
+            }
+            escribir_lote(destino_lote == DESTINO_ACCESOS ? log_fd : destino_lote, iov, num_iov);
+            // Solo ahora se devuelven las líneas al productor.
+            atomic_store_explicit(&anillo->cola, cola + pendientes, memory_order_release);
+        }
+    }
+}
+
+static void *hilo_volcado_registro(void *arg) {
+    (void)arg;
+    while (registro_activo) {
+        struct timespec limite;
+        clock_gettime(CLOCK_REALTIME, &limite);
+        limite.tv_sec += intervalo_ms / 1000;
+        limite.tv_nsec += (long)(intervalo_ms % 1000) * 1000000;
+        if (limite.tv_nsec >= 1000000000) {
+            limite.tv_sec++;
+            limite.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&aviso_volcado, &limite);
+        volcar_anillos();
+    }
+    volcar_anillos();
+    return NULL;
+}
 
-    time_t ahora = time(NULL);
-    char *timestamp = ctime(&ahora);
-    timestamp[strlen(timestamp) - 1] = '\0';
+// Abre el archivo de log y arranca el hilo de volcado.
+int iniciar_registro(const ConfigServidor *config) {
+    capacidad_anillo = config->log_anillo;
+    intervalo_ms = config->log_intervalo_ms;
+    lote_registro = config->log_lote;
+    politica_registro = config->log_politica;
+    sem_init(&aviso_volcado, 0, 0);
+    // Lo que quede en el buffer de stdio debe salir antes que las líneas de los anillos.
+    fflush(stdout);
+
+    log_fd = open(LOG_ARCHIVO, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        perror("Error al abrir archivo de log");
+        return -1;
+    }
+    registro_activo = 1;
+    if (pthread_create(&hilo_volcado, NULL, hilo_volcado_registro, NULL) != 0) {
+        perror("[REGISTRO] Error al crear el hilo de volcado");
+        registro_activo = 0;
+        close(log_fd);
+        log_fd = -1;
+        return -1;
+    }
+    return 0;
+}
 
-    pthread_mutex_lock(&mutex_log);
-    fprintf(archivo, "[%s] Conexión desde %s:%d, página solicitada: %s\n", 
-            timestamp, ip, puerto, pagina_solicitada);
-    pthread_mutex_unlock(&mutex_log);
+// Total de líneas descartadas porque el anillo de su hilo estaba lleno.
+unsigned long registros_descartados(void) {
+    unsigned long total = atomic_load_explicit(&descartes_sin_anillo, memory_order_relaxed);
+    int n = atomic_load_explicit(&num_anillos, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        total += atomic_load_explicit(&anillos[i]->descartados, memory_order_relaxed);
+    }
+    return total;
+}
 
-    fclose(archivo);
+// Vuelca lo pendiente, detiene el hilo de volcado y cierra el archivo.
+void detener_registro(void) {
+    if (!registro_activo) {
+        return;
+    }
+    registro_activo = 0;
+    sem_post(&aviso_volcado);
+    pthread_join(hilo_volcado, NULL);
+    close(log_fd);
+    log_fd = -1;
+    DIAG_INFO("[REGISTRO] Registro detenido. Líneas descartadas: %lu\n", registros_descartados());
 }
@@ -0,0 +1,85 @@
+#include "servidor_web.h"
+
+// Segmento de memoria compartida para los cuerpos de la caché en el modo de procesos.
+// El maestro lo crea antes de cargar la caché y copia en él los cuerpos, las variantes
+// comprimidas y los encabezados de las páginas que carga. Los trabajadores lo heredan
+// con fork() y sirven esos bytes desde las mismas páginas físicas, sin una copia por
+// proceso. Las reservas solo avanzan (nada se devuelve al segmento) y se cierran al
+// lanzar los trabajadores: lo que un trabajador cargue después va a su memoria propia.
+
+static char *segmento = NULL;
+static size_t tam_segmento = 0;
+static _Atomic size_t usado_segmento = 0;
+static int segmento_abierto = 0;
+
+// Reserva el segmento. Con MAP_NORESERVE solo ocupa memoria lo que se llegue a usar.
+int crear_segmento_compartido(size_t tam) {
+    void *mapa = mmap(NULL, tam, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapa == MAP_FAILED) {
+        perror("[SEGMENTO] Error creando el segmento compartido");
+        return -1;
+    }
+    segmento = mapa;
+    tam_segmento = tam;
+    atomic_init(&usado_segmento, 0);
+    segmento_abierto = 1;
+    return 0;
+}
+
+// Copia 'tam' bytes al segmento. Devuelve la copia, o NULL si el segmento está cerrado
+// o no queda sitio (el llamante se queda entonces con su memoria propia).
+void *copiar_a_segmento(const void *datos, size_t tam) {
+    if (!segmento_abierto) {
+        return NULL;
+    }
+    size_t reserva = (tam + 63) & ~(size_t)63; // cada bloque en su propia línea de caché
+    size_t inicio = atomic_load_explicit(&usado_segmento, memory_order_relaxed);
+    do {
+        if (inicio + reserva > tam_segmento) {
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&usado_segmento, &inicio, inicio + reserva,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    memcpy(segmento + inicio, datos, tam);
+    return segmento + inicio;
+}
+
+// Indica si 'bloque' vive en el segmento (y por tanto no se libera con free()).
+int en_segmento(const void *bloque) {
+    return segmento && (const char *)bloque >= segmento && (const char *)bloque < segmento + tam_segmento;
+}
+
+// Deja de reservar en el segmento y lo pasa a solo lectura: un trabajador no puede
+// estropear los cuerpos que sirven los demás.
+void cerrar_segmento(void) {
+    if (!segmento) {
+        return;
+    }
+    if (segmento_abierto) {
+        DIAG_INFO("[SEGMENTO] %zu KB de la caché compartidos entre los trabajadores.\n",
+                  atomic_load(&usado_segmento) / 1024);
+    }
+    segmento_abierto = 0;
+    mprotect(segmento, tam_segmento, PROT_READ);
+}
+
+// Reserva una zona compartida aparte que los trabajadores pueden seguir escribiendo
+// (la tabla de límites por IP). Hay que pedirla antes de lanzarlos y dura lo que el
+// proceso. Devuelve NULL si no se pudo.
+void *reservar_compartido(size_t tam) {
+    void *mapa = mmap(NULL, tam, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapa == MAP_FAILED) {
+        perror("[SEGMENTO] Error reservando memoria compartida");
+        return NULL;
+    }
+    return mapa;
+}
+
+void liberar_segmento(void) {
+    if (segmento) {
+        munmap(segmento, tam_segmento);
+        segmento = NULL;
+        tam_segmento = 0;
+        segmento_abierto = 0;
+    }
+}
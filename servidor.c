@@ -2,114 +2,246 @@
 
 //variables globales
 volatile sig_atomic_t servidor_corriendo = 1;
-int servidor_fd_global;
+int sockets_escucha[MAX_REACTORES];
+int num_sockets_escucha = 0;
 BufferPaginas buffer_global;
 
-int main(int argc, char *argv[]) {
-    int puerto_escucha = PUERTO_DEFECTO;
-    const char *ip_escucha = IP_DEFECTO;
-    
-    //argumento puerto.
-    if (argc > 1) {
-        puerto_escucha = atoi(argv[1]);
-        if (puerto_escucha <= 0) {
-            fprintf(stderr, "[SERVIDOR] Uso: %s [puerto] [ip]\n", argv[0]);
-            exit(EXIT_FAILURE);
-        }
-    }
-    
-    //argumento IP.
-    if (argc > 2) {
-        ip_escucha = argv[2];
-    }
-    
-    printf("[SERVIDOR] Iniciando servidor web...\n");
-
-    // Configurar la señal SIGINT para un cierre limpio.
-    struct sigaction sa;
-    sa.sa_handler = cerrar_servidor;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
-
+// Crea, enlaza y pone en escucha un socket TCP. Devuelve el descriptor o -1.
+int crear_socket_escucha(const char *ip, int puerto, int reutilizar_puerto, int no_bloqueante) {
     //Creacion del socket
-    servidor_fd_global = socket(AF_INET, SOCK_STREAM, 0);
-    if (servidor_fd_global < 0) {
+    int tipo = SOCK_STREAM | SOCK_CLOEXEC | (no_bloqueante ? SOCK_NONBLOCK : 0);
+    int socket_fd = socket(AF_INET, tipo, 0);
+    if (socket_fd < 0) {
         perror("[SERVIDOR] Error creando el socket");
-        exit(EXIT_FAILURE);
+        return -1;
     }
-    
+
     // se Configura el socket para la reutilización de la dirección del puerto
     int optval = 1;
-    if (setsockopt(servidor_fd_global, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
         perror("[SERVIDOR] Error al configurar setsockopt");
-        close(servidor_fd_global);
-        exit(EXIT_FAILURE);
+        close(socket_fd);
+        return -1;
     }
-    
+
+    // Con SO_REUSEPORT varios sockets comparten el puerto y el kernel reparte las conexiones entre ellos.
+    if (reutilizar_puerto && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+        perror("[SERVIDOR] Error al configurar SO_REUSEPORT");
+        close(socket_fd);
+        return -1;
+    }
+
     struct sockaddr_in servidor_addr;
     memset(&servidor_addr, 0, sizeof(servidor_addr));
-    
+
     servidor_addr.sin_family = AF_INET;
-    servidor_addr.sin_port = htons(puerto_escucha);
-    
-    int pton_result = inet_pton(AF_INET, ip_escucha, &servidor_addr.sin_addr);
+    servidor_addr.sin_port = htons(puerto);
+
+    int pton_result = inet_pton(AF_INET, ip, &servidor_addr.sin_addr);
     if (pton_result <= 0) {
         if (pton_result == 0) {
-            fprintf(stderr, "[SERVIDOR] Dirección IP inválida: La cadena '%s' no es una dirección IP válida.\n", ip_escucha);
+            fprintf(stderr, "[SERVIDOR] Dirección IP inválida: La cadena '%s' no es una dirección IP válida.\n", ip);
         } else {
             perror("[SERVIDOR] Error en inet_pton");
         }
-        close(servidor_fd_global);
-        exit(EXIT_FAILURE);
+        close(socket_fd);
+        return -1;
     }
-    
-    if (bind(servidor_fd_global, (struct sockaddr *)&servidor_addr, sizeof(servidor_addr)) < 0) {
+
+    if (bind(socket_fd, (struct sockaddr *)&servidor_addr, sizeof(servidor_addr)) < 0) {
         perror("[SERVIDOR] Error en bind");
-        close(servidor_fd_global);
-        exit(EXIT_FAILURE);
+        close(socket_fd);
+        return -1;
     }
-    
-    if (listen(servidor_fd_global, MAX_CONEXIONES) < 0) {
+
+    if (listen(socket_fd, config_global.backlog) < 0) {
         perror("[SERVIDOR] Error en listen");
-        close(servidor_fd_global);
-        exit(EXIT_FAILURE);
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+static void cerrar_sockets_escucha(void) {
+    for (int i = 0; i < num_sockets_escucha; i++) {
+        close(sockets_escucha[i]);
+    }
+}
+
+// Atiende conexiones en este proceso hasta la señal de apagado y drena. Es el servidor
+// entero en el modo de un solo proceso, y cada trabajador en el modo de procesos; la
+// caché ya está cargada. Devuelve el estado de salida del proceso.
+int atender_conexiones(int senal_fd) {
+    if (iniciar_registro(&config_global) != 0) {
+        cerrar_sockets_escucha();
+        return EXIT_FAILURE;
+    }
+    if (config_global.vigilar_contenido) {
+        // Sin vigilancia el servidor sigue funcionando, solo que con la caché de arranque.
+        iniciar_vigilancia(&buffer_global, &config_global);
     }
-    
-    printf("[SERVIDOR] Servidor escuchando en %s:%d...\n", ip_escucha, puerto_escucha);
-    printf("[SERVIDOR] Esperando conexiones...\n");
-    
-    inicializar_buffer(&buffer_global);
-    
-    ServidorArgs args;
-    args.servidor_fd = servidor_fd_global;
-    args.buffer_paginas = &buffer_global;
-    
+
+    static ColaConexiones cola_conexiones;
     pthread_t despachador;
-    if (pthread_create(&despachador, NULL, hilo_despachador, &args) != 0) {
-        perror("[SERVIDOR] Error creando hilo despachador");
-        // Los hilos se cierran cuando el proceso termina.
-        close(servidor_fd_global);
-        exit(EXIT_FAILURE);
+    if (config_global.motor == MOTOR_URING && iniciar_anillos(sockets_escucha, num_sockets_escucha, &buffer_global) != 0) {
+        // Sin io_uring (núcleo antiguo o desactivado con kernel.io_uring_disabled) los
+        // mismos sockets, uno por anillo, se atienden con un reactor epoll cada uno.
+        DIAG_AVISO("[SERVIDOR] io_uring no disponible; se usa el motor epoll.\n");
+        config_global.motor = MOTOR_EPOLL;
     }
-    
-    while(servidor_corriendo) {
-        sleep(1);
+    if (config_global.motor == MOTOR_EPOLL) {
+        if (iniciar_reactores(sockets_escucha, num_sockets_escucha, &buffer_global) != 0) {
+            cerrar_sockets_escucha();
+            return EXIT_FAILURE;
+        }
+    } else if (config_global.motor == MOTOR_HILOS) {
+        if (inicializar_cola(&cola_conexiones, config_global.tamano_cola, config_global.politica, config_global.limite_espera) != 0 ||
+            iniciar_pool(&cola_conexiones, &buffer_global, config_global.num_trabajadores) != 0) {
+            cerrar_sockets_escucha();
+            return EXIT_FAILURE;
+        }
+
+        static ServidorArgs args;
+        args.servidor_fd = sockets_escucha[0];
+        args.buffer_paginas = &buffer_global;
+        args.cola = &cola_conexiones;
+
+        if (pthread_create(&despachador, NULL, hilo_despachador, &args) != 0) {
+            perror("[SERVIDOR] Error creando hilo despachador");
+            // Los hilos se cierran cuando el proceso termina.
+            cerrar_sockets_escucha();
+            return EXIT_FAILURE;
+        }
     }
-    printf("[SERVIDOR] Servidor apagado limpiamente.\n");
+
+    avisar_relevo_listo();
+
+    pthread_t hilo_senal;
+    if (pthread_create(&hilo_senal, NULL, hilo_senales, &senal_fd) != 0) {
+        perror("[SERVIDOR] Error creando el hilo de señales");
+        return EXIT_FAILURE;
+    }
+    pthread_join(hilo_senal, NULL);
+
+    // Drenaje: los motores dejan de aceptar y cierran su socket de escucha (en un relevo
+    // sigue abierto en el proceso nuevo), las peticiones en curso terminan sin keep-alive
+    // hasta el plazo, y solo cuando ningún hilo puede tocar la caché se libera.
+    DIAG_INFO("[SERVIDOR] Drenando conexiones (plazo: %d s)...\n", config_global.plazo_drenaje);
+    servidor_corriendo = 0;
+    int drenado;
+    if (config_global.motor == MOTOR_URING) {
+        drenado = detener_anillos();
+    } else if (config_global.motor == MOTOR_EPOLL) {
+        drenado = detener_reactores();
+    } else {
+        pthread_join(despachador, NULL);
+        drenado = detener_pool(&cola_conexiones, config_global.plazo_drenaje);
+    }
+    detener_vigilancia();
+    if (drenado == 0) {
+        liberar_buffer(&buffer_global);
+    } else {
+        DIAG_AVISO("[SERVIDOR] Quedan hilos atendiendo tras el plazo; la caché no se libera.\n");
+    }
+    detener_registro();
+    DIAG_INFO("[SERVIDOR] Servidor apagado limpiamente.\n");
     return 0;
 }
 
-// funcion de señales para cerrar el servidor
-void cerrar_servidor(int signum) {
-    printf("\n[SERVIDOR] Señal de terminación recibida. Cerrando el servidor...\n");
-    servidor_corriendo = 0;
-    //Liberar la memoria del buffer de páginas
-    liberar_buffer(&buffer_global);
-    //Usar shutdown() para desbloquear accept() de forma segura
-    if (servidor_fd_global != -1) {
-        shutdown(servidor_fd_global, SHUT_RDWR);
-        close(servidor_fd_global);
-    }
-}
\ No newline at end of file
+// Sube el límite blando de descriptores hasta el duro: cada conexión y cada archivo que
+// la caché mantiene abierto gastan uno, y el límite blando habitual es 1024.
+static void elevar_limite_descriptores(void) {
+    struct rlimit limite;
+    if (getrlimit(RLIMIT_NOFILE, &limite) != 0 || limite.rlim_cur >= limite.rlim_max) {
+        return;
+    }
+    rlim_t anterior = limite.rlim_cur;
+    limite.rlim_cur = limite.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limite) == 0) {
+        DIAG_INFO("[SERVIDOR] Límite de descriptores elevado de %llu a %llu.\n", (unsigned long long)anterior,
+                  (unsigned long long)limite.rlim_cur);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int puerto_escucha = PUERTO_DEFECTO;
+    const char *ip_escucha = IP_DEFECTO;
+
+    //argumento puerto.
+    if (argc > 1) {
+        puerto_escucha = atoi(argv[1]);
+        if (puerto_escucha <= 0) {
+            fprintf(stderr, "[SERVIDOR] Uso: %s [puerto] [ip]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //argumento IP.
+    if (argc > 2) {
+        ip_escucha = argv[2];
+    }
+
+    DIAG_INFO("[SERVIDOR] Iniciando servidor web...\n");
+    cargar_configuracion(&config_global);
+    guardar_argumentos(argv);
+    elevar_limite_descriptores();
+
+    // Las señales se bloquean antes de crear ningún hilo y las atiende hilo_senales()
+    // (ver ciclo_vida.c): SIGINT/SIGTERM apagan drenando, SIGUSR1 vuelca la caché y
+    // SIGUSR2 relanza el binario sin cerrar los sockets de escucha.
+    int senal_fd = bloquear_senales();
+    if (senal_fd < 0) {
+        exit(EXIT_FAILURE);
+    }
+    // Un cliente que cierra a mitad de respuesta no debe terminar el proceso.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Un socket por trabajador en el modo de procesos; si no, uno para el despachador o
+    // uno por reactor o anillo. Con varios, SO_REUSEPORT reparte las conexiones entre
+    // ellos. En un relevo se usan los que deja abiertos el proceso anterior: las
+    // conexiones que esperan en su cola de listen no se pierden.
+    int un_socket_por_hilo = (config_global.motor != MOTOR_HILOS);
+    num_sockets_escucha = heredar_sockets_escucha(sockets_escucha, MAX_REACTORES);
+    if (num_sockets_escucha > 0) {
+        DIAG_INFO("[SERVIDOR] Relevo: %d sockets de escucha heredados del proceso anterior.\n", num_sockets_escucha);
+        if (config_global.procesos > 0) {
+            config_global.procesos = num_sockets_escucha;
+        } else if (un_socket_por_hilo) {
+            config_global.num_reactores = num_sockets_escucha;
+        } else if (num_sockets_escucha > 1) {
+            DIAG_AVISO("[SERVIDOR] El motor de hilos usa un solo socket; se cierran los otros %d heredados.\n",
+                       num_sockets_escucha - 1);
+            while (num_sockets_escucha > 1) {
+                close(sockets_escucha[--num_sockets_escucha]);
+            }
+        }
+    }
+    int num_sockets = config_global.procesos > 0 ? config_global.procesos :
+                      un_socket_por_hilo ? config_global.num_reactores : 1;
+    while (num_sockets_escucha < num_sockets) {
+        // No bloqueantes en todos los motores: el despachador espera con poll() para poder
+        // ver el apagado sin que otro hilo cierre el socket.
+        int socket_fd = crear_socket_escucha(ip_escucha, puerto_escucha, num_sockets > 1, 1);
+        if (socket_fd < 0) {
+            cerrar_sockets_escucha();
+            exit(EXIT_FAILURE);
+        }
+        sockets_escucha[num_sockets_escucha++] = socket_fd;
+    }
+
+    DIAG_INFO("[SERVIDOR] Servidor escuchando en %s:%d...\n", ip_escucha, puerto_escucha);
+    DIAG_INFO("[SERVIDOR] Esperando conexiones...\n");
+
+    // La caché se carga antes de repartir el trabajo: en el modo de procesos la carga el
+    // maestro una sola vez en el segmento compartido y los trabajadores la heredan.
+    if (config_global.procesos > 0 && crear_segmento_compartido(config_global.cache_bytes) != 0) {
+        cerrar_sockets_escucha();
+        exit(EXIT_FAILURE);
+    }
+    inicializar_buffer(&buffer_global, &config_global);
+    iniciar_limites_cliente(&config_global); // antes del fork(): la tabla es de todos los trabajadores
+    if (config_global.procesos > 0) {
+        return ejecutar_maestro(senal_fd);
+    }
+    return atender_conexiones(senal_fd);
+}
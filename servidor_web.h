@@ -1,6 +1,8 @@
 #ifndef SERVIDOR_WEB_H
 #define SERVIDOR_WEB_H
 
+#define _GNU_SOURCE // accept4, SO_REUSEPORT y demás extensiones de Linux
+
 //librerías necesarias
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,63 +13,676 @@
 #include <signal.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <ftw.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h> // solo las definiciones: el motor io_uring usa las llamadas directamente, sin liburing
 #include <time.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <zlib.h>
+#ifdef SERVIDOR_BROTLI
+#include <brotli/encode.h> // compilar con -DSERVIDOR_BROTLI y enlazar con -lbrotlienc
+#endif
 
 // Constantes globales para el servidor 
 #define PUERTO_DEFECTO 8000           // Puerto por defecto para la escucha del servidor
 #define IP_DEFECTO "0.0.0.0"          // IP por defecto para escuchar en todas las interfaces
-#define MAX_CONEXIONES 10             // Número máximo de conexiones pendientes en la cola de listen
-#define MAX_PAGINAS 3                 // Tamaño del buffer de páginas 
+#define BACKLOG_DEFECTO 1024          // Conexiones pendientes en la cola de listen (el kernel la limita a somaxconn)
+#define CACHE_BYTES_DEFECTO (32 * 1024 * 1024) // Presupuesto de bytes de la caché de páginas
+#define MAX_ENTRADAS_CACHE 1024       // Ranuras del reloj CLOCK (entradas máximas en caché)
+#define MAX_DESCRIPTORES_CACHE 512    // Entradas con su archivo abierto (imágenes y archivos grandes)
+#define TAMANO_TABLA_CACHE 2048       // Cubetas de la tabla hash de la caché
+#define MAX_HILOS_CACHE 256           // Hilos con registro propio para leer la caché sin bloqueo
 #define PAGINAS_DIR "paginas/"        // Directorio donde se almacenan los archivos HTML
 #define IMAGENES_DIR "imagenes/"      // Directorio para los archivos de imagen
 #define LOG_ARCHIVO "log_conexiones.txt" // Archivo donde se registran las conexiones
 #define TAMANO_BUFFER 4096            // Tamaño del buffer para las peticiones HTTP
+#define NUM_TRABAJADORES_DEFECTO 8    // Hilos del pool de trabajadores
+#define TAMANO_COLA_DEFECTO 256       // Capacidad de la cola de conexiones aceptadas (potencia de 2)
+#define LIMITE_ESPERA_DEFECTO 1024    // Máximo de conexiones en la lista de espera (política desbordar)
+#define MAX_REACTORES 64              // Máximo de reactores epoll o anillos io_uring (uno por núcleo)
+#define MAX_PROCESOS MAX_REACTORES    // Máximo de trabajadores en el modo de procesos (un socket cada uno)
+#define TIMEOUT_INACTIVO_DEFECTO 5    // Segundos que se mantiene abierta una conexión sin actividad
+#define PAUSA_ACCEPT_MS 100           // Milisegundos sin aceptar tras quedarse sin descriptores
+#define MAX_PETICIONES_DEFECTO 100    // Peticiones máximas atendidas por conexión keep-alive
+#define MAX_ANILLOS_REGISTRO 256      // Hilos con anillo propio en el registro de conexiones
+#define TAMANO_LINEA_REGISTRO 232     // Bytes de texto por línea del registro
+#define ANILLO_REGISTRO_DEFECTO 1024  // Líneas por anillo de registro (potencia de 2)
+#define INTERVALO_REGISTRO_DEFECTO 200 // Milisegundos entre volcados del registro
+#define LOTE_REGISTRO_DEFECTO 256     // Líneas por llamada a writev() del registro
+#define MAX_LOTE_REGISTRO 512         // Tope del lote: dos iovec por línea sin pasar de IOV_MAX
+#define MAX_HILOS_METRICAS 256        // Hilos con bloque de métricas propio
+#define NUM_CUBETAS_LATENCIA 312      // Cubetas log-lineales: 16 + 8 por potencia de 2 hasta 2^41 ns
+#define TAMANO_INFORME_METRICAS 16384 // Bytes reservados para la respuesta de /metrics
+#define TAMANO_CUERPO_GENERADO TAMANO_INFORME_METRICAS // Bytes de cada cuerpo de la losa del hilo (/metrics, partes de un multipart)
+#define MIN_TAM_COMPRESION 256        // Cuerpos más pequeños no se comprimen
+#define NIVEL_GZIP_DEFECTO 9          // Nivel de zlib; se comprime una sola vez al cargar
+#define CACHE_CONTROL_PAGINAS_DEFECTO "no-cache"                // Revalidar con ETag en cada visita
+#define CACHE_CONTROL_IMAGENES_DEFECTO "public, max-age=604800" // Una semana sin revalidar
+#define MAX_CACHE_CONTROL 128         // Longitud máxima de un valor de Cache-Control configurado
+#define CONEXIONES_POR_TRAMO 64       // Objetos Conexion que reserva de una vez la losa de un reactor
+#define MAX_CONEXIONES_ANILLO 4096    // Descriptores fijos de cada anillo io_uring: conexiones simultáneas
+#define ACEPTACIONES_EN_VUELO 16      // accept pendientes en cada anillo, cada uno con su dirección
+#define BUFERES_RECEPCION 256         // Búferes de recepción que presta cada anillo al kernel (potencia de 2)
+#define BLOQUES_ANILLO 32             // Bloques registrados de cada anillo para leer archivos
+#define TAMANO_BLOQUE_ANILLO (256 * 1024) // Bytes de archivo que se leen y envían en cada envío encadenado
+#define PETICIONES_POR_TRAMO 16       // Objetos PeticionEnCurso por tramo (~6,7 KB cada uno)
+#define MAX_DIRECTORIOS_VIGILADOS 1024 // Directorios de contenido que vigila inotify
+#define MAX_MAPEOS_CACHE (2 * MAX_ENTRADAS_CACHE) // Cuerpos mapeados a la vez, retirados aún en uso incluidos
+#define MIN_TAM_PAGINAS_ENORMES (2 * 1024 * 1024) // Mapeos a partir de este tamaño piden MADV_HUGEPAGE
+#define UMBRAL_TRANSMISION_DEFECTO (1024 * 1024) // Archivos mayores se envían desde disco, sin copiarlos a memoria
+#define PLAZO_DRENAJE_DEFECTO 10      // Segundos para terminar las peticiones en curso al apagar
+#define MAX_RANGOS 8                  // Rangos por petición; con más se responde el archivo entero
+#define MAX_ENCABEZADOS_HTTP 64       // Encabezados que caben en una PeticionHttp
+#define LIMITE_URI_DEFECTO 2048       // Longitud máxima del destino de la línea de petición
+#define LIMITE_ENCABEZADOS_DEFECTO 32 // Encabezados admitidos por petición
+#define LIMITE_CUERPO_DEFECTO 1024    // Content-Length máximo aceptado
+#define CONEXIONES_POR_IP_DEFECTO 256 // Conexiones simultáneas por IP de cliente (0: sin límite)
+#define TAMANO_TABLA_CLIENTES 16384   // Entradas de la tabla de límites por IP; no crece
+#define VIAS_TABLA_CLIENTES 4         // Entradas en las que puede caer cada IP
+#define FRANJAS_TABLA_CLIENTES 64     // Cerrojos que se reparten los conjuntos de la tabla de límites
+
+// Niveles de diagnóstico. Los mensajes por encima de NIVEL_DIAGNOSTICO_COMPILADO no se
+// compilan (p. ej. -DNIVEL_DIAGNOSTICO_COMPILADO=NIVEL_INFO); el resto se filtra en
+// tiempo de ejecución con SERVIDOR_NIVEL_LOG.
+#define NIVEL_ERROR 0
+#define NIVEL_AVISO 1
+#define NIVEL_INFO 2
+#define NIVEL_DEPURACION 3
+#ifndef NIVEL_DIAGNOSTICO_COMPILADO
+#define NIVEL_DIAGNOSTICO_COMPILADO NIVEL_DEPURACION
+#endif
+
+// Un nivel desactivado no evalúa sus argumentos; uno activo solo formatea en el anillo del hilo.
+#define DIAGNOSTICO(nivel, ...) do { \
+        if ((nivel) <= NIVEL_DIAGNOSTICO_COMPILADO && (nivel) <= nivel_diagnostico) { \
+            registrar_diagnostico((nivel), __VA_ARGS__); \
+        } \
+    } while (0)
+#define DIAG_ERROR(...) DIAGNOSTICO(NIVEL_ERROR, __VA_ARGS__)
+#define DIAG_AVISO(...) DIAGNOSTICO(NIVEL_AVISO, __VA_ARGS__)
+#define DIAG_INFO(...) DIAGNOSTICO(NIVEL_INFO, __VA_ARGS__)
+#define DIAG_DEPURACION(...) DIAGNOSTICO(NIVEL_DEPURACION, __VA_ARGS__)
 
 //Estructuras de datos compartidas
 
-// Estructura de una página en el buffer
+// Codificaciones precomprimidas que puede guardar una página, además de la identidad
+typedef enum {
+    CODIFICACION_GZIP,
+    CODIFICACION_BROTLI,
+    NUM_CODIFICACIONES
+} Codificacion;
+
+// Máscara de codificaciones que se generan al cargar (SERVIDOR_COMPRESION)
+#define COMPRIMIR_GZIP (1 << CODIFICACION_GZIP)
+#define COMPRIMIR_BROTLI (1 << CODIFICACION_BROTLI)
+
+// Una representación de la página (identidad o comprimida) con su encabezado 200 sin la
+// línea Connection. Desde 'inicio_validadores' el encabezado solo lleva ETag,
+// Last-Modified, Cache-Control y Vary, que es lo que repite un 304.
 typedef struct {
-    char *nombre_archivo;
-    char *contenido;
+    char *contenido;             // NULL si no se generó, o si la identidad se sirve desde 'fd'
     size_t tamano;
-    time_t ultimo_acceso; // timestamp del último acceso
+    char *encabezado;
+    size_t tam_encabezado;
+    size_t inicio_validadores;
+    char etag[48];               // ETag entre comillas, con W/ delante si es débil
+} VariantePagina;
+
+// Estructura de una página en el buffer. Las páginas HTML se guardan en memoria;
+// las imágenes y los archivos por encima del umbral de transmisión mantienen su
+// descriptor abierto y se envían con sendfile().
+typedef struct Pagina {
+    char *nombre_archivo;        // ruta en disco, clave de la tabla hash
+    const char *tipo;            // Content-Type, para las respuestas parciales
+    VariantePagina identidad;    // cuerpo sin comprimir; en memoria salvo si se envía desde 'fd'
+    int mapeada;                 // el cuerpo de 'identidad' es un mmap() del archivo, no una copia
+    VariantePagina variantes[NUM_CODIFICACIONES]; // cuerpos precomprimidos, elegidos por Accept-Encoding
+    int fd;                      // descriptor para sendfile(), o -1
+    struct stat info;            // metadatos de fstat al cargarla
+    size_t coste;                // bytes que cuenta contra el presupuesto de la caché
+    _Atomic int referencias;     // la caché y cada respuesta en curso tienen una
+    int ranura;                  // posición en el reloj CLOCK
+    int segunda_oportunidad;     // recién insertada: sobrevive a la primera pasada de CLOCK
+    uint64_t aciertos_vistos;    // suma de aciertos por hilo en la última pasada de CLOCK
+    _Atomic(struct Pagina *) siguiente; // cadena de la cubeta
+    struct Pagina *retirada_siguiente;  // lista de páginas retiradas pendientes de reclamar
+    uint64_t epoca_retiro;       // época en que se sacó de la tabla
 } Pagina;
 
-// Estructura del buffer de páginas en memoria
+// Dónde vive el cuerpo de las páginas de texto en la caché. Con RESPALDO_MMAP no se
+// guardan variantes comprimidas, que obligarían a leer el mapeo entero al cargarlo.
+// El manejador de SIGBUS solo cubre las lecturas del propio proceso: si el archivo se
+// trunca mientras sendmsg() copia desde el mapeo, el kernel devuelve EFAULT y esa
+// conexión se cierra sin completar la respuesta.
+typedef enum {
+    RESPALDO_MEMORIA, // copia en memoria propia del proceso
+    RESPALDO_MMAP     // el archivo mapeado en solo lectura, compartido con la caché del kernel
+} RespaldoCache;
+
+// Estructura del buffer de páginas en memoria. Los aciertos la leen sin bloqueo;
+// el mutex solo serializa fallos, inserciones y expulsiones.
 typedef struct {
-    Pagina paginas[MAX_PAGINAS];
-    int num_paginas;
-    pthread_mutex_t mutex; // Mutex para proteger el acceso concurrente al buffer
+    _Atomic(Pagina *) tabla[TAMANO_TABLA_CACHE];   // índice hash por ruta
+    _Atomic(Pagina *) ranuras[MAX_ENTRADAS_CACHE]; // reloj CLOCK
+    int ranuras_libres[MAX_ENTRADAS_CACHE];        // pila de ranuras sin usar
+    int num_ranuras_libres;
+    int manecilla;
+    _Atomic int num_paginas;
+    _Atomic size_t bytes_usados;
+    size_t bytes_maximos;
+    int descriptores_abiertos; // entradas en la tabla que mantienen su archivo abierto
+    int max_descriptores;      // tope de esas entradas, según el límite de descriptores del proceso
+    int compresion;          // máscara COMPRIMIR_* para las páginas que se carguen
+    int nivel_gzip;
+    RespaldoCache respaldo;
+    size_t umbral_transmision; // archivos más grandes no se copian a memoria
+    const char *cache_control_paginas;  // Cache-Control de paginas/
+    const char *cache_control_imagenes; // Cache-Control de imagenes/
+    _Atomic uint64_t epoca;  // época global para la reclamación diferida
+    Pagina *retiradas;       // páginas fuera de la tabla que algún lector aún puede ver
+    int num_retiradas;
+    pthread_mutex_t mutex; // Mutex para el camino de escritura del buffer
 } BufferPaginas;
 
+// Qué hacer con una conexión aceptada cuando la cola del pool está llena
+typedef enum {
+    POLITICA_BLOQUEAR,  // el despachador deja de aceptar hasta que haya hueco
+    POLITICA_RECHAZAR,  // se responde 503 y se cierra la conexión
+    POLITICA_DESBORDAR  // se guarda en una lista de espera (limitada) fuera de la cola
+} PoliticaContrapresion;
+
+// Modelo de concurrencia con el que se atienden las conexiones
+typedef enum {
+    MOTOR_HILOS, // despachador + pool de hilos con E/S bloqueante
+    MOTOR_EPOLL, // reactores epoll edge-triggered con sockets no bloqueantes
+    MOTOR_URING  // anillos io_uring: accept, recepción, envío y lectura de archivos sin una llamada por operación
+} MotorServidor;
+
+// Qué hacer con un cliente que supera su límite de conexiones o de peticiones
+typedef enum {
+    RECHAZO_RESPONDER, // 503 al aceptar la conexión, 429 a la petición
+    RECHAZO_CERRAR     // se cierra la conexión sin responder
+} RechazoCliente;
+
+// Qué se carga en la caché al arrancar
+typedef enum {
+    PRECARGA_NINGUNA, // la caché empieza vacía
+    PRECARGA_PAGINAS, // los archivos de paginas/ que quepan, en orden de readdir()
+    PRECARGA_TODO     // todo paginas/ e imagenes/ con subdirectorios, en paralelo
+} PrecargaCache;
+
+// Qué hacer con una línea del registro cuando el anillo de su hilo está lleno
+typedef enum {
+    REGISTRO_DESCARTAR, // se pierde la línea y se cuenta como descartada
+    REGISTRO_BLOQUEAR   // el hilo espera a que el volcado libere espacio
+} PoliticaRegistro;
+
+// Límites que impone el analizador de peticiones (ver parser_http.c)
+typedef struct {
+    size_t max_uri;
+    int max_encabezados;
+    size_t max_cuerpo;
+} LimitesHttp;
+
+// Configuración del servidor leída al arrancar (ver configuracion.c)
+typedef struct {
+    MotorServidor motor;
+    int procesos;          // trabajadores del modo de procesos; 0 para un solo proceso
+    int fijar_cpu;         // fijar cada trabajador a un núcleo
+    int backlog;
+    int num_reactores;
+    int num_trabajadores;
+    int tamano_cola;
+    int limite_espera;
+    PoliticaContrapresion politica;
+    int timeout_inactivo;
+    int max_peticiones_conexion;
+    int plazo_drenaje;
+    int conexiones_por_ip;    // 0 para no limitar
+    int peticiones_por_ip;    // peticiones por segundo; 0 para no limitar
+    int rafaga_por_ip;        // peticiones seguidas que se permiten por encima del ritmo
+    RechazoCliente rechazo_por_ip;
+    size_t cache_bytes;
+    int compresion;
+    int nivel_gzip;
+    RespaldoCache respaldo;
+    size_t umbral_transmision;
+    const char *cache_control_paginas;
+    const char *cache_control_imagenes;
+    PrecargaCache precarga;
+    int hilos_precarga;
+    int vigilar_contenido;
+    LimitesHttp limites_http;
+    int log_anillo;
+    int log_intervalo_ms;
+    int log_lote;
+    PoliticaRegistro log_politica;
+    int nivel_log;
+} ConfigServidor;
+
+#define DESTINO_ACCESOS 0 // destino de las líneas del archivo de log de conexiones
+
+// Línea del registro: una conexión (con marca de tiempo, formateada al volcarla) o un
+// mensaje de diagnóstico para la salida estándar o de errores
+typedef struct {
+    time_t instante;
+    int destino;       // DESTINO_ACCESOS, STDOUT_FILENO o STDERR_FILENO
+    uint32_t longitud;
+    char texto[TAMANO_LINEA_REGISTRO];
+} LineaRegistro;
+
+// Anillo de un solo productor (el hilo que registra) y un solo consumidor (el hilo
+// de volcado). Cabeza y cola van en líneas de caché distintas.
+typedef struct {
+    _Alignas(64) _Atomic size_t cabeza; // siguiente línea a escribir (productor)
+    _Alignas(64) _Atomic size_t cola;   // siguiente línea a volcar (consumidor)
+    _Alignas(64) _Atomic unsigned long descartados;
+    LineaRegistro *lineas;
+    size_t mascara;
+} AnilloRegistro;
+
+// Contadores de /metrics
+typedef enum {
+    METRICA_PETICIONES,
+    METRICA_BYTES_ENVIADOS,
+    METRICA_ACIERTOS_CACHE,
+    METRICA_FALLOS_CACHE,
+    METRICA_EXPULSIONES,
+    METRICA_RESPUESTAS_404,
+    METRICA_RESPUESTAS_COMPRIMIDAS,
+    METRICA_RESPUESTAS_304,
+    METRICA_RESPUESTAS_PARCIALES,
+    METRICA_ERRORES_ACCEPT,
+    METRICA_RESERVAS_MONTICULO,
+    METRICA_RESERVAS_LOSA,
+    METRICA_RECHAZOS_CONEXION_IP,
+    METRICA_RECHAZOS_PETICION_IP,
+    METRICA_CLIENTES_SIN_ENTRADA,
+    NUM_CONTADORES
+} ContadorMetrica;
+
+// Fases de una petición con histograma de latencia
+typedef enum {
+    FASE_PARSEO,   // línea de petición y encabezados
+    FASE_BUSQUEDA, // obtener_pagina()
+    FASE_ENVIO,    // desde el primer intento de envío hasta terminar la respuesta
+    FASE_COLA,     // espera de una conexión aceptada en la cola del pool de hilos
+    NUM_FASES
+} FaseLatencia;
+
+// Métricas de un hilo. Solo las escribe su hilo; cada bloque empieza en su propia
+// línea de caché para que los hilos no compartan líneas al actualizarlas.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t contadores[NUM_CONTADORES];
+    _Atomic uint64_t suma_ns[NUM_FASES];
+    _Atomic uint64_t cubetas[NUM_FASES][NUM_CUBETAS_LATENCIA];
+} MetricasHilo;
+
+// Losa de objetos de tamaño fijo (ver losas.c). No es segura entre hilos.
+typedef struct {
+    size_t tam_objeto;
+    size_t objetos_por_tramo;
+    void *libres;    // lista de objetos libres
+    void *tramos;    // tramos reservados, enlazados por su cabecera
+    size_t en_uso;
+    size_t capacidad;
+} Losa;
+
+// Hueco de la cola de conexiones (cola MPMC acotada con números de secuencia)
+typedef struct {
+    _Atomic size_t secuencia;
+    int cliente_fd;
+    int entrada_cliente;  // entrada en la tabla de límites por IP (ver limitador.c)
+    uint64_t encolado_ns; // instante en que se encoló, para medir la espera
+} HuecoCola;
+
+// Conexión desbordada a la lista de espera
+typedef struct NodoEspera {
+    int cliente_fd;
+    int entrada_cliente;
+    uint64_t encolado_ns;
+    struct NodoEspera *siguiente;
+} NodoEspera;
+
+// Cola acotada de conexiones aceptadas que alimenta al pool de trabajadores
+typedef struct {
+    HuecoCola *huecos;
+    size_t mascara;
+    _Atomic size_t pos_encolar;
+    _Atomic size_t pos_desencolar;
+    sem_t elementos;         // conexiones pendientes (cola + lista de espera)
+    sem_t libres;            // huecos libres en la cola
+    _Atomic int profundidad; // conexiones pendientes, para informar
+    PoliticaContrapresion politica;
+    // Lista de espera para la política desbordar
+    pthread_mutex_t mutex_espera;
+    NodoEspera *espera_inicio;
+    NodoEspera *espera_fin;
+    Losa nodos_espera;       // nodos de la lista de espera, bajo 'mutex_espera'
+    int num_espera;
+    int limite_espera;
+    _Atomic int cerrada;     // el despachador ya no encola: los hilos salen al vaciarla
+} ColaConexiones;
+
 // Estructura para pasar argumentos al hilo despachador
 typedef struct {
     int servidor_fd;
     BufferPaginas *buffer_paginas;
+    ColaConexiones *cola;
 } ServidorArgs;
 
+// Conexión que atiende un hilo del pool, publicada para poder cortarla al apagar
+typedef struct {
+    pthread_mutex_t mutex;  // el descriptor no se cierra mientras el apagado lo corta
+    int cliente_fd;         // -1 si el hilo no atiende ninguna
+    _Atomic int ociosa;     // esperando la siguiente petición keep-alive
+} ConexionEnServicio;
+
 // Estructura para pasar argumentos al hilo trabajador
 typedef struct {
     int cliente_fd;
+    int entrada_cliente;             // entrada en la tabla de límites por IP, o CLIENTE_SIN_ENTRADA
     BufferPaginas *buffer_paginas;
+    ConexionEnServicio *en_servicio; // o NULL
 } TrabajadorArgs;
 
+// Resultados de admitir_conexion() que no son una entrada de la tabla de límites
+#define CLIENTE_SIN_ENTRADA -1 // admitida sin seguimiento (sin límites o con su conjunto lleno)
+#define CLIENTE_RECHAZADO -2   // la IP superó su límite
+
+// Resultados de analizar_peticion(); los errores son el código HTTP con signo negativo
+#define ANALISIS_INCOMPLETO 0
+#define ANALISIS_COMPLETO 1
+
+// Fragmento de un buffer que no termina en '\0'
+typedef struct {
+    const char *datos;
+    size_t longitud;
+} VistaCadena;
+
+typedef struct {
+    VistaCadena nombre;
+    VistaCadena valor;
+} EncabezadoHttp;
+
+// Petición analizada. Las vistas apuntan al buffer de recepción y solo valen mientras
+// sus bytes sigan en él.
+typedef struct {
+    int fase;
+    size_t analizados;  // bytes de líneas completas ya analizadas
+    size_t revisados;   // bytes de la línea incompleta ya revisados
+    size_t tam_cuerpo;
+    int hay_longitud;   // vino Content-Length
+    size_t longitud;    // encabezados + cuerpo, cuando está completa
+    VistaCadena metodo;
+    VistaCadena ruta;
+    VistaCadena consulta;
+    VistaCadena version;
+    int version_menor;  // x de HTTP/1.x
+    int num_encabezados;
+    EncabezadoHttp encabezados[MAX_ENCABEZADOS_HTTP];
+} PeticionHttp;
+
+// Iovecs de cada envío de una respuesta: las partes del encabezado y el cuerpo. Un cuerpo
+// en varios tramos puede necesitar más y se envía en varias veces.
+#define MAX_IOV_RESPUESTA 4
+
+// Tramo de un cuerpo compuesto (multipart/byteranges): las cabeceras de cada parte se
+// generan en memoria y los bytes de cada rango salen de la página, sin copiarlos.
+typedef struct {
+    const char *datos;    // bytes en memoria, o NULL si salen del archivo de la respuesta
+    off_t desplazamiento; // posición en el archivo cuando 'datos' es NULL
+    size_t tam;
+} TramoCuerpo;
+
+#define MAX_TRAMOS_CUERPO (2 * MAX_RANGOS + 1) // cabecera y datos de cada rango, y el cierre
+
+// Respuesta HTTP preparada, lista para enviarse por cualquiera de los motores
+typedef struct {
+    int codigo;
+    char encabezado[512];            // encabezado formateado para las respuestas generadas (404, /metrics...)
+    struct iovec partes[MAX_IOV_RESPUESTA - 1]; // encabezado en orden de envío: línea de estado de un 304, el de la
+    int num_partes;                  // página y la línea Connection; o solo 'encabezado'
+    size_t tam_encabezado;           // suma de las partes
+    const char *cuerpo;              // cuerpo en memoria, o NULL si se envía desde 'archivo_fd'
+    char *cuerpo_generado;           // cuerpo de la losa del hilo para esta respuesta (p. ej. /metrics), o NULL
+    size_t tam_cuerpo;
+    Pagina *pagina;                  // página retenida hasta terminar el envío
+    int archivo_fd;                  // descriptor para sendfile(), o -1 si el cuerpo está en memoria
+    off_t desplazamiento;            // posición del cuerpo dentro del archivo
+    const TramoCuerpo *tramos;       // cuerpo en varios tramos, o NULL si es uno solo
+    int num_tramos;
+    int mantener_conexion; // 1 si la conexión sigue abierta tras enviarla
+} Respuesta;
+
+// Fases de una conexión en el motor epoll
+typedef enum {
+    CONEXION_LEYENDO,    // acumulando la petición
+    CONEXION_ESCRIBIENDO // enviando la respuesta
+} EstadoConexion;
+
+// Estado de una petición en curso; se reserva solo mientras hay trabajo pendiente.
+// 'lectura' puede contener varias peticiones encadenadas; 'longitud' es la que se está respondiendo.
+typedef struct {
+    char lectura[TAMANO_BUFFER];
+    size_t leidos;
+    size_t longitud;
+    PeticionHttp http;
+    Respuesta respuesta;
+    size_t enviados;
+    uint64_t inicio_envio_ns; // para el histograma de la fase de envío
+} PeticionEnCurso;
+
+// Conexión gestionada por un reactor
+typedef struct Conexion {
+    int fd;
+    EstadoConexion estado;
+    PeticionEnCurso *peticion;
+    char ip[INET_ADDRSTRLEN];
+    int puerto;
+    int peticiones_atendidas;
+    int entrada_cliente;     // entrada en la tabla de límites por IP, o CLIENTE_SIN_ENTRADA
+    time_t ultima_actividad;
+    // Lista de conexiones del reactor ordenada por actividad, para los timeouts
+    struct Conexion *anterior;
+    struct Conexion *siguiente;
+} Conexion;
+
+// Reactor epoll: un hilo con su socket de escucha y su instancia epoll
+typedef struct {
+    int id;
+    int epoll_fd;
+    int escucha_fd;
+    int conexiones_activas;
+    BufferPaginas *buffer_paginas;
+    Losa conexiones;          // objetos Conexion del reactor
+    Losa peticiones;          // objetos PeticionEnCurso del reactor
+    Conexion *menos_reciente; // cabeza de la lista por actividad
+    Conexion *mas_reciente;   // cola de la lista por actividad
+    time_t ahora;             // reloj del reactor, se actualiza en cada vuelta
+    time_t limite_drenaje;    // al apagar, hora a la que se cierran las conexiones que queden
+    uint64_t aceptar_desde_ns; // sin descriptores: no se vuelve a llamar a accept() antes (0 si no)
+} Reactor;
+
+// Conexión de un anillo io_uring. Mientras tiene operaciones en vuelo el kernel puede
+// estar usando su petición, su respuesta o su bloque, así que solo se cierra y se
+// devuelve a la losa cuando han vuelto todas.
+typedef struct ConexionAnillo {
+    int ranura;              // descriptor fijo del socket en la tabla del anillo
+    EstadoConexion estado;
+    PeticionEnCurso *peticion;
+    int bloque;              // bloque registrado para enviar desde un archivo, o -1
+    size_t en_bloque;        // bytes del bloque que lleva el envío en curso
+    size_t enviados_bloque;  // de ellos, los ya enviados
+    int operaciones;         // operaciones en vuelo con esta conexión
+    int cortada;             // se pidió shutdown() por inactividad o al vencer el drenaje
+    int cerrando;            // se cierra en cuanto vuelvan sus operaciones
+    struct msghdr mensaje;   // envío en curso de una respuesta en memoria
+    struct iovec iov[MAX_IOV_RESPUESTA];
+    char ip[INET_ADDRSTRLEN];
+    int puerto;
+    int peticiones_atendidas;
+    int entrada_cliente;     // entrada en la tabla de límites por IP, o CLIENTE_SIN_ENTRADA
+    time_t ultima_actividad;
+    struct ConexionAnillo *anterior;  // lista por actividad, para los timeouts
+    struct ConexionAnillo *siguiente;
+    struct ConexionAnillo *siguiente_espera; // cola de conexiones esperando un bloque libre, o de cierres pendientes
+} ConexionAnillo;
+
+// accept en vuelo de un anillo; el kernel escribe aquí la dirección del cliente
+typedef struct {
+    struct sockaddr_in direccion;
+    socklen_t longitud;
+    int en_vuelo;
+} AceptacionAnillo;
+
+// Anillo io_uring: un hilo con su socket de escucha, sus colas de envío (SQ) y de
+// completados (CQ) compartidas con el kernel, su tabla de descriptores fijos, el
+// anillo de búferes de recepción y los bloques registrados para leer archivos
+typedef struct {
+    int id;
+    int anillo_fd;
+    int escucha_fd;
+    _Atomic unsigned *sq_cabeza;   // la avanza el kernel al consumir entradas
+    _Atomic unsigned *sq_cola;     // la avanza el hilo al publicarlas
+    unsigned sq_mascara;
+    unsigned sq_entradas;
+    unsigned sq_preparadas;        // cola local: entradas rellenas, aún sin publicar
+    struct io_uring_sqe *sqes;
+    _Atomic unsigned *cq_cabeza;
+    _Atomic unsigned *cq_cola;
+    unsigned cq_mascara;
+    struct io_uring_cqe *cqes;
+    void *mapa_colas;
+    size_t tam_mapa_colas;
+    size_t tam_mapa_sqes;
+    struct io_uring_buf_ring *buferes; // búferes de recepción prestados al kernel
+    char *memoria_buferes;
+    char *bloques;                 // BLOQUES_ANILLO bloques para leer archivos
+    int bloques_registrados;       // si no se pudieron registrar se lee con IORING_OP_READ
+    int bloques_libres[BLOQUES_ANILLO];
+    int num_bloques_libres;
+    ConexionAnillo *primera_espera; // cola de conexiones esperando un bloque
+    ConexionAnillo *ultima_espera;
+    ConexionAnillo *cierres_pendientes; // conexiones cuyo close no cupo en la SQ
+    int ranuras_por_cerrar[MAX_CONEXIONES_ANILLO]; // sockets rechazados cuyo close no cupo
+    int num_ranuras_por_cerrar;
+    AceptacionAnillo aceptaciones[ACEPTACIONES_EN_VUELO];
+    int aceptaciones_en_vuelo;
+    int conexiones_activas;        // desde el accept hasta que vuelve su close
+    BufferPaginas *buffer_paginas;
+    Losa conexiones;
+    Losa peticiones;
+    ConexionAnillo *menos_reciente;
+    ConexionAnillo *mas_reciente;
+    time_t ahora;
+    time_t limite_drenaje;
+    _Atomic int abandonar;         // el arranque falló: salir sin drenar ni cerrar la escucha
+    int habilitado;                // el hilo pudo habilitar el anillo (ver iniciar_anillos)
+} AnilloServidor;
+
+// Estructura para pasar argumentos a los hilos del pool
+typedef struct {
+    int id;
+    ColaConexiones *cola;
+    BufferPaginas *buffer_paginas;
+    ConexionEnServicio en_servicio;
+} PoolArgs;
+
 // Variables globales
 extern volatile sig_atomic_t servidor_corriendo;
-extern int servidor_fd_global;
+extern int sockets_escucha[MAX_REACTORES];
+extern int num_sockets_escucha;
 extern BufferPaginas buffer_global;
-extern pthread_mutex_t mutex_log;
+extern ConfigServidor config_global;
+extern volatile int nivel_diagnostico;
+extern const char *const nombres_codificacion[NUM_CODIFICACIONES];
+extern const char respuesta_503[];
 
 // Declaraciones de funciones compartidas 
-void inicializar_buffer(BufferPaginas *buffer);
-char *obtener_pagina(BufferPaginas *buffer, const char *ruta, size_t *tam_out);
+void inicializar_buffer(BufferPaginas *buffer, const ConfigServidor *config);
+Pagina *obtener_pagina(BufferPaginas *buffer, const char *ruta);
+void soltar_pagina(Pagina *pagina);
+void recargar_pagina(BufferPaginas *buffer, const char *ruta_archivo, int insertar_si_falta);
+int iniciar_vigilancia(BufferPaginas *buffer, const ConfigServidor *config);
+void detener_vigilancia(void);
 void imprimir_buffer(BufferPaginas *buffer);
 void registrar_conexion(const char *ip, int puerto, const char *pagina_solicitada);
+int iniciar_registro(const ConfigServidor *config);
+void detener_registro(void);
+unsigned long registros_descartados(void);
+void contar_metrica(ContadorMetrica contador, uint64_t n);
+void publicar_profundidad_cola(_Atomic int *profundidad);
+void registrar_latencia(FaseLatencia fase, uint64_t ns);
+size_t generar_metricas(char *destino, size_t tam);
+void registrar_diagnostico(int nivel, const char *formato, ...) __attribute__((format(printf, 2, 3)));
 void *hilo_despachador(void *arg);
 void *hilo_trabajador(void *arg);
-void cerrar_servidor(int signum);
 void liberar_buffer(BufferPaginas *buffer);
+void cargar_configuracion(ConfigServidor *config);
+int inicializar_cola(ColaConexiones *cola, int capacidad, PoliticaContrapresion politica, int limite_espera);
+int encolar_conexion(ColaConexiones *cola, int cliente_fd, int entrada_cliente);
+int desencolar_conexion(ColaConexiones *cola, uint64_t *espera_ns, int *entrada_cliente);
+int iniciar_pool(ColaConexiones *cola, BufferPaginas *buffer, int num_trabajadores);
+int detener_pool(ColaConexiones *cola, int plazo_segundos);
+uint64_t tiempo_monotonico_ns(void);
+void iniciar_limites_cliente(const ConfigServidor *config);
+void olvidar_conexiones_trabajador(int trabajador);
+int admitir_conexion(uint32_t ip);
+void soltar_conexion(int entrada);
+int admitir_peticion(int entrada);
+void iniciar_losa(Losa *losa, size_t tam_objeto, size_t objetos_por_tramo);
+void *tomar_de_losa(Losa *losa);
+void devolver_a_losa(Losa *losa, void *objeto);
+void iniciar_peticion_http(PeticionHttp *peticion);
+int analizar_peticion(PeticionHttp *peticion, const char *datos, size_t leidos, const LimitesHttp *limites);
+const VistaCadena *buscar_encabezado(const PeticionHttp *peticion, const char *nombre);
+int contiene_token(VistaCadena lista, const char *token);
+void procesar_peticion(BufferPaginas *buffer, const PeticionHttp *peticion, const char *ip, int puerto,
+                       int permitir_mantener, Respuesta *resp);
+void responder_peticion_invalida(Respuesta *resp, int codigo);
+void liberar_respuesta(Respuesta *resp);
+int partes_pendientes(const Respuesta *resp, size_t enviados, struct iovec *iov);
+int tramo_de_archivo(const Respuesta *resp, size_t enviados, off_t *posicion, size_t *tam);
+int enviar_respuesta(int cliente_fd, Respuesta *resp, size_t *enviados);
+int iniciar_reactores(int *sockets_escucha, int num_reactores, BufferPaginas *buffer);
+int detener_reactores(void);
+int iniciar_anillos(int *sockets_escucha, int num_anillos, BufferPaginas *buffer);
+int detener_anillos(void);
+int bloquear_senales(void);
+void *hilo_senales(void *arg);
+void guardar_argumentos(char **argv);
+int heredar_sockets_escucha(int *sockets, int max_sockets);
+void avisar_relevo_listo(void);
+int crear_socket_escucha(const char *ip, int puerto, int reutilizar_puerto, int no_bloqueante);
+int atender_conexiones(int senal_fd);
+int ejecutar_maestro(int senal_fd);
+int numero_trabajador(void);
+int reenviar_a_trabajadores(int senal);
+int trabajador_terminado(pid_t pid, int estado);
+int crear_segmento_compartido(size_t tam);
+void *copiar_a_segmento(const void *datos, size_t tam);
+int en_segmento(const void *bloque);
+void cerrar_segmento(void);
+void *reservar_compartido(size_t tam);
+void liberar_segmento(void);
 #endif // SERVIDOR_WEB_H
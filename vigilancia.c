@@ -0,0 +1,155 @@
+#include "servidor_web.h"
+
+// Vigilancia del contenido con inotify. Un hilo en segundo plano recibe los cambios de
+// paginas/ e imagenes/ (con sus subdirectorios) y sustituye o retira la entrada de la
+// caché con recargar_pagina(); los aciertos de los demás hilos no se bloquean.
+
+#define EVENTOS_ARCHIVO (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+// Directorio asociado a cada descriptor de vigilancia de inotify
+typedef struct {
+    int wd;
+    char *ruta;
+} DirectorioVigilado;
+
+static int inotify_fd = -1;
+static DirectorioVigilado vigilados[MAX_DIRECTORIOS_VIGILADOS];
+static int num_vigilados = 0;
+static int cargar_nuevos = 0; // con PRECARGA_TODO también se cargan los archivos que aparecen
+static pthread_t hilo;
+static int vigilancia_activa = 0;
+
+static int vigilar_directorio(const char *ruta, const struct stat *info, int tipo, struct FTW *ftw) {
+    (void)info;
+    (void)ftw;
+    if (tipo != FTW_D) {
+        return 0;
+    }
+    if (num_vigilados == MAX_DIRECTORIOS_VIGILADOS) {
+        DIAG_AVISO("[VIGILANCIA] Demasiados directorios; '%s' no se vigila.\n", ruta);
+        return 0;
+    }
+    int wd = inotify_add_watch(inotify_fd, ruta, EVENTOS_ARCHIVO | IN_CREATE | IN_ONLYDIR);
+    if (wd < 0) {
+        DIAG_AVISO("[VIGILANCIA] No se pudo vigilar '%s': %s\n", ruta, strerror(errno));
+        return 0;
+    }
+    for (int i = 0; i < num_vigilados; i++) {
+        if (vigilados[i].wd == wd) {
+            return 0; // ya estaba vigilado
+        }
+    }
+    char *copia = strdup(ruta);
+    if (copia) {
+        vigilados[num_vigilados].wd = wd;
+        vigilados[num_vigilados].ruta = copia;
+        num_vigilados++;
+    }
+    return 0;
+}
+
+static const char *ruta_vigilada(int wd) {
+    for (int i = 0; i < num_vigilados; i++) {
+        if (vigilados[i].wd == wd) {
+            return vigilados[i].ruta;
+        }
+    }
+    return NULL;
+}
+
+// Olvida un directorio que inotify dejó de vigilar (borrado o movido fuera).
+static void olvidar_directorio(int wd) {
+    for (int i = 0; i < num_vigilados; i++) {
+        if (vigilados[i].wd == wd) {
+            free(vigilados[i].ruta);
+            vigilados[i] = vigilados[--num_vigilados];
+            return;
+        }
+    }
+}
+
+static void procesar_evento(BufferPaginas *buffer, const struct inotify_event *evento) {
+    if (evento->mask & IN_Q_OVERFLOW) {
+        DIAG_AVISO("[VIGILANCIA] Se perdieron eventos de inotify; la caché puede tener entradas antiguas.\n");
+        return;
+    }
+    if (evento->mask & IN_IGNORED) {
+        olvidar_directorio(evento->wd);
+        return;
+    }
+    const char *directorio = ruta_vigilada(evento->wd);
+    if (!directorio || evento->len == 0) {
+        return;
+    }
+    char ruta[512];
+    int n = snprintf(ruta, sizeof(ruta), "%s/%s", directorio, evento->name);
+    if (n <= 0 || (size_t)n >= sizeof(ruta)) {
+        return;
+    }
+
+    if (evento->mask & IN_ISDIR) {
+        if (evento->mask & (IN_CREATE | IN_MOVED_TO)) {
+            nftw(ruta, vigilar_directorio, 16, FTW_PHYS);
+        }
+        return;
+    }
+    if (evento->mask & EVENTOS_ARCHIVO) {
+        DIAG_DEPURACION("[VIGILANCIA] Cambio en '%s' (máscara 0x%x).\n", ruta, evento->mask);
+        recargar_pagina(buffer, ruta, cargar_nuevos && (evento->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)));
+    }
+}
+
+static void *hilo_vigilancia(void *arg) {
+    BufferPaginas *buffer = arg;
+    char eventos[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+    while (servidor_corriendo) {
+        // El timeout permite ver el fin del servidor aunque no lleguen eventos.
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        ssize_t n = read(inotify_fd, eventos, sizeof(eventos));
+        if (n <= 0) {
+            continue;
+        }
+        for (char *p = eventos; p < eventos + n;) {
+            const struct inotify_event *evento = (const struct inotify_event *)p;
+            procesar_evento(buffer, evento);
+            p += sizeof(struct inotify_event) + evento->len;
+        }
+    }
+    return NULL;
+}
+
+// Empieza a vigilar el árbol de contenido. Devuelve -1 si inotify no está disponible.
+int iniciar_vigilancia(BufferPaginas *buffer, const ConfigServidor *config) {
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        perror("[VIGILANCIA] Error en inotify_init1");
+        return -1;
+    }
+    cargar_nuevos = (config->precarga == PRECARGA_TODO);
+    nftw(PAGINAS_DIR, vigilar_directorio, 16, FTW_PHYS);
+    nftw(IMAGENES_DIR, vigilar_directorio, 16, FTW_PHYS);
+
+    if (pthread_create(&hilo, NULL, hilo_vigilancia, buffer) != 0) {
+        perror("[VIGILANCIA] Error al crear el hilo de vigilancia");
+        close(inotify_fd);
+        inotify_fd = -1;
+        return -1;
+    }
+    vigilancia_activa = 1;
+    DIAG_INFO("[VIGILANCIA] Vigilando %d directorios de contenido.\n", num_vigilados);
+    return 0;
+}
+
+// Espera a que el hilo de vigilancia vea el apagado, para que no recargue páginas
+// mientras se libera la caché.
+void detener_vigilancia(void) {
+    if (vigilancia_activa) {
+        pthread_join(hilo, NULL);
+        close(inotify_fd);
+        inotify_fd = -1;
+        vigilancia_activa = 0;
+    }
+}